@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "argparse.h"
+
+/* Bytes of arguments parsed at each length, so every case costs the same */
+#define TOTAL_BYTES (64 * 1024 * 1024)
+
+
+/**
+ * @brief Get the current time.
+ * 
+ * @return double Seconds on CLOCK_MONOTONIC
+ */
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Build a run command with a number of arguments, every fourth one
+ * quoted.
+ * 
+ * @param words Number of arguments
+ * @return char* Command. Must be freed
+ */
+static char *make_command(size_t words) {
+    size_t size = 16 + words * 24;
+    char *command = malloc(size);
+    if (command == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t length = (size_t)snprintf(command, size, "run program");
+    for (size_t i = 0; i < words; ++i) {
+        const char *format = i % 4 == 3 ? " 'quoted %zu'" : " arg%zu";
+        length += (size_t)snprintf(command + length, size - length, format, i);
+    }
+    return command;
+}
+
+/**
+ * @brief Time parsing a command of a given number of arguments over and over
+ * into the same args, as a worker does.
+ * 
+ * @param words Number of arguments
+ */
+static void bench_words(size_t words) {
+    char *command = make_command(words);
+    size_t length = strlen(command);
+    size_t rounds = TOTAL_BYTES / length + 1;
+
+    args a;
+    args_init(&a);
+    size_t tokens = 0;
+    double start = seconds();
+    for (size_t i = 0; i < rounds; ++i) {
+        if (args_parse(&a, command) < 0) {
+            perror("args_parse");
+            exit(EXIT_FAILURE);
+        }
+        tokens += a.token_count;
+    }
+    double elapsed = seconds() - start;
+
+    printf("%6zu words: %8.0f ns/command, %6.2f ns/word, %5.0f MB/s\n",
+           words, elapsed * 1e9 / (double)rounds,
+           elapsed * 1e9 / (double)tokens,
+           (double)(length * rounds) / elapsed / 1e6);
+    args_free(&a);
+    free(command);
+}
+
+int main(void) {
+    size_t words[] = { 1, 16, 256, 4096, 65536 };
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i) {
+        bench_words(words[i]);
+    }
+    return EXIT_SUCCESS;
+}
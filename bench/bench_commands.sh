@@ -0,0 +1,18 @@
+#!/bin/bash
+# Commands per second through the runner, from a script sent in batches
+. "$(dirname "$0")/../tests/lib.sh"
+
+N=${N:-100000}
+
+for i in $(seq "$N"); do
+    echo "logs $i"
+done > "$TMP/commands"
+
+for workers in 1 2 4; do
+    start=$(now)
+    "$SHELL_BIN" -j $workers -c $workers -f "$TMP/commands" > /dev/null 2>&1
+    t=$(elapsed "$start")
+    awk -v n="$N" -v t="$t" -v w="$workers" \
+        'BEGIN { printf "%d commands, %d workers: %.2fs, %.0f commands/s\n",
+                 n, w, t, n / t }'
+done
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Time launching job arrays through each launch path, until every job shows
+# up in list. Jobs either all get a slot or all wait for one
+. "$(dirname "$0")/../tests/lib.sh"
+
+SIZES=${SIZES:-"1000 10000"}
+
+running() {
+    [ "$(grep -c ",$1,")" -eq "$2" ]
+}
+
+for n in $SIZES; do
+    for mode in "" "-z" "-t 4"; do
+        for slots in "$n" 1; do
+            state=RUNNING
+            [ "$slots" -eq 1 ] && state=READY
+            # shellcheck disable=SC2086
+            pm_start -c "$slots" -i 0 $mode
+            start=$(now)
+            pm_do "run -n $n sleep 60" > /dev/null
+            TIMEOUT=600 pm_wait running "$state" $((n - (slots == 1)))
+            t=$(elapsed "$start")
+            pm_stop
+            awk -v n="$n" -v t="$t" -v mode="${mode:-direct}" -v state="$state" \
+                'BEGIN { printf "%6d jobs %-6s %-7s %6.2fs %7.0f jobs/s\n",
+                         n, mode, state, t, n / t }'
+        done
+    done
+done
@@ -0,0 +1,90 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pidmap.h"
+
+/* Lookups timed at each size, enough to dwarf the clock reads */
+#define LOOKUPS 4000000
+
+
+/**
+ * @brief Get the current time.
+ * 
+ * @return double Seconds on CLOCK_MONOTONIC
+ */
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Time lookups of present and absent pids, then churn, in a map of a
+ * given size.
+ * 
+ * @param size Number of pids in the map
+ * @param stride Gap between pids, as on a busy host where other processes
+ * take the ones in between
+ */
+static void bench_size(size_t size, size_t stride) {
+    pidmap m;
+    pidmap_init(&m);
+    for (size_t i = 0; i < size; ++i) {
+        pid_t pid = (pid_t)(1 + i * stride);
+        if (pidmap_put(&m, pid, (void *)(uintptr_t)pid) < 0) {
+            perror("pidmap_put");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* A cheap generator, so lookups hit the table in no particular order */
+    uint32_t x = 12345;
+    uintptr_t found = 0;
+    double start = seconds();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        x = x * 1664525 + 1013904223;
+        pid_t pid = (pid_t)(1 + (x % size) * stride);
+        found += (uintptr_t)pidmap_get(&m, pid);
+    }
+    double hit_ns = (seconds() - start) * 1e9 / LOOKUPS;
+
+    start = seconds();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        x = x * 1664525 + 1013904223;
+        pid_t pid = (pid_t)(2 + (x % size) * stride);
+        found += (uintptr_t)pidmap_get(&m, pid);
+    }
+    double miss_ns = (seconds() - start) * 1e9 / LOOKUPS;
+
+    /* Jobs exit and new ones take fresh pids, like a long-running worker */
+    pid_t next = (pid_t)(1 + size * stride);
+    start = seconds();
+    for (size_t i = 0; i < LOOKUPS / 4; ++i) {
+        pidmap_remove(&m, (pid_t)(1 + (i % size) * stride));
+        pidmap_put(&m, next, (void *)(uintptr_t)next);
+        pidmap_remove(&m, next);
+        pidmap_put(&m, (pid_t)(1 + (i % size) * stride), NULL);
+        next += (pid_t)stride;
+    }
+    double churn_ns = (seconds() - start) * 1e9 / LOOKUPS;
+
+    printf("%8zu pids, stride %zu: hit %6.1f ns, miss %6.1f ns, "
+           "churn %6.1f ns/op%s\n", size, stride, hit_ns, miss_ns, churn_ns,
+           found == 0 ? " (no hits)" : "");
+    pidmap_free(&m);
+}
+
+int main(void) {
+    /* Power of two strides leave the low bits of every pid the same */
+    size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    size_t strides[] = { 2, 3, 4 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        for (size_t j = 0; j < sizeof(strides) / sizeof(strides[0]); ++j) {
+            bench_size(sizes[i], strides[j]);
+        }
+    }
+    return EXIT_SUCCESS;
+}
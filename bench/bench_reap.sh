@@ -0,0 +1,13 @@
+#!/bin/bash
+# Time from submitting a burst of trivial jobs until every one is reaped
+. "$(dirname "$0")/../tests/lib.sh"
+
+N=${N:-10000}
+
+pm_start -c "${SLOTS:-$(nproc)}"
+start=$(now)
+pm_do "run -n $N true"
+TIMEOUT=600 pm_wait no_live_jobs
+t=$(elapsed "$start")
+awk -v n="$N" -v t="$t" \
+    'BEGIN { printf "%d jobs reaped in %.2fs, %.0f jobs/s\n", n, t, n / t }'
@@ -0,0 +1,31 @@
+#!/bin/bash
+# CPU used by a worker sampling many idle jobs, as a share of one core
+. "$(dirname "$0")/../tests/lib.sh"
+
+N=${N:-10000}
+PERIOD=${PERIOD:-10}
+
+# Print the CPU seconds a process has used
+cpu_seconds() {
+    awk -v hz="$(getconf CLK_TCK)" '{
+        sub(/.*\) /, "")
+        printf "%.3f", ($12 + $13) / hz
+    }' "/proc/$1/stat"
+}
+
+for interval in 0 1000 100; do
+    pm_start -c "$N" -i $interval
+    pm_do "run -n $N sleep 600" > /dev/null
+    worker=$(pgrep -P "$PM_PID" -x shell)
+
+    # Launching is done once every job is in list
+    TIMEOUT=600 pm_wait awk -v n="$N" '/,RUNNING,/ { c++ } END { exit c != n }'
+    sleep 1
+    before=$(cpu_seconds "$worker")
+    sleep "$PERIOD"
+    after=$(cpu_seconds "$worker")
+    awk -v n="$N" -v i=$interval -v used="$(awk -v a="$after" -v b="$before" \
+        'BEGIN { print a - b }')" -v p="$PERIOD" \
+        'BEGIN { printf "%d jobs, -i %4d: %.2f%% of a core\n", n, i, used / p * 100 }'
+    pm_stop
+done
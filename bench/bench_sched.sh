@@ -0,0 +1,34 @@
+#!/bin/bash
+# Mean and p99 turnaround of a mixed workload under each policy: a few long
+# CPU-bound jobs with many short ones arriving among them, on one slot
+. "$(dirname "$0")/../tests/lib.sh"
+
+# list only remembers the last 64 jobs, so the workload stays below that
+LONG_JOBS=${LONG_JOBS:-3}
+SHORT_JOBS=${SHORT_JOBS:-30}
+LONG="sh -c 'i=0; while [ \$i -lt 400000 ]; do i=\$((i+1)); done'"
+SHORT="sh -c 'i=0; while [ \$i -lt 10000 ]; do i=\$((i+1)); done'"
+
+# Print mean and p99 of the wall times in terminated lines on stdin
+turnaround() {
+    awk -F, '$2 == "TERMINATED" { print $4 }' | sort -n | awk '
+        { t[NR] = $1; sum += $1 }
+        END {
+            p99 = t[int((NR - 1) * 0.99) + 1]
+            printf "%d jobs, mean %.3fs, p99 %.3fs", NR, sum / NR, p99
+        }'
+}
+
+for policy in fifo rr mlfq; do
+    pm_start -c 1 -s $policy -i 0
+    start=$(now)
+    for i in $(seq "$SHORT_JOBS"); do
+        [ $((i % (SHORT_JOBS / LONG_JOBS))) -eq 1 ] && pm_do "run $LONG"
+        pm_do "run $SHORT"
+        sleep 0.02
+    done
+    TIMEOUT=600 pm_wait no_live_jobs
+    t=$(elapsed "$start")
+    echo "$policy: $(pm_do list | turnaround), done in ${t}s"
+    pm_stop
+done
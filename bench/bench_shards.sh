@@ -0,0 +1,18 @@
+#!/bin/bash
+# Spawn and reap throughput of trivial jobs as the number of workers grows
+. "$(dirname "$0")/../tests/lib.sh"
+
+N=${N:-10000}
+# Workers never outnumber slots
+SLOTS=${SLOTS:-8}
+
+for workers in 1 2 4 8; do
+    pm_start -j $workers -c "$SLOTS" -i 0
+    start=$(now)
+    pm_do "run -n $N true" > /dev/null
+    TIMEOUT=600 pm_wait no_live_jobs
+    t=$(elapsed "$start")
+    pm_stop
+    awk -v n="$N" -v t="$t" -v w=$workers \
+        'BEGIN { printf "%d jobs, %d workers: %.2fs, %.0f jobs/s\n", n, w, t, n / t }'
+done
@@ -0,0 +1,19 @@
+#!/bin/bash
+# Run every benchmark, or the ones named on the command line. Scripts drive
+# the shell, binaries time a single module
+
+cd "$(dirname "$0")" || exit 1
+
+benches=("$@")
+if [ ${#benches[@]} -eq 0 ]; then
+    benches=(bench_*.sh ../bin/bench_*)
+fi
+
+for b in "${benches[@]}"; do
+    [ -e "$b" ] || continue
+    echo "== $(basename "$b")"
+    case $b in
+        *.sh) bash "$b" ;;
+        *) "$b" ;;
+    esac
+done
@@ -1,7 +1,7 @@
 #!/bin/sh
 
 CC=gcc
-CFLAGS='-Wall -Werror -Wextra -Wconversion -Wpedantic -Wstrict-prototypes -std=gnu17 -g'
+CFLAGS='-Wall -Werror -Wextra -Wconversion -Wpedantic -Wstrict-prototypes -std=gnu17 -pthread -g'
 SRC_DIR=./src
 BUILD_DIR=./bin
 EXE=$BUILD_DIR/shell
@@ -9,8 +9,18 @@ EXE=$BUILD_DIR/shell
 mkdir -p $BUILD_DIR
 
 # Compile main executable test binary
-SRC="$SRC_DIR/main.c $SRC_DIR/argparse.c $SRC_DIR/procman.c $SRC_DIR/runner.c $SRC_DIR/input.c"
+SRC="$SRC_DIR/main.c $SRC_DIR/argparse.c $SRC_DIR/procman.c $SRC_DIR/runner.c $SRC_DIR/input.c $SRC_DIR/pidmap.c $SRC_DIR/pqueue.c $SRC_DIR/ptable.c $SRC_DIR/history.c $SRC_DIR/spawn.c $SRC_DIR/zygote.c $SRC_DIR/reply.c $SRC_DIR/buffer.c $SRC_DIR/command.c $SRC_DIR/sched.c $SRC_DIR/affinity.c $SRC_DIR/cgroup.c $SRC_DIR/procstat.c $SRC_DIR/pressure.c $SRC_DIR/slotpool.c $SRC_DIR/spawner.c $SRC_DIR/joblog.c $SRC_DIR/journal.c"
 $CC $CFLAGS $SRC -o $EXE
 
 # Compile prog test binary
 $CC $CFLAGS $SRC_DIR/prog.c -o $BUILD_DIR/prog
+
+# Compile module microbenchmarks, optimised unlike the shell
+$CC $CFLAGS -O2 -I$SRC_DIR ./bench/bench_pidmap.c $SRC_DIR/pidmap.c -o $BUILD_DIR/bench_pidmap
+$CC $CFLAGS -O2 -I$SRC_DIR ./bench/bench_argparse.c $SRC_DIR/argparse.c -o $BUILD_DIR/bench_argparse
+
+# Run the tests or benchmarks when asked to
+case "$1" in
+    check) exec bash ./tests/run.sh ;;
+    bench) exec bash ./bench/run.sh ;;
+esac
@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <sched.h>
+
+#include "affinity.h"
+
+#define NODE_CPULIST "/sys/devices/system/node/node%d/cpulist"
+#define MAX_NODES 64
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Read the CPUs of a NUMA node from sysfs.
+ * 
+ * @param node Target node
+ * @param cpus Destination set
+ * @return true The node exists
+ * @return false The node does not exist or could not be read
+ */
+static bool read_node_cpus(int node, cpu_set_t *cpus) {
+    char path[64];
+    snprintf(path, sizeof(path), NODE_CPULIST, node);
+
+    FILE *file = fopen(path, "re");
+    if (file == NULL) {
+        return false;
+    }
+
+    /* List of ranges such as 0-3,8-11 */
+    CPU_ZERO(cpus);
+    int first, last;
+    while (fscanf(file, "%d", &first) == 1) {
+        last = first;
+        int c = fgetc(file);
+        if (c == '-') {
+            if (fscanf(file, "%d", &last) != 1) {
+                break;
+            }
+            c = fgetc(file);
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET((size_t)cpu, cpus);
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**
+ * @brief Find the NUMA node of every allowed CPU.
+ * 
+ * @param allowed CPUs the worker may run on
+ * @param nodes Destination indexed by CPU, left at 0 when unknown
+ * @param node_cpus Destination holding the allowed CPUs of every node
+ */
+static void map_nodes(const cpu_set_t *allowed, int *nodes,
+                      cpu_set_t *node_cpus) {
+    for (int node = 0; node < MAX_NODES; ++node) {
+        cpu_set_t cpus;
+        if (!read_node_cpus(node, &cpus)) {
+            continue;
+        }
+
+        CPU_AND(&node_cpus[node], &cpus, allowed);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET((size_t)cpu, &node_cpus[node])) {
+                nodes[cpu] = node;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Find the next allowed CPU, wrapping around.
+ * 
+ * @param allowed CPUs to pick from, not empty
+ * @param cpu Current CPU. -1 to start from the first
+ * @return int Next allowed CPU after cpu
+ */
+static int next_cpu(const cpu_set_t *allowed, int cpu) {
+    do {
+        cpu = (cpu + 1) % CPU_SETSIZE;
+    } while (!CPU_ISSET((size_t)cpu, allowed));
+    return cpu;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Count the CPUs the calling process may run on.
+ * 
+ * @return size_t Number of CPUs, at least 1
+ */
+size_t affinity_cpu_count(void) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return 1;
+    }
+
+    int count = CPU_COUNT(&allowed);
+    return count > 0 ? (size_t)count : 1;
+}
+
+/**
+ * @brief Work out the CPU set of every slot.
+ * 
+ * @param a Target placement
+ * @param mode How slots are bound to CPUs
+ * @param first_slot Index of the first slot among the slots of every worker,
+ * so that workers sharing the CPUs start on different ones
+ * @param slot_count Number of slots
+ * @return int 0 if successful. -1 otherwise
+ */
+int affinity_init(affinity *a, affinity_mode mode, size_t first_slot,
+                  size_t slot_count) {
+    a->mode = mode;
+    a->slot_count = slot_count;
+    a->slot_cpus = NULL;
+    a->slot_nodes = NULL;
+    if (mode == AFFINITY_NONE || slot_count == 0) {
+        return 0;
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return -1;
+    }
+
+    cpu_set_t *slot_cpus = calloc(slot_count, sizeof(cpu_set_t));
+    a->slot_cpus = slot_cpus;
+    a->slot_nodes = calloc(slot_count, sizeof(int));
+    int *nodes = calloc(CPU_SETSIZE, sizeof(int));
+    cpu_set_t *node_cpus = calloc(MAX_NODES, sizeof(cpu_set_t));
+    if (a->slot_cpus == NULL || a->slot_nodes == NULL || nodes == NULL
+        || node_cpus == NULL) {
+        free(nodes);
+        free(node_cpus);
+        affinity_free(a);
+        return -1;
+    }
+    map_nodes(&allowed, nodes, node_cpus);
+
+    /* Deal allowed CPUs out to slots in order, wrapping around. Slots before
+     * the first one belong to other workers
+     */
+    int cpu = -1;
+    size_t skipped = first_slot % (size_t)CPU_COUNT(&allowed);
+    for (size_t i = 0; i < skipped; ++i) {
+        cpu = next_cpu(&allowed, cpu);
+    }
+
+    for (size_t slot = 0; slot < slot_count; ++slot) {
+        cpu = next_cpu(&allowed, cpu);
+
+        a->slot_nodes[slot] = nodes[cpu];
+        if (mode == AFFINITY_NUMA && CPU_COUNT(&node_cpus[nodes[cpu]]) > 0) {
+            slot_cpus[slot] = node_cpus[nodes[cpu]];
+        } else {
+            CPU_ZERO(&slot_cpus[slot]);
+            CPU_SET((size_t)cpu, &slot_cpus[slot]);
+        }
+    }
+
+    free(nodes);
+    free(node_cpus);
+    return 0;
+}
+
+/**
+ * @brief Get the NUMA node of a slot.
+ * 
+ * @param a Target placement
+ * @param slot Target slot
+ * @return int Node of the slot. 0 when nodes are unknown
+ */
+int affinity_node(const affinity *a, size_t slot) {
+    return a->slot_nodes != NULL ? a->slot_nodes[slot] : 0;
+}
+
+/**
+ * @brief Bind a process to the CPU set of a slot.
+ * 
+ * @param a Target placement
+ * @param slot Slot the process runs in
+ * @param pid Target process
+ * @return int 0 if successful or placement is disabled. -1 otherwise
+ */
+int affinity_apply(const affinity *a, size_t slot, pid_t pid) {
+    if (a->slot_cpus == NULL) {
+        return 0;
+    }
+    const cpu_set_t *slot_cpus = a->slot_cpus;
+    return sched_setaffinity(pid, sizeof(cpu_set_t), &slot_cpus[slot]);
+}
+
+/**
+ * @brief Deallocate memory used by the placement.
+ * 
+ * @param a Target placement
+ */
+void affinity_free(affinity *a) {
+    free(a->slot_cpus);
+    free(a->slot_nodes);
+    a->slot_cpus = NULL;
+    a->slot_nodes = NULL;
+    a->slot_count = 0;
+}
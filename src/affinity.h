@@ -0,0 +1,71 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef enum affinity_mode {
+    AFFINITY_NONE,  /* Leave placement to the kernel */
+    AFFINITY_CPU,   /* Bind every slot to a single CPU */
+    AFFINITY_NUMA,  /* Bind every slot to the CPUs of a NUMA node */
+} affinity_mode;
+
+/**
+ * CPU sets of the running slots of a process manager. Slots are spread over
+ * the CPUs available to the worker in order, wrapping around when there are
+ * more slots than CPUs.
+ */
+typedef struct affinity {
+    affinity_mode mode;
+    size_t slot_count;
+    void *slot_cpus;    /* cpu_set_t of every slot, kept out of the header */
+    int *slot_nodes;
+} affinity;
+
+/**
+ * @brief Count the CPUs the calling process may run on.
+ * 
+ * @return size_t Number of CPUs, at least 1
+ */
+size_t affinity_cpu_count(void);
+
+/**
+ * @brief Work out the CPU set of every slot.
+ * 
+ * @param a Target placement
+ * @param mode How slots are bound to CPUs
+ * @param first_slot Index of the first slot among the slots of every worker,
+ * so that workers sharing the CPUs start on different ones
+ * @param slot_count Number of slots
+ * @return int 0 if successful. -1 otherwise
+ */
+int affinity_init(affinity *a, affinity_mode mode, size_t first_slot,
+                  size_t slot_count);
+
+/**
+ * @brief Get the NUMA node of a slot.
+ * 
+ * @param a Target placement
+ * @param slot Target slot
+ * @return int Node of the slot. 0 when nodes are unknown
+ */
+int affinity_node(const affinity *a, size_t slot);
+
+/**
+ * @brief Bind a process to the CPU set of a slot.
+ * 
+ * @param a Target placement
+ * @param slot Slot the process runs in
+ * @param pid Target process
+ * @return int 0 if successful or placement is disabled. -1 otherwise
+ */
+int affinity_apply(const affinity *a, size_t slot, pid_t pid);
+
+/**
+ * @brief Deallocate memory used by the placement.
+ * 
+ * @param a Target placement
+ */
+void affinity_free(affinity *a);
+
+#endif
@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <errno.h>
 
 #include "argparse.h"
 
@@ -10,61 +12,40 @@
 
 
 /**
- * @brief Count number of null delimited strings in bytes.
+ * @brief Check for a character separating words.
  * 
- * @param bytes Source data ended with a double null character
- * @return size_t Number of tokens
+ * @param c Target character
+ * @return true c is whitespace
+ * @return false c is part of a word
  */
-static size_t count_tokens(const char *bytes) {
-    size_t count = 0;
-
-    /* Bytes is ended by a double null terminator */
-    while (*bytes || *(bytes + 1)) {
-        
-        /* Tokens are delimited by a single null terminator */
-        if (*bytes && *(bytes + 1) == '\0') {
-            count++;
-        }
-        bytes++;
-    }
-
-    return count;
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v'
+        || c == '\f';
 }
 
 /**
- * @brief Create an argv array from a given byte string representation.
+ * @brief Make the arena large enough for any parse of a string.
  * 
- * @param bytes Source data ended with a null character
- * @param token_count Number of tokens in bytes
- * @return char** Array of string tokens parsed. Last item in array is NULL
+ * A string of n bytes holds at most n / 2 + 1 words, and the words with
+ * their terminators never take more than n + 1 bytes.
+ * 
+ * @param a Target args
+ * @param len Length of the string to parse
+ * @return int 0 if successful. -1 otherwise
  */
-static char **to_argv(char *bytes, size_t token_count) {
-    char **argv = calloc(token_count + 1, sizeof(char *));
-    argv[token_count] = NULL;
-    
-    size_t i = 0;
-    char *iter = bytes;
-    
-    while (*iter) {
-        argv[i++] = iter;
-        iter += strlen(iter) + 1;
+static int args_reserve(args *a, size_t len) {
+    size_t size = (len / 2 + 2) * sizeof(char *) + len + 1;
+    if (size <= a->arena_size) {
+        return 0;
     }
 
-    return argv;
-}
-
-/**
- * @brief Consumes a string of bytes and casts it into args
- * 
- * @param a destination
- * @param bytes source
- * @param size number of bytes
- */
-static void args_cast(args *a, char *bytes, size_t size) {
-    a->bytes = bytes;
-    a->bytes_size = size;
-    a->token_count = count_tokens(bytes);
-    a->argv = to_argv(bytes, a->token_count);
+    char *arena = realloc(a->arena, size);
+    if (arena == NULL) {
+        return -1;
+    }
+    a->arena = arena;
+    a->arena_size = size;
+    return 0;
 }
 
 
@@ -73,36 +54,94 @@ static void args_cast(args *a, char *bytes, size_t size) {
  ******************************************************************************/
 
 
+/**
+ * @brief Initialise empty args
+ * 
+ * @param a Target args
+ */
+void args_init(args *a) {
+    a->token_count = 0;
+    a->argv = NULL;
+    a->arena = NULL;
+    a->arena_size = 0;
+}
+
 /**
  * @brief Collect whitespace delimited words into args
  * 
+ * Words may be quoted with '' or "" to keep whitespace. A backslash escapes
+ * the next character outside of quotes and a backslash or " within "".
+ * 
  * @param a Destination args
  * @param str Source string
+ * @return int 0 if successful. -1 with errno set to EINVAL on an unterminated
+ * quote or escape, or to ENOMEM
  */
-void args_parse(args *a, const char *str) {
-    /* Initialise buffer with 2 additional bytes for a double null terminator */
-    char *buffer = calloc(strlen(str) + 2, sizeof(char));
-    size_t len = 0;
-    
-    /* Add '\0' after every token and trim additonal whitespace between them. */
-    while (*str != '\0') {
-        /* Skip contiguous whitespaces */
-        while (*str == ' ') {
-            str++;
+int args_parse(args *a, const char *str) {
+    size_t len = strlen(str);
+    a->token_count = 0;
+    if (args_reserve(a, len) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* Pointers go first in the arena and the words they point to after */
+    char **argv = (char **)(void *)a->arena;
+    char *out = a->arena + (len / 2 + 2) * sizeof(char *);
+    size_t count = 0;
+    bool in_word = false;
+    char quote = '\0';
+
+    /* Copy each word once, dropping quotes and escapes along the way */
+    for (const char *iter = str; *iter != '\0'; ++iter) {
+        char c = *iter;
+
+        if (quote == '\0' && is_blank(c)) {
+            if (in_word) {
+                *out++ = '\0';
+                in_word = false;
+            }
+            continue;
+        }
+
+        if (!in_word) {
+            argv[count++] = out;
+            in_word = true;
         }
-        while (*str != ' ' && *str != '\0') {
-            buffer[len++] = *str;
-            str++;
+
+        if (c == '\\' && quote != '\'') {
+            char next = *(iter + 1);
+            if (next == '\0') {
+                errno = EINVAL;
+                return -1;
+            }
+            /* Within "" only the quote and backslash itself are escaped */
+            if (quote == '\0' || next == '"' || next == '\\') {
+                c = next;
+                iter++;
+            }
+            *out++ = c;
+        } else if (quote == '\0' && (c == '\'' || c == '"')) {
+            quote = c;
+        } else if (c == quote) {
+            quote = '\0';
+        } else {
+            *out++ = c;
         }
-        buffer[len++] = '\0';
     }
-    
-    /* Length of bytes + 1 additional null terminator */
-    len += 1;
-    
-    buffer = realloc(buffer, len * sizeof(char));
-    
-    args_cast(a, buffer, len);
+
+    if (quote != '\0') {
+        errno = EINVAL;
+        return -1;
+    }
+    if (in_word) {
+        *out = '\0';
+    }
+
+    argv[count] = NULL;
+    a->argv = argv;
+    a->token_count = count;
+    return 0;
 }
 
 /**
@@ -111,9 +150,6 @@ void args_parse(args *a, const char *str) {
  * @param a Target args
  */
 void args_free(args *a) {
-    free(a->argv);
-    a->argv = NULL;
-
-    free(a->bytes);
-    a->bytes = NULL;
+    free(a->arena);
+    args_init(a);
 }
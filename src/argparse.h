@@ -3,20 +3,36 @@
 
 #include <stddef.h>
 
+/**
+ * Words of a command. The argv array and the words it points to live in a
+ * single arena that is kept and reused by the next args_parse().
+ */
 typedef struct args {
-    size_t bytes_size;
     size_t token_count;
-    char *bytes;
     char **argv;
+    char *arena;
+    size_t arena_size;
 } args;
 
+/**
+ * @brief Initialise empty args
+ * 
+ * @param a Target args
+ */
+void args_init(args *a);
+
 /**
  * @brief Collect whitespace delimited words into args
  * 
+ * Words may be quoted with '' or "" to keep whitespace. A backslash escapes
+ * the next character outside of quotes and a backslash or " within "".
+ * 
  * @param a Destination args
  * @param str Source string
+ * @return int 0 if successful. -1 with errno set to EINVAL on an unterminated
+ * quote or escape, or to ENOMEM
  */
-void args_parse(args *a, const char *str);
+int args_parse(args *a, const char *str);
 
 /**
  * @brief Deallocate internally memory used by args
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+
+#define BUFFER_INITIAL_CAPACITY 4096
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise an empty buffer.
+ * 
+ * @param b Target buffer
+ */
+void buffer_init(buffer *b) {
+    b->data = NULL;
+    b->start = 0;
+    b->end = 0;
+    b->capacity = 0;
+}
+
+/**
+ * @brief Make room for a number of bytes after the end.
+ * 
+ * @param b Target buffer
+ * @param size Number of bytes
+ * @return int 0 if successful. -1 otherwise
+ */
+int buffer_reserve(buffer *b, size_t size) {
+    if (b->capacity - b->end >= size) {
+        return 0;
+    }
+
+    /* Reclaim consumed space before growing */
+    size_t used = b->end - b->start;
+    if (b->start > 0) {
+        memmove(b->data, b->data + b->start, used);
+        b->start = 0;
+        b->end = used;
+        if (b->capacity - b->end >= size) {
+            return 0;
+        }
+    }
+
+    size_t capacity = b->capacity ? b->capacity : BUFFER_INITIAL_CAPACITY;
+    while (capacity - used < size) {
+        capacity *= 2;
+    }
+
+    char *data = realloc(b->data, capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    b->data = data;
+    b->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Append bytes to the end.
+ * 
+ * @param b Target buffer
+ * @param bytes Bytes to copy in
+ * @param size Number of bytes
+ * @return int 0 if successful. -1 otherwise
+ */
+int buffer_append(buffer *b, const void *bytes, size_t size) {
+    if (buffer_reserve(b, size) < 0) {
+        return -1;
+    }
+
+    memcpy(b->data + b->end, bytes, size);
+    b->end += size;
+    return 0;
+}
+
+/**
+ * @brief Get the number of unconsumed bytes.
+ * 
+ * @param b Target buffer
+ * @return size_t Number of bytes between start and end
+ */
+size_t buffer_size(const buffer *b) {
+    return b->end - b->start;
+}
+
+/**
+ * @brief Drop bytes from the start.
+ * 
+ * @param b Target buffer
+ * @param size Number of bytes, at most buffer_size()
+ */
+void buffer_consume(buffer *b, size_t size) {
+    b->start += size;
+
+    /* Rewind for free once everything is consumed */
+    if (b->start == b->end) {
+        b->start = 0;
+        b->end = 0;
+    }
+}
+
+/**
+ * @brief Drop bytes from the end.
+ * 
+ * @param b Target buffer
+ * @param size Number of bytes kept, at most buffer_size()
+ */
+void buffer_truncate(buffer *b, size_t size) {
+    b->end = b->start + size;
+    if (size == 0) {
+        b->start = 0;
+        b->end = 0;
+    }
+}
+
+/**
+ * @brief Deallocate memory used by the buffer.
+ * 
+ * @param b Target buffer
+ */
+void buffer_free(buffer *b) {
+    free(b->data);
+    buffer_init(b);
+}
@@ -0,0 +1,75 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+
+/**
+ * Growable byte queue. Bytes are appended at the end and consumed from the
+ * start, and the unconsumed bytes are only moved to the front when more room
+ * is needed.
+ */
+typedef struct buffer {
+    char *data;
+    size_t start;
+    size_t end;
+    size_t capacity;
+} buffer;
+
+/**
+ * @brief Initialise an empty buffer.
+ * 
+ * @param b Target buffer
+ */
+void buffer_init(buffer *b);
+
+/**
+ * @brief Make room for a number of bytes after the end.
+ * 
+ * @param b Target buffer
+ * @param size Number of bytes
+ * @return int 0 if successful. -1 otherwise
+ */
+int buffer_reserve(buffer *b, size_t size);
+
+/**
+ * @brief Append bytes to the end.
+ * 
+ * @param b Target buffer
+ * @param bytes Bytes to copy in
+ * @param size Number of bytes
+ * @return int 0 if successful. -1 otherwise
+ */
+int buffer_append(buffer *b, const void *bytes, size_t size);
+
+/**
+ * @brief Get the number of unconsumed bytes.
+ * 
+ * @param b Target buffer
+ * @return size_t Number of bytes between start and end
+ */
+size_t buffer_size(const buffer *b);
+
+/**
+ * @brief Drop bytes from the start.
+ * 
+ * @param b Target buffer
+ * @param size Number of bytes, at most buffer_size()
+ */
+void buffer_consume(buffer *b, size_t size);
+
+/**
+ * @brief Drop bytes from the end.
+ * 
+ * @param b Target buffer
+ * @param size Number of bytes kept, at most buffer_size()
+ */
+void buffer_truncate(buffer *b, size_t size);
+
+/**
+ * @brief Deallocate memory used by the buffer.
+ * 
+ * @param b Target buffer
+ */
+void buffer_free(buffer *b);
+
+#endif
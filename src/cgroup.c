@@ -0,0 +1,422 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#include "cgroup.h"
+
+#define JOB_NAME "job-%d-%lu"
+
+/* Period of cpu.max, quotas are a percentage of it */
+#define CPU_PERIOD_US 100000
+
+/* cpu.weight of capped jobs, so running jobs win any contention */
+#define THROTTLED_WEIGHT 10
+#define DEFAULT_WEIGHT 100
+
+/* Draining cgroups looked at per cg_reap() call, the rest stay ready */
+#define MAX_EVENTS 16
+
+/* How long the tree waits on close for killed processes to leave */
+#define EXIT_GRACE_MS 100
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Write a string to a control file of a cgroup.
+ * 
+ * @param dir_fd Directory of the cgroup
+ * @param name Name of the control file
+ * @param value String to write
+ * @return int 0 if successful. -1 otherwise
+ */
+static int cg_write(int dir_fd, const char *name, const char *value) {
+    int fd = openat(dir_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t len = strlen(value);
+    ssize_t written = write(fd, value, len);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return written == (ssize_t)len ? 0 : -1;
+}
+
+/**
+ * @brief Get the directory name of a job's cgroup.
+ * 
+ * @param job Target cgroup
+ * @param name Destination
+ * @param size Size of the destination
+ */
+static void cg_name(const cgroup_job *job, char *name, size_t size) {
+    snprintf(name, size, JOB_NAME, job->owner, (unsigned long)job->id);
+}
+
+/**
+ * @brief Check whether every process has left a cgroup.
+ * 
+ * Reading cgroup.events also clears its pending notification.
+ * 
+ * @param events_fd cgroup.events of the cgroup
+ * @return true The cgroup is empty
+ * @return false Processes are still in it, or the file could not be read
+ */
+static bool cg_is_empty(int events_fd) {
+    char events[128];
+    ssize_t n = pread(events_fd, events, sizeof(events) - 1, 0);
+    if (n < 0) {
+        return false;
+    }
+    events[n] = '\0';
+    return strstr(events, "populated 0") != NULL;
+}
+
+/**
+ * @brief Start watching a cgroup whose processes are being killed.
+ * 
+ * cgroup.events polls with POLLPRI whenever its populated state changes.
+ * 
+ * @param t Tree of the cgroup
+ * @param events_fd cgroup.events of the cgroup, owned by the tree if
+ * successful
+ * @param name Directory name of the cgroup
+ * @return int 0 if successful. -1 otherwise
+ */
+static int cg_add_draining(cgroup_tree *t, int events_fd, const char *name) {
+    if (t->draining_count == t->draining_capacity) {
+        size_t capacity = t->draining_capacity ? t->draining_capacity * 2 : 4;
+        cgroup_draining *draining = realloc(t->draining,
+                                            capacity * sizeof(cgroup_draining));
+        if (draining == NULL) {
+            return -1;
+        }
+        t->draining = draining;
+        t->draining_capacity = capacity;
+    }
+
+    struct epoll_event ev = { .events = EPOLLPRI, .data.fd = events_fd };
+    if (epoll_ctl(t->events_fd, EPOLL_CTL_ADD, events_fd, &ev) < 0) {
+        return -1;
+    }
+
+    cgroup_draining *d = &t->draining[t->draining_count++];
+    d->events_fd = events_fd;
+    snprintf(d->name, sizeof(d->name), "%s", name);
+    return 0;
+}
+
+/**
+ * @brief Stop watching a draining cgroup.
+ * 
+ * @param t Tree of the cgroup
+ * @param i Index of the cgroup in the draining list, which the last one
+ * takes over
+ */
+static void cg_drop_draining(cgroup_tree *t, size_t i) {
+    close(t->draining[i].events_fd);
+    t->draining[i] = t->draining[--t->draining_count];
+}
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Open a delegated subtree and enable the cpu controller in it.
+ * 
+ * @param t Target tree
+ * @param path Directory of the subtree in cgroupfs
+ * @return int 0 if successful. -1 if the subtree is not usable
+ */
+int cg_init(cgroup_tree *t, const char *path) {
+    t->has_cpu = false;
+    t->owner = getpid();
+    t->next_id = 0;
+    t->draining = NULL;
+    t->draining_count = 0;
+    t->draining_capacity = 0;
+    t->events_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (t->events_fd < 0) {
+        t->root_fd = -1;
+        return -1;
+    }
+
+    t->root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (t->root_fd < 0) {
+        close(t->events_fd);
+        return -1;
+    }
+
+    /* Creating a child is the only reliable test of delegation */
+    cgroup_job probe;
+    if (cg_create(t, &probe) < 0) {
+        close(t->root_fd);
+        close(t->events_fd);
+        t->root_fd = -1;
+        return -1;
+    }
+    cg_remove(t, &probe);
+
+    /* Without the cpu controller jobs can still be frozen, not capped */
+    t->has_cpu = cg_write(t->root_fd, "cgroup.subtree_control", "+cpu") == 0;
+    return 0;
+}
+
+/**
+ * @brief Check whether the tree is in use.
+ * 
+ * @param t Target tree
+ * @return true The tree was opened successfully
+ * @return false Jobs are managed with signals only
+ */
+bool cg_enabled(const cgroup_tree *t) {
+    return t->root_fd >= 0;
+}
+
+/**
+ * @brief Create an empty cgroup for a new job.
+ * 
+ * @param t Target tree
+ * @param job Destination cgroup
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_create(cgroup_tree *t, cgroup_job *job) {
+    char name[48];
+    job->id = t->next_id++;
+    job->owner = t->owner;
+    job->fd = -1;
+    cg_name(job, name, sizeof(name));
+
+    if (mkdirat(t->root_fd, name, 0755) < 0) {
+        return -1;
+    }
+
+    job->fd = openat(t->root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return job->fd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Open the existing cgroup of a job taken over from another manager.
+ * 
+ * @param t Target tree
+ * @param owner Manager that created the cgroup
+ * @param id Id of the cgroup in the tree of its owner
+ * @param job Destination cgroup
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_adopt(const cgroup_tree *t, pid_t owner, uint64_t id, cgroup_job *job) {
+    char name[48];
+    job->id = id;
+    job->owner = owner;
+    cg_name(job, name, sizeof(name));
+
+    job->fd = openat(t->root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return job->fd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Open the file that moves processes into a job's cgroup.
+ * 
+ * Writing "0" to it moves the writer itself, which lets a child enter the
+ * cgroup before it executes the program.
+ * 
+ * @param job Target cgroup
+ * @return int Writable cgroup.procs descriptor. -1 on error
+ */
+int cg_procs_fd(const cgroup_job *job) {
+    return openat(job->fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+}
+
+/**
+ * @brief Move a process into a job's cgroup.
+ * 
+ * @param job Target cgroup
+ * @param pid Target process
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_attach(const cgroup_job *job, pid_t pid) {
+    char value[16];
+    snprintf(value, sizeof(value), "%d", pid);
+    return cg_write(job->fd, "cgroup.procs", value);
+}
+
+/**
+ * @brief Freeze or thaw every process of a job.
+ * 
+ * @param job Target cgroup
+ * @param frozen Freeze if true, thaw otherwise
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_freeze(const cgroup_job *job, bool frozen) {
+    return cg_write(job->fd, "cgroup.freeze", frozen ? "1" : "0");
+}
+
+/**
+ * @brief Cap the CPU share of a job.
+ * 
+ * @param t Tree of the job
+ * @param job Target cgroup
+ * @param percent Percent of one CPU the job may use. 100 lifts the cap
+ * @return int 0 if successful. -1 otherwise, including when the cpu
+ * controller is not available
+ */
+int cg_throttle(const cgroup_tree *t, const cgroup_job *job, int percent) {
+    if (!t->has_cpu) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    char max[32];
+    char weight[16];
+    if (percent >= 100) {
+        snprintf(max, sizeof(max), "max %d", CPU_PERIOD_US);
+        snprintf(weight, sizeof(weight), "%d", DEFAULT_WEIGHT);
+    } else {
+        snprintf(max, sizeof(max), "%d %d", CPU_PERIOD_US / 100 * percent,
+                 CPU_PERIOD_US);
+        snprintf(weight, sizeof(weight), "%d", THROTTLED_WEIGHT);
+    }
+
+    if (cg_write(job->fd, "cpu.max", max) < 0) {
+        return -1;
+    }
+    return cg_write(job->fd, "cpu.weight", weight);
+}
+
+/**
+ * @brief SIGKILL every process of a job.
+ * 
+ * @param job Target cgroup
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_kill(const cgroup_job *job) {
+    return cg_write(job->fd, "cgroup.kill", "1");
+}
+
+/**
+ * @brief Remove the cgroup of a finished job.
+ * 
+ * Processes left in the cgroup are killed, and the cgroup itself is removed
+ * by cg_reap() once they are gone, so this never waits.
+ * 
+ * @param t Tree of the job
+ * @param job Target cgroup, closed by this call
+ */
+void cg_remove(cgroup_tree *t, cgroup_job *job) {
+    if (job->fd < 0) {
+        return;
+    }
+
+    char name[48];
+    cg_name(job, name, sizeof(name));
+    if (unlinkat(t->root_fd, name, AT_REMOVEDIR) == 0 || errno != EBUSY
+        || cg_kill(job) < 0) {
+        close(job->fd);
+        job->fd = -1;
+        return;
+    }
+
+    /* Stragglers keep the cgroup busy until the kill lands. A cgroup that
+     * can't be watched is left behind, empty
+     */
+    int events_fd = openat(job->fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    close(job->fd);
+    job->fd = -1;
+    if (events_fd < 0) {
+        return;
+    }
+    if (cg_add_draining(t, events_fd, name) < 0) {
+        close(events_fd);
+        return;
+    }
+
+    /* It may have emptied before cgroup.events was opened, which is then
+     * never reported
+     */
+    if (unlinkat(t->root_fd, name, AT_REMOVEDIR) == 0) {
+        cg_drop_draining(t, t->draining_count - 1);
+    }
+}
+
+/**
+ * @brief Get a pollable descriptor that becomes readable when the cgroup of
+ * a removed job empties.
+ * 
+ * @param t Target tree
+ * @return int epoll file descriptor to call cg_reap() on. -1 if the tree is
+ * not in use
+ */
+int cg_events_fd(const cgroup_tree *t) {
+    return cg_enabled(t) ? t->events_fd : -1;
+}
+
+/**
+ * @brief Remove the cgroups of removed jobs that emptied since.
+ * 
+ * @param t Target tree
+ */
+void cg_reap(cgroup_tree *t) {
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(t->events_fd, events, MAX_EVENTS, 0);
+
+    for (int i = 0; i < n; ++i) {
+        for (size_t j = 0; j < t->draining_count; ++j) {
+            cgroup_draining *d = &t->draining[j];
+            if (d->events_fd != events[i].data.fd) {
+                continue;
+            }
+            if (cg_is_empty(d->events_fd)
+                && (unlinkat(t->root_fd, d->name, AT_REMOVEDIR) == 0
+                    || errno != EBUSY)) {
+                cg_drop_draining(t, j);
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Close the subtree once the cgroups of removed jobs are gone.
+ * 
+ * Cgroups whose processes take longer than a moment to exit are left
+ * behind, empty.
+ * 
+ * @param t Target tree
+ */
+void cg_free(cgroup_tree *t) {
+    if (t->root_fd < 0) {
+        return;
+    }
+
+    /* Nothing else is left to do, so waiting no longer holds anything up */
+    struct epoll_event ev;
+    while (t->draining_count > 0
+           && epoll_wait(t->events_fd, &ev, 1, EXIT_GRACE_MS) > 0) {
+        cg_reap(t);
+    }
+
+    while (t->draining_count > 0) {
+        unlinkat(t->root_fd, t->draining[0].name, AT_REMOVEDIR);
+        cg_drop_draining(t, 0);
+    }
+    free(t->draining);
+    t->draining = NULL;
+    t->draining_capacity = 0;
+
+    close(t->events_fd);
+    t->events_fd = -1;
+    close(t->root_fd);
+    t->root_fd = -1;
+}
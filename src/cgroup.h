@@ -0,0 +1,165 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Cgroup of a finished job that still held processes when it was removed.
+ * Those were killed, and the directory goes once they are gone.
+ */
+typedef struct cgroup_draining {
+    int events_fd;      /* cgroup.events, polls when the cgroup empties */
+    char name[48];
+} cgroup_draining;
+
+/**
+ * Delegated cgroup v2 subtree holding one leaf cgroup per job. Job cgroups
+ * are named after the owning process so several managers can share a tree.
+ */
+typedef struct cgroup_tree {
+    int root_fd;
+    bool has_cpu;
+    pid_t owner;
+    uint64_t next_id;
+    int events_fd;      /* epoll set of draining cgroups */
+    cgroup_draining *draining;
+    size_t draining_count;
+    size_t draining_capacity;
+} cgroup_tree;
+
+/**
+ * Cgroup of a single job.
+ */
+typedef struct cgroup_job {
+    int fd;
+    uint64_t id;
+    pid_t owner;        /* Manager that created it, which names it */
+} cgroup_job;
+
+/**
+ * @brief Open a delegated subtree and enable the cpu controller in it.
+ * 
+ * @param t Target tree
+ * @param path Directory of the subtree in cgroupfs
+ * @return int 0 if successful. -1 if the subtree is not usable
+ */
+int cg_init(cgroup_tree *t, const char *path);
+
+/**
+ * @brief Check whether the tree is in use.
+ * 
+ * @param t Target tree
+ * @return true The tree was opened successfully
+ * @return false Jobs are managed with signals only
+ */
+bool cg_enabled(const cgroup_tree *t);
+
+/**
+ * @brief Create an empty cgroup for a new job.
+ * 
+ * @param t Target tree
+ * @param job Destination cgroup
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_create(cgroup_tree *t, cgroup_job *job);
+
+/**
+ * @brief Open the existing cgroup of a job taken over from another manager.
+ * 
+ * @param t Target tree
+ * @param owner Manager that created the cgroup
+ * @param id Id of the cgroup in the tree of its owner
+ * @param job Destination cgroup
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_adopt(const cgroup_tree *t, pid_t owner, uint64_t id, cgroup_job *job);
+
+/**
+ * @brief Open the file that moves processes into a job's cgroup.
+ * 
+ * Writing "0" to it moves the writer itself, which lets a child enter the
+ * cgroup before it executes the program.
+ * 
+ * @param job Target cgroup
+ * @return int Writable cgroup.procs descriptor. -1 on error
+ */
+int cg_procs_fd(const cgroup_job *job);
+
+/**
+ * @brief Move a process into a job's cgroup.
+ * 
+ * @param job Target cgroup
+ * @param pid Target process
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_attach(const cgroup_job *job, pid_t pid);
+
+/**
+ * @brief Freeze or thaw every process of a job.
+ * 
+ * @param job Target cgroup
+ * @param frozen Freeze if true, thaw otherwise
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_freeze(const cgroup_job *job, bool frozen);
+
+/**
+ * @brief Cap the CPU share of a job.
+ * 
+ * @param t Tree of the job
+ * @param job Target cgroup
+ * @param percent Percent of one CPU the job may use. 100 lifts the cap
+ * @return int 0 if successful. -1 otherwise, including when the cpu
+ * controller is not available
+ */
+int cg_throttle(const cgroup_tree *t, const cgroup_job *job, int percent);
+
+/**
+ * @brief SIGKILL every process of a job.
+ * 
+ * @param job Target cgroup
+ * @return int 0 if successful. -1 otherwise
+ */
+int cg_kill(const cgroup_job *job);
+
+/**
+ * @brief Remove the cgroup of a finished job.
+ * 
+ * Processes left in the cgroup are killed, and the cgroup itself is removed
+ * by cg_reap() once they are gone, so this never waits.
+ * 
+ * @param t Tree of the job
+ * @param job Target cgroup, closed by this call
+ */
+void cg_remove(cgroup_tree *t, cgroup_job *job);
+
+/**
+ * @brief Get a pollable descriptor that becomes readable when the cgroup of
+ * a removed job empties.
+ * 
+ * @param t Target tree
+ * @return int epoll file descriptor to call cg_reap() on. -1 if the tree is
+ * not in use
+ */
+int cg_events_fd(const cgroup_tree *t);
+
+/**
+ * @brief Remove the cgroups of removed jobs that emptied since.
+ * 
+ * @param t Target tree
+ */
+void cg_reap(cgroup_tree *t);
+
+/**
+ * @brief Close the subtree once the cgroups of removed jobs are gone.
+ * 
+ * Cgroups whose processes take longer than a moment to exit are left
+ * behind, empty.
+ * 
+ * @param t Target tree
+ */
+void cg_free(cgroup_tree *t);
+
+#endif
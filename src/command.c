@@ -0,0 +1,439 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "command.h"
+
+#define USAGE "COMMANDS:\n"                     \
+              "    run [-n COUNT] [program] [arguments]\n" \
+              "    stop [PID]\n"                \
+              "    kill [PID]\n"                \
+              "    resume [PID]\n"              \
+              "    list\n"                      \
+              "    quantum [MS]\n"              \
+              "    logs [PID]\n"                \
+              "    exit\n"
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Make room for a number of arguments and the NULL that ends them.
+ * 
+ * @param c Target command
+ * @param argc Number of arguments
+ * @return int 0 if successful. -1 otherwise
+ */
+static int command_reserve(command *c, size_t argc) {
+    if (argc < c->argv_capacity) {
+        return 0;
+    }
+
+    size_t capacity = c->argv_capacity ? c->argv_capacity : 8;
+    while (capacity <= argc) {
+        capacity *= 2;
+    }
+
+    char **argv = realloc(c->argv, capacity * sizeof(char *));
+    if (argv == NULL) {
+        return -1;
+    }
+    c->argv = argv;
+    c->argv_capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Ensure number of required arguments is hit.
+ * 
+ * @param a Target argument
+ * @param n Minimum number of tokens
+ * @param message Message to reply with when lacking tokens
+ * @param r Reply to the command
+ * @return true Reached token count
+ * @return false Less than token count
+ */
+static bool ensure_args_length(const args *a, size_t n, const char *message,
+                               reply *r) {
+    if (a->token_count < n) {
+        reply_error(r, "%s", message);
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Parse a string representing a pid into a pid_t type
+ * 
+ * @param pid Target pid
+ * @param r Reply to the command
+ * @return pid_t Parsed pid. 0 if string was an invalid pid
+ */
+static pid_t parse_pid(const char *pid, reply *r) {
+    int num = atoi(pid);
+    /* atoi() returns 0 on invalid input but 0 is also an invalid pid for us */
+    if (num == 0) {
+        reply_error(r, "Invalid pid\n");
+    }
+    return num;
+}
+
+/**
+ * @brief Parse the size of a job array.
+ * 
+ * @param count Target count
+ * @param r Reply to the command
+ * @return uint32_t Parsed count. 0 if string was an invalid count
+ */
+static uint32_t parse_count(const char *count, reply *r) {
+    char *end;
+    long num = strtol(count, &end, 10);
+    if (*end != '\0' || num < 1 || num > JOB_ARRAY_MAX) {
+        reply_error(r, "Invalid count, expected 1 to %d\n", JOB_ARRAY_MAX);
+        return 0;
+    }
+    return (uint32_t)num;
+}
+
+/**
+ * @brief Parse a scheduling quantum in milliseconds.
+ * 
+ * @param quantum Target quantum
+ * @param r Reply to the command
+ * @return int32_t Parsed quantum. 0 if string was an invalid quantum
+ */
+static int32_t parse_quantum(const char *quantum, reply *r) {
+    char *end;
+    long num = strtol(quantum, &end, 10);
+    if (*end != '\0' || num < 1 || num > QUANTUM_MAX_MS) {
+        reply_error(r, "Invalid quantum, expected 1 to %d ms\n",
+                    QUANTUM_MAX_MS);
+        return 0;
+    }
+    return (int32_t)num;
+}
+
+/**
+ * @brief Fill in a command taking a single pid argument.
+ * 
+ * @param c Destination command
+ * @param op Opcode of the command
+ * @param a Words of the input
+ * @param message Message to reply with when the pid is missing
+ * @param r Reply to the command
+ * @return true The pid is valid
+ * @return false r holds the error
+ */
+static bool parse_pid_command(command *c, opcode op, const args *a,
+                              const char *message, reply *r) {
+    if (!ensure_args_length(a, 2, message, r)) {
+        return false;
+    }
+
+    c->op = op;
+    c->pid = parse_pid(a->argv[1], r);
+    return c->pid != 0;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise an empty command.
+ * 
+ * @param c Target command
+ */
+void command_init(command *c) {
+    c->op = OP_NONE;
+    c->pid = 0;
+    c->count = 1;
+    c->value = 0;
+    c->argc = 0;
+    c->argv = NULL;
+    c->argv_capacity = 0;
+}
+
+/**
+ * @brief Build a command from the words of a line of user input.
+ * 
+ * @param c Destination command, borrowing strings from a
+ * @param a Words of the input
+ * @param r Reply receiving any usage error
+ * @return true c holds a command to execute
+ * @return false Input was empty or invalid, r holds the result
+ */
+bool command_parse(command *c, const args *a, reply *r) {
+    c->op = OP_NONE;
+    c->pid = 0;
+    c->count = 1;
+    c->value = 0;
+    c->argc = 0;
+
+    /* No-op when empty command received */
+    if (a->token_count == 0) {
+        return false;
+    }
+
+    const char *name = a->argv[0];
+
+    if (!strcmp(name, "run")) {
+        /* Program starts after an optional job array size */
+        size_t first = 1;
+        if (a->token_count > 2 && !strcmp(a->argv[1], "-n")) {
+            c->count = parse_count(a->argv[2], r);
+            if (c->count == 0) {
+                return false;
+            }
+            first = 3;
+        }
+
+        if (!ensure_args_length(a, first + 1,
+                                "USAGE: run [-n COUNT] [program] [arguments]\n",
+                                r)) {
+            return false;
+        }
+        if (command_reserve(c, a->token_count - first) < 0) {
+            reply_error(r, "Out of memory\n");
+            return false;
+        }
+
+        c->op = OP_RUN;
+        c->argc = a->token_count - first;
+        memcpy(c->argv, a->argv + first, c->argc * sizeof(char *));
+        c->argv[c->argc] = NULL;
+        return true;
+
+    } else if (!strcmp(name, "stop")) {
+        return parse_pid_command(c, OP_STOP, a, "USAGE: stop [PID]\n", r);
+
+    } else if (!strcmp(name, "kill")) {
+        return parse_pid_command(c, OP_KILL, a, "USAGE: kill [PID]\n", r);
+
+    } else if (!strcmp(name, "resume")) {
+        return parse_pid_command(c, OP_RESUME, a, "USAGE: resume [PID]\n", r);
+
+    } else if (!strcmp(name, "list")) {
+        c->op = OP_LIST;
+        return true;
+
+    } else if (!strcmp(name, "quantum")) {
+        c->op = OP_QUANTUM;
+        if (a->token_count > 1) {
+            c->value = parse_quantum(a->argv[1], r);
+            return c->value != 0;
+        }
+        return true;
+
+    } else if (!strcmp(name, "logs")) {
+        return parse_pid_command(c, OP_LOGS, a, "USAGE: logs [PID]\n", r);
+
+    } else if (!strcmp(name, "exit")) {
+        c->op = OP_EXIT;
+        return true;
+    }
+
+    /* Unrecognised command received */
+    reply_error(r, USAGE);
+    return false;
+}
+
+/**
+ * @brief Append a command as one frame.
+ * 
+ * @param c Command to encode
+ * @param id Id of the command
+ * @param out Destination buffer
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+int command_encode(const command *c, uint64_t id, buffer *out) {
+    size_t length = 0;
+    for (size_t i = 0; i < c->argc; ++i) {
+        length += strlen(c->argv[i]) + 1;
+    }
+    if (length > FRAME_MAX_LENGTH || c->argc > UINT16_MAX) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    frame_header header = {
+        .id = id,
+        .length = (uint32_t)length,
+        .opcode = (uint16_t)c->op,
+        .argc = (uint16_t)c->argc,
+        .pid = c->pid,
+        .count = c->count,
+        .value = c->value,
+    };
+
+    /* Reserve the whole frame up front so it is never left half written */
+    if (buffer_reserve(out, sizeof(header) + length) < 0) {
+        return -1;
+    }
+    buffer_append(out, &header, sizeof(header));
+    for (size_t i = 0; i < c->argc; ++i) {
+        buffer_append(out, c->argv[i], strlen(c->argv[i]) + 1);
+    }
+    return 0;
+}
+
+/**
+ * @brief Decode the first frame of a buffer without consuming it.
+ * 
+ * @param c Destination command, borrowing strings from the buffer
+ * @param id Destination of the command id
+ * @param in Source buffer
+ * @return ssize_t Size of the frame. 0 if it is incomplete, -1 if malformed
+ */
+ssize_t command_decode(command *c, uint64_t *id, buffer *in) {
+    frame_header header;
+    size_t available = buffer_size(in);
+    if (available < sizeof(header)) {
+        return 0;
+    }
+
+    /* The header may be unaligned inside the buffer */
+    memcpy(&header, in->data + in->start, sizeof(header));
+    if (header.length > FRAME_MAX_LENGTH
+        || header.opcode <= OP_NONE || header.opcode > OP_EXIT
+        || header.count < 1 || header.count > JOB_ARRAY_MAX
+        || header.value < 0
+        || (header.opcode == OP_QUANTUM && header.value > QUANTUM_MAX_MS)
+        || (header.opcode == OP_RUN
+            && (uint32_t)header.value + header.count > JOB_ARRAY_MAX)) {
+        return -1;
+    }
+    if (available - sizeof(header) < header.length) {
+        return 0;
+    }
+    if (command_reserve(c, header.argc) < 0) {
+        return -1;
+    }
+
+    /* Point arguments into the payload, which must hold exactly argc */
+    char *iter = in->data + in->start + sizeof(header);
+    char *end = iter + header.length;
+    for (size_t i = 0; i < header.argc; ++i) {
+        char *terminator = iter < end ? memchr(iter, '\0', (size_t)(end - iter))
+                                      : NULL;
+        if (terminator == NULL) {
+            return -1;
+        }
+        c->argv[i] = iter;
+        iter = terminator + 1;
+    }
+    if (iter != end || (header.opcode == OP_RUN && header.argc == 0)) {
+        return -1;
+    }
+
+    c->op = (opcode)header.opcode;
+    c->pid = header.pid;
+    c->count = header.count;
+    c->value = header.value;
+    c->argc = header.argc;
+    c->argv[c->argc] = NULL;
+    *id = header.id;
+    return (ssize_t)(sizeof(header) + header.length);
+}
+
+/**
+ * @brief Initialise empty job arguments.
+ * 
+ * @param j Target job arguments
+ */
+void job_argv_init(job_argv *j) {
+    j->argv = NULL;
+    j->capacity = 0;
+    buffer_init(&j->strings);
+}
+
+/**
+ * @brief Get the arguments of one job of a run command.
+ * 
+ * Every JOB_INDEX_PLACEHOLDER in the arguments is replaced by the index.
+ * 
+ * @param j Storage for the arguments, overwritten by the next call
+ * @param c Run command
+ * @param index Index of the job within the array
+ * @return char* const* NULL terminated arguments. NULL if out of memory
+ */
+char *const *job_argv_expand(job_argv *j, const command *c, uint32_t index) {
+    if (j->capacity <= c->argc) {
+        char **argv = realloc(j->argv, (c->argc + 1) * sizeof(char *));
+        if (argv == NULL) {
+            return NULL;
+        }
+        j->argv = argv;
+        j->capacity = c->argc + 1;
+    }
+
+    char digits[16];
+    size_t digits_len = (size_t)snprintf(digits, sizeof(digits), "%u", index);
+    size_t placeholder_len = strlen(JOB_INDEX_PLACEHOLDER);
+
+    /* Size every expansion first so the strings never move once written */
+    size_t size = 0;
+    for (size_t i = 0; i < c->argc; ++i) {
+        const char *found = c->argv[i];
+        while ((found = strstr(found, JOB_INDEX_PLACEHOLDER)) != NULL) {
+            size += digits_len;
+            found += placeholder_len;
+        }
+        size += strlen(c->argv[i]) + 1;
+    }
+
+    buffer *b = &j->strings;
+    buffer_consume(b, buffer_size(b));
+    if (buffer_reserve(b, size) < 0) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < c->argc; ++i) {
+        const char *arg = c->argv[i];
+        const char *found = strstr(arg, JOB_INDEX_PLACEHOLDER);
+        if (found == NULL) {
+            j->argv[i] = c->argv[i];
+            continue;
+        }
+
+        j->argv[i] = b->data + b->end;
+        while (found != NULL) {
+            buffer_append(b, arg, (size_t)(found - arg));
+            buffer_append(b, digits, digits_len);
+            arg = found + placeholder_len;
+            found = strstr(arg, JOB_INDEX_PLACEHOLDER);
+        }
+        buffer_append(b, arg, strlen(arg) + 1);
+    }
+
+    j->argv[c->argc] = NULL;
+    return j->argv;
+}
+
+/**
+ * @brief Deallocate memory used by job arguments.
+ * 
+ * @param j Target job arguments
+ */
+void job_argv_free(job_argv *j) {
+    free(j->argv);
+    buffer_free(&j->strings);
+    job_argv_init(j);
+}
+
+/**
+ * @brief Deallocate memory used by a command.
+ * 
+ * @param c Target command
+ */
+void command_free(command *c) {
+    free(c->argv);
+    command_init(c);
+}
@@ -0,0 +1,149 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "argparse.h"
+#include "buffer.h"
+#include "reply.h"
+
+/* Largest frame accepted from the command pipe */
+#define FRAME_MAX_LENGTH (1 << 20)
+
+/* Largest number of jobs a single run can launch */
+#define JOB_ARRAY_MAX 100000
+
+/* Longest scheduling quantum that can be set */
+#define QUANTUM_MAX_MS 60000
+
+/* Replaced by the index of each job of an array in its arguments */
+#define JOB_INDEX_PLACEHOLDER "{i}"
+
+typedef enum opcode {
+    OP_NONE,
+    OP_RUN,
+    OP_STOP,
+    OP_KILL,
+    OP_RESUME,
+    OP_LIST,
+    OP_QUANTUM,
+    OP_LOGS,
+    OP_EXIT,
+} opcode;
+
+/**
+ * A parsed command. The strings in argv are borrowed from whatever the
+ * command was parsed or decoded from, only the array itself is owned. A run
+ * with a count above 1 launches a job array, whose jobs are numbered from
+ * the value of the run. Value holds the new quantum of a quantum command, 0
+ * to leave it unchanged.
+ */
+typedef struct command {
+    opcode op;
+    pid_t pid;
+    uint32_t count;
+    int32_t value;
+    size_t argc;
+    char **argv;
+    size_t argv_capacity;
+} command;
+
+/**
+ * Fixed part of every frame on the command pipe. It is followed by length
+ * bytes holding argc null terminated arguments.
+ */
+typedef struct frame_header {
+    uint64_t id;
+    uint32_t length;
+    uint16_t opcode;
+    uint16_t argc;
+    int32_t pid;
+    uint32_t count;
+    int32_t value;
+} frame_header;
+
+/**
+ * Arguments of one job of a job array, owning the strings that had their
+ * placeholder replaced.
+ */
+typedef struct job_argv {
+    char **argv;
+    size_t capacity;
+    buffer strings;
+} job_argv;
+
+/**
+ * @brief Initialise an empty command.
+ * 
+ * @param c Target command
+ */
+void command_init(command *c);
+
+/**
+ * @brief Build a command from the words of a line of user input.
+ * 
+ * @param c Destination command, borrowing strings from a
+ * @param a Words of the input
+ * @param r Reply receiving any usage error
+ * @return true c holds a command to execute
+ * @return false Input was empty or invalid, r holds the result
+ */
+bool command_parse(command *c, const args *a, reply *r);
+
+/**
+ * @brief Append a command as one frame.
+ * 
+ * @param c Command to encode
+ * @param id Id of the command
+ * @param out Destination buffer
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+int command_encode(const command *c, uint64_t id, buffer *out);
+
+/**
+ * @brief Decode the first frame of a buffer without consuming it.
+ * 
+ * @param c Destination command, borrowing strings from the buffer
+ * @param id Destination of the command id
+ * @param in Source buffer
+ * @return ssize_t Size of the frame. 0 if it is incomplete, -1 if malformed
+ */
+ssize_t command_decode(command *c, uint64_t *id, buffer *in);
+
+/**
+ * @brief Initialise empty job arguments.
+ * 
+ * @param j Target job arguments
+ */
+void job_argv_init(job_argv *j);
+
+/**
+ * @brief Get the arguments of one job of a run command.
+ * 
+ * Every JOB_INDEX_PLACEHOLDER in the arguments is replaced by the index.
+ * 
+ * @param j Storage for the arguments, overwritten by the next call
+ * @param c Run command
+ * @param index Index of the job within the array
+ * @return char* const* NULL terminated arguments. NULL if out of memory
+ */
+char *const *job_argv_expand(job_argv *j, const command *c, uint32_t index);
+
+/**
+ * @brief Deallocate memory used by job arguments.
+ * 
+ * @param j Target job arguments
+ */
+void job_argv_free(job_argv *j);
+
+/**
+ * @brief Deallocate memory used by a command.
+ * 
+ * @param c Target command
+ */
+void command_free(command *c);
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+
+#include "history.h"
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise an empty history.
+ * 
+ * @param h Target history
+ * @param capacity Number of records kept. 0 keeps nothing
+ * @return int 0 if successful. -1 otherwise
+ */
+int history_init(history *h, size_t capacity) {
+    h->records = NULL;
+    h->capacity = 0;
+    h->head = 0;
+    h->count = 0;
+
+    if (capacity > 0) {
+        h->records = malloc(capacity * sizeof(job_record));
+        if (h->records == NULL) {
+            return -1;
+        }
+        h->capacity = capacity;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Append a record, evicting the oldest one if the history is full.
+ * 
+ * @param h Target history
+ * @param record Record to copy in
+ */
+void history_push(history *h, const job_record *record) {
+    if (h->capacity == 0) {
+        return;
+    }
+
+    if (h->count == h->capacity) {
+        h->head = (h->head + 1) % h->capacity;
+        h->count--;
+    }
+
+    h->records[(h->head + h->count) % h->capacity] = *record;
+    h->count++;
+}
+
+/**
+ * @brief Get a record by age.
+ * 
+ * @param h Target history
+ * @param i Index from 0, the oldest record, to count - 1, the newest
+ * @return const job_record* Record at index i
+ */
+const job_record *history_get(const history *h, size_t i) {
+    return &h->records[(h->head + i) % h->capacity];
+}
+
+/**
+ * @brief Find the newest record of a pid.
+ * 
+ * @param h Target history
+ * @param pid Target pid
+ * @return const job_record* Newest record of pid. NULL if not found
+ */
+const job_record *history_find(const history *h, pid_t pid) {
+    for (size_t i = h->count; i > 0; --i) {
+        const job_record *record = history_get(h, i - 1);
+        if (record->pid == pid) {
+            return record;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Remove every record while keeping the allocated ring.
+ * 
+ * @param h Target history
+ */
+void history_clear(history *h) {
+    h->head = 0;
+    h->count = 0;
+}
+
+/**
+ * @brief Deallocate memory used by the history.
+ * 
+ * @param h Target history
+ */
+void history_free(history *h) {
+    free(h->records);
+    history_init(h, 0);
+}
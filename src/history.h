@@ -0,0 +1,84 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/**
+ * Summary of a job after it has been reaped.
+ */
+typedef struct job_record {
+    pid_t pid;
+    uint64_t spawned_ns;    /* CLOCK_BOOTTIME at admission, names its log */
+    bool signaled;
+    int code;
+    struct timeval wall_time;
+    struct timeval user_time;
+    struct timeval system_time;
+    long max_rss;
+} job_record;
+
+/**
+ * Fixed-size ring of the most recently reaped jobs. Once full, every new
+ * record overwrites the oldest one.
+ */
+typedef struct history {
+    job_record *records;
+    size_t capacity;
+    size_t head;
+    size_t count;
+} history;
+
+/**
+ * @brief Initialise an empty history.
+ * 
+ * @param h Target history
+ * @param capacity Number of records kept. 0 keeps nothing
+ * @return int 0 if successful. -1 otherwise
+ */
+int history_init(history *h, size_t capacity);
+
+/**
+ * @brief Append a record, evicting the oldest one if the history is full.
+ * 
+ * @param h Target history
+ * @param record Record to copy in
+ */
+void history_push(history *h, const job_record *record);
+
+/**
+ * @brief Get a record by age.
+ * 
+ * @param h Target history
+ * @param i Index from 0, the oldest record, to count - 1, the newest
+ * @return const job_record* Record at index i
+ */
+const job_record *history_get(const history *h, size_t i);
+
+/**
+ * @brief Find the newest record of a pid.
+ * 
+ * @param h Target history
+ * @param pid Target pid
+ * @return const job_record* Newest record of pid. NULL if not found
+ */
+const job_record *history_find(const history *h, pid_t pid);
+
+/**
+ * @brief Remove every record while keeping the allocated ring.
+ * 
+ * @param h Target history
+ */
+void history_clear(history *h);
+
+/**
+ * @brief Deallocate memory used by the history.
+ * 
+ * @param h Target history
+ */
+void history_free(history *h);
+
+#endif
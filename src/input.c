@@ -1,53 +1,150 @@
 #include <unistd.h>
 #include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #include "input.h"
 
+#define READ_CHUNK 4096
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Read once from the file descriptor, retrying on interrupts.
+ * 
+ * @param rd Target reader
+ * @return ssize_t Number of bytes read. 0 on end of file, -1 on error
+ */
+static ssize_t reader_read(reader *rd) {
+    if (buffer_reserve(&rd->data, READ_CHUNK) < 0) {
+        return -1;
+    }
+
+    ssize_t len;
+    do {
+        len = read(rd->fd, rd->data.data + rd->data.end,
+                   rd->data.capacity - rd->data.end);
+    } while (len < 0 && errno == EINTR);
+
+    if (len > 0) {
+        rd->data.end += (size_t)len;
+    } else if (len == 0) {
+        rd->eof = true;
+    }
+    return len;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
 /**
- * @brief Read until EOF
- *
- * @param fd Input file descriptor
- * @param buffer_size The number of bytes to read at once.
- * 64 bytes if 0 specified
- * @param terminator Stop reading when terminator is reached. Not included in
- * the output string
- * @return char* Read string. Null if nothing read
+ * @brief Initialise a reader over a file descriptor
+ * 
+ * @param rd Target reader
+ * @param fd Input file descriptor, which stays owned by the caller
  */
-char *read_all(int fd, size_t buffer_size, char terminator) {
-    static const size_t default_buffer_size = 64;
+void reader_init(reader *rd, int fd) {
+    rd->fd = fd;
+    buffer_init(&rd->data);
+    rd->scanned = 0;
+    rd->pending = 0;
+    rd->eof = false;
+}
 
-    if (buffer_size <= 0) {
-        buffer_size = default_buffer_size;
+/**
+ * @brief Read everything currently available into the reader
+ * 
+ * Reads until the descriptor would block, so it should be non-blocking. End
+ * of file is flagged in the reader's eof field.
+ * 
+ * @param rd Target reader
+ * @return ssize_t Number of bytes read. -1 on error
+ */
+ssize_t reader_fill(reader *rd) {
+    ssize_t total = 0;
+    ssize_t len;
+    while ((len = reader_read(rd)) > 0) {
+        total += len;
     }
 
-    char buffer[buffer_size];
-    
-    char* read_str = NULL;
-    size_t str_len = 0;
-    ssize_t read_len = 0;
-    
-    bool terminator_found = false;
-    
-    /* Collect characters until EOF */
-    while (!terminator_found && (read_len = read(fd, buffer, buffer_size)) > 0)
-    {
-        /* Search for our terminator */
-        for (ssize_t i = 0; i < read_len; ++i) {
-            if (buffer[i] == terminator) {
-                terminator_found = true;
-                buffer[i] = '\0';
-                read_len = i + 1;
-                break;
-            }
+    if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        return -1;
+    }
+    return total;
+}
+
+/**
+ * @brief Get the number of bytes that can be consumed without reading
+ * 
+ * @param rd Target reader
+ * @return size_t Number of buffered bytes after the current record
+ */
+size_t reader_buffered(const reader *rd) {
+    return buffer_size(&rd->data) - rd->pending;
+}
+
+/**
+ * @brief Get the next record, blocking until it is complete
+ * 
+ * The record is returned in place with its terminator replaced by a null
+ * character, and stays valid until the next call on the reader.
+ * 
+ * @param rd Target reader
+ * @param terminator Character ending every record. Not included in the
+ * output string
+ * @return char* Next record, or the unterminated remainder at end of file.
+ * NULL once nothing is left
+ */
+char *reader_record(reader *rd, char terminator) {
+    buffer *b = &rd->data;
+
+    /* The previous record was only handed out, drop it now */
+    buffer_consume(b, rd->pending);
+    rd->pending = 0;
+
+    while (true) {
+        /* Only look at bytes that were not searched before */
+        char *start = b->data + b->start;
+        size_t size = buffer_size(b);
+        char *found = memchr(start + rd->scanned, terminator,
+                             size - rd->scanned);
+        if (found != NULL) {
+            *found = '\0';
+            rd->pending = (size_t)(found - start) + 1;
+            rd->scanned = 0;
+            return start;
+        }
+        rd->scanned = size;
+
+        if (rd->eof || reader_read(rd) <= 0) {
+            break;
         }
+    }
 
-        read_str = realloc(read_str, (str_len + (size_t)read_len));
-        memcpy(read_str + str_len, buffer, (size_t)read_len);
-        str_len += (size_t)read_len;
+    /* Hand out whatever is left without its terminator */
+    if (buffer_size(b) == 0 || buffer_reserve(b, 1) < 0) {
+        return NULL;
     }
+    b->data[b->end] = '\0';
+    rd->pending = buffer_size(b);
+    rd->scanned = 0;
+    return b->data + b->start;
+}
 
-    return read_str;
+/**
+ * @brief Deallocate memory used by a reader
+ * 
+ * @param rd Target reader
+ */
+void reader_free(reader *rd) {
+    buffer_free(&rd->data);
+    rd->scanned = 0;
+    rd->pending = 0;
 }
@@ -1,16 +1,69 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "buffer.h"
+
+/**
+ * Buffered reader over a file descriptor. Bytes read past the end of a
+ * record are kept for the next call instead of being dropped.
+ */
+typedef struct reader {
+    int fd;
+    buffer data;
+    size_t scanned;
+    size_t pending;
+    bool eof;
+} reader;
+
+/**
+ * @brief Initialise a reader over a file descriptor
+ * 
+ * @param rd Target reader
+ * @param fd Input file descriptor, which stays owned by the caller
+ */
+void reader_init(reader *rd, int fd);
+
+/**
+ * @brief Read everything currently available into the reader
+ * 
+ * Reads until the descriptor would block, so it should be non-blocking. End
+ * of file is flagged in the reader's eof field.
+ * 
+ * @param rd Target reader
+ * @return ssize_t Number of bytes read. -1 on error
+ */
+ssize_t reader_fill(reader *rd);
+
+/**
+ * @brief Get the number of bytes that can be consumed without reading
+ * 
+ * @param rd Target reader
+ * @return size_t Number of buffered bytes after the current record
+ */
+size_t reader_buffered(const reader *rd);
+
+/**
+ * @brief Get the next record, blocking until it is complete
+ * 
+ * The record is returned in place with its terminator replaced by a null
+ * character, and stays valid until the next call on the reader.
+ * 
+ * @param rd Target reader
+ * @param terminator Character ending every record. Not included in the
+ * output string
+ * @return char* Next record, or the unterminated remainder at end of file.
+ * NULL once nothing is left
+ */
+char *reader_record(reader *rd, char terminator);
+
 /**
- * @brief Read until EOF
- *
- * @param fd Input file descriptor
- * @param buffer_size The number of bytes to read at once.
- * 64 bytes if 0 specified
- * @param terminator Stop reading when terminator is reached. Not included in
- * the output string
- * @return char* Read string
+ * @brief Deallocate memory used by a reader
+ * 
+ * @param rd Target reader
  */
-char *read_all(int fd, size_t buffer_size, char terminator);
+void reader_free(reader *rd);
 
 #endif
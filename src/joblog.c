@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "joblog.h"
+
+#define LOG_FILE_MODE 0644
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Get the file name of a job's log.
+ * 
+ * @param name Destination
+ * @param size Size of the destination
+ * @param pid Pid of the job
+ * @param spawned_ns CLOCK_BOOTTIME at which the job was admitted
+ */
+static void joblog_name(char *name, size_t size, pid_t pid,
+                        uint64_t spawned_ns) {
+    snprintf(name, size, "%d-%llu.log", pid,
+             (unsigned long long)(spawned_ns / 1000000));
+}
+
+/**
+ * @brief Move bytes from a pipe to a descriptor inside the kernel.
+ * 
+ * @param from Pipe holding at least count bytes
+ * @param to Destination descriptor
+ * @param count Number of bytes to move
+ * @return size_t Number of bytes left in the pipe after a failure. 0 if
+ * every byte was moved
+ */
+static size_t splice_all(int from, int to, size_t count) {
+    while (count > 0) {
+        ssize_t n = splice(from, NULL, to, NULL, count, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        count -= (size_t)n;
+    }
+    return count;
+}
+
+/**
+ * @brief Append the end of a batch of output to the tail ring.
+ * 
+ * @param d Directory whose scratch pipe holds the duplicated batch
+ * @param l Target log
+ * @param count Size of the batch in the scratch pipe, which is emptied
+ */
+static void joblog_keep_tail(const joblog_dir *d, joblog *l, size_t count) {
+    if (l->tail == NULL) {
+        l->tail = malloc(JOBLOG_TAIL_SIZE);
+    }
+
+    /* Anything the ring would overwrite straight away is never copied */
+    size_t keep = count < JOBLOG_TAIL_SIZE ? count : JOBLOG_TAIL_SIZE;
+    if (l->tail == NULL) {
+        keep = 0;
+    }
+    size_t left = splice_all(d->copy_fds[0], d->null_fd, count - keep);
+    if (left > 0 || keep == 0) {
+        splice_all(d->copy_fds[0], d->null_fd, left + keep);
+        return;
+    }
+
+    size_t at = l->tail_end % JOBLOG_TAIL_SIZE;
+    size_t first = JOBLOG_TAIL_SIZE - at < keep ? JOBLOG_TAIL_SIZE - at : keep;
+    struct iovec iov[2] = {
+        { .iov_base = l->tail + at, .iov_len = first },
+        { .iov_base = l->tail, .iov_len = keep - first },
+    };
+    ssize_t n = readv(d->copy_fds[0], iov, 2);
+    if (n <= 0) {
+        splice_all(d->copy_fds[0], d->null_fd, keep);
+        return;
+    }
+
+    l->tail_end += (size_t)n;
+    l->tail_length += (size_t)n;
+    if (l->tail_length > JOBLOG_TAIL_SIZE) {
+        l->tail_length = JOBLOG_TAIL_SIZE;
+    }
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Open the directory receiving job logs.
+ * 
+ * @param d Target directory
+ * @param path Existing directory, shared by every worker
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+int joblog_dir_init(joblog_dir *d, const char *path) {
+    d->copy_fds[0] = d->copy_fds[1] = -1;
+    d->null_fd = -1;
+    d->dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (d->dir_fd < 0) {
+        return -1;
+    }
+
+    d->null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (d->null_fd < 0
+        || pipe2(d->copy_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        int saved = errno;
+        joblog_dir_free(d);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether job output is captured.
+ * 
+ * @param d Target directory
+ * @return true The directory was opened successfully
+ */
+bool joblog_dir_enabled(const joblog_dir *d) {
+    return d->dir_fd >= 0;
+}
+
+/**
+ * @brief Read the end of the log file of a job.
+ * 
+ * @param d Directory holding the log
+ * @param pid Pid of the job
+ * @param spawned_ns CLOCK_BOOTTIME at which the job was admitted
+ * @param dst Destination of the last bytes of the file
+ * @param size Largest number of bytes to read
+ * @return ssize_t Number of bytes read. -1 with errno set on failure
+ */
+ssize_t joblog_dir_read_tail(const joblog_dir *d, pid_t pid,
+                             uint64_t spawned_ns, char *dst, size_t size) {
+    char name[48];
+    joblog_name(name, sizeof(name), pid, spawned_ns);
+
+    int fd = openat(d->dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    ssize_t n = -1;
+    if (fstat(fd, &st) == 0) {
+        off_t start = st.st_size > (off_t)size ? st.st_size - (off_t)size : 0;
+        n = pread(fd, dst, (size_t)(st.st_size - start), start);
+    }
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n;
+}
+
+/**
+ * @brief Close the directory and its scratch descriptors.
+ * 
+ * @param d Target directory
+ */
+void joblog_dir_free(joblog_dir *d) {
+    int *fds[] = { &d->dir_fd, &d->copy_fds[0], &d->copy_fds[1], &d->null_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
+/**
+ * @brief Initialise a log that captures nothing.
+ * 
+ * @param l Target log
+ */
+void joblog_init(joblog *l) {
+    l->pipe_fd = -1;
+    l->file_fd = -1;
+    l->tail = NULL;
+    l->tail_end = 0;
+    l->tail_length = 0;
+}
+
+/**
+ * @brief Start capturing a job's output into its log file.
+ * 
+ * @param d Directory receiving the file
+ * @param l Target log
+ * @param pipe_fd Read end of the pipe holding the job's output, owned by the
+ * log from now on even on failure
+ * @param pid Pid of the job, which names the file
+ * @param spawned_ns CLOCK_BOOTTIME at which the job was admitted, which
+ * tells apart jobs that had the same pid
+ * @return int 0 if successful. -1 with errno set if the file could not be
+ * created, in which case output is still drained and only the tail is kept
+ */
+int joblog_open(const joblog_dir *d, joblog *l, int pipe_fd, pid_t pid,
+                uint64_t spawned_ns) {
+    char name[48];
+    joblog_name(name, sizeof(name), pid, spawned_ns);
+
+    joblog_init(l);
+    l->pipe_fd = pipe_fd;
+    l->file_fd = openat(d->dir_fd, name,
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        LOG_FILE_MODE);
+
+    int saved = errno;
+
+    /* The job writes to a blocking pipe, only this end must never block */
+    fcntl(pipe_fd, F_SETFL, fcntl(pipe_fd, F_GETFL) | O_NONBLOCK);
+
+    errno = saved;
+    return l->file_fd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Check whether output is still being captured.
+ * 
+ * @param l Target log
+ * @return true The job's pipe is open
+ */
+bool joblog_is_open(const joblog *l) {
+    return l->pipe_fd >= 0;
+}
+
+/**
+ * @brief Move pending output into the log file and keep its tail.
+ * 
+ * Output is spliced from the pipe to the file without passing through user
+ * space. Only the part that ends up in the tail is copied. Never blocks on
+ * the pipe.
+ * 
+ * @param d Directory of the log
+ * @param l Target log
+ * @param limit Largest number of bytes to move
+ * @return ssize_t Number of bytes moved. 0 once every writer is gone, which
+ * closes the pipe and the file. -1 with errno set, EAGAIN if nothing is
+ * pending
+ */
+ssize_t joblog_spool(const joblog_dir *d, joblog *l, size_t limit) {
+    /* Duplicate first, the pipe keeps the data until it is spliced out */
+    ssize_t n = tee(l->pipe_fd, d->copy_fds[1], limit, SPLICE_F_NONBLOCK);
+    if (n <= 0) {
+        if (n == 0) {
+            close(l->pipe_fd);
+            l->pipe_fd = -1;
+            if (l->file_fd >= 0) {
+                close(l->file_fd);
+                l->file_fd = -1;
+            }
+        }
+        return n;
+    }
+
+    /* A file that cannot take more still has to let the job go on */
+    size_t left = (size_t)n;
+    if (l->file_fd >= 0) {
+        left = splice_all(l->pipe_fd, l->file_fd, left);
+    }
+    if (left > 0) {
+        splice_all(l->pipe_fd, d->null_fd, left);
+    }
+
+    /* The scratch pipe is shared by every job and must be left empty */
+    joblog_keep_tail(d, l, (size_t)n);
+    return n;
+}
+
+/**
+ * @brief Copy the kept tail of the output in order.
+ * 
+ * @param l Target log
+ * @param dst Destination of at least JOBLOG_TAIL_SIZE bytes
+ * @return size_t Number of bytes copied
+ */
+size_t joblog_tail(const joblog *l, char *dst) {
+    if (l->tail == NULL) {
+        return 0;
+    }
+
+    size_t start = (l->tail_end - l->tail_length) % JOBLOG_TAIL_SIZE;
+    size_t first = JOBLOG_TAIL_SIZE - start < l->tail_length
+                 ? JOBLOG_TAIL_SIZE - start : l->tail_length;
+    memcpy(dst, l->tail + start, first);
+    memcpy(dst + first, l->tail, l->tail_length - first);
+    return l->tail_length;
+}
+
+/**
+ * @brief Stop capturing and forget the tail.
+ * 
+ * @param l Target log
+ */
+void joblog_close(joblog *l) {
+    if (l->pipe_fd >= 0) {
+        close(l->pipe_fd);
+    }
+    if (l->file_fd >= 0) {
+        close(l->file_fd);
+    }
+    free(l->tail);
+    joblog_init(l);
+}
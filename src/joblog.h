@@ -0,0 +1,136 @@
+#ifndef JOBLOG_H
+#define JOBLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Bytes of recent output kept in memory for every job */
+#define JOBLOG_TAIL_SIZE 4096
+
+/**
+ * Directory receiving one log file per job, named after the job's pid and
+ * the millisecond it was admitted, since pids get reused. Output is
+ * duplicated into a scratch pipe on its way to the files, so the tail of
+ * each batch can be kept without copying the rest.
+ */
+typedef struct joblog_dir {
+    int dir_fd;
+    int copy_fds[2];
+    int null_fd;
+} joblog_dir;
+
+/**
+ * Captured output of a single job. The pipe is closed once every writer has
+ * closed its end, the tail stays until the job is released.
+ */
+typedef struct joblog {
+    int pipe_fd;
+    int file_fd;
+    char *tail;
+    size_t tail_end;        /* Bytes ever kept, wraps around the ring */
+    size_t tail_length;
+} joblog;
+
+/**
+ * @brief Open the directory receiving job logs.
+ * 
+ * @param d Target directory
+ * @param path Existing directory, shared by every worker
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+int joblog_dir_init(joblog_dir *d, const char *path);
+
+/**
+ * @brief Check whether job output is captured.
+ * 
+ * @param d Target directory
+ * @return true The directory was opened successfully
+ */
+bool joblog_dir_enabled(const joblog_dir *d);
+
+/**
+ * @brief Read the end of the log file of a job.
+ * 
+ * @param d Directory holding the log
+ * @param pid Pid of the job
+ * @param spawned_ns CLOCK_BOOTTIME at which the job was admitted
+ * @param dst Destination of the last bytes of the file
+ * @param size Largest number of bytes to read
+ * @return ssize_t Number of bytes read. -1 with errno set on failure
+ */
+ssize_t joblog_dir_read_tail(const joblog_dir *d, pid_t pid,
+                             uint64_t spawned_ns, char *dst, size_t size);
+
+/**
+ * @brief Close the directory and its scratch descriptors.
+ * 
+ * @param d Target directory
+ */
+void joblog_dir_free(joblog_dir *d);
+
+/**
+ * @brief Initialise a log that captures nothing.
+ * 
+ * @param l Target log
+ */
+void joblog_init(joblog *l);
+
+/**
+ * @brief Start capturing a job's output into its log file.
+ * 
+ * @param d Directory receiving the file
+ * @param l Target log
+ * @param pipe_fd Read end of the pipe holding the job's output, owned by the
+ * log from now on even on failure
+ * @param pid Pid of the job, which names the file
+ * @param spawned_ns CLOCK_BOOTTIME at which the job was admitted, which
+ * tells apart jobs that had the same pid
+ * @return int 0 if successful. -1 with errno set if the file could not be
+ * created, in which case output is still drained and only the tail is kept
+ */
+int joblog_open(const joblog_dir *d, joblog *l, int pipe_fd, pid_t pid,
+                uint64_t spawned_ns);
+
+/**
+ * @brief Check whether output is still being captured.
+ * 
+ * @param l Target log
+ * @return true The job's pipe is open
+ */
+bool joblog_is_open(const joblog *l);
+
+/**
+ * @brief Move pending output into the log file and keep its tail.
+ * 
+ * Output is spliced from the pipe to the file without passing through user
+ * space. Only the part that ends up in the tail is copied. Never blocks on
+ * the pipe.
+ * 
+ * @param d Directory of the log
+ * @param l Target log
+ * @param limit Largest number of bytes to move
+ * @return ssize_t Number of bytes moved. 0 once every writer is gone, which
+ * closes the pipe and the file. -1 with errno set, EAGAIN if nothing is
+ * pending
+ */
+ssize_t joblog_spool(const joblog_dir *d, joblog *l, size_t limit);
+
+/**
+ * @brief Copy the kept tail of the output in order.
+ * 
+ * @param l Target log
+ * @param dst Destination of at least JOBLOG_TAIL_SIZE bytes
+ * @return size_t Number of bytes copied
+ */
+size_t joblog_tail(const joblog *l, char *dst);
+
+/**
+ * @brief Stop capturing and forget the tail.
+ * 
+ * @param l Target log
+ */
+void joblog_close(joblog *l);
+
+#endif
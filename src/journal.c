@@ -0,0 +1,476 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+#define JOURNAL_MAGIC 0x324C4E524A4D50ULL   /* "PMJRNL2" */
+#define JOURNAL_FILE_MODE 0644
+
+/* Entries start on their own cache line after the header */
+#define JOURNAL_HEADER_SIZE 64
+
+/* Room for a few thousand changes before the first compaction */
+#define JOURNAL_MIN_CAPACITY 4096
+
+/**
+ * Entry tagged with its position, so sorting by pid keeps each job's
+ * changes in order.
+ */
+typedef struct journal_item {
+    journal_entry entry;
+    size_t index;
+} journal_item;
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Get the size of a journal file with room for some entries.
+ * 
+ * @param capacity Number of entries
+ * @return size_t Size in bytes
+ */
+static size_t journal_size(size_t capacity) {
+    return JOURNAL_HEADER_SIZE + capacity * sizeof(journal_entry);
+}
+
+/**
+ * @brief Map a journal file into memory.
+ * 
+ * @param j Target journal whose descriptor is open
+ * @param capacity Number of entries the file has room for
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+static int journal_map(journal *j, size_t capacity) {
+    void *map = mmap(NULL, journal_size(capacity), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, j->fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    j->header = map;
+    j->entries = (journal_entry *)((char *)map + JOURNAL_HEADER_SIZE);
+    j->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Double the room for entries.
+ * 
+ * @param j Open journal
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+static int journal_grow(journal *j) {
+    size_t capacity = j->capacity * 2;
+    if (ftruncate(j->fd, (off_t)journal_size(capacity)) < 0) {
+        return -1;
+    }
+
+    void *map = mremap(j->header, journal_size(j->capacity),
+                       journal_size(capacity), MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    j->header = map;
+    j->entries = (journal_entry *)((char *)map + JOURNAL_HEADER_SIZE);
+    j->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Order entries by pid, then by position.
+ * 
+ * @param a First journal_item
+ * @param b Second journal_item
+ * @return int Negative, 0 or positive as a sorts before, with or after b
+ */
+static int journal_item_by_pid(const void *a, const void *b) {
+    const journal_item *x = a;
+    const journal_item *y = b;
+    if (x->entry.pid != y->entry.pid) {
+        return x->entry.pid < y->entry.pid ? -1 : 1;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * @brief Order entries by position.
+ * 
+ * @param a First journal_item
+ * @param b Second journal_item
+ * @return int Negative, 0 or positive as a sorts before, with or after b
+ */
+static int journal_item_by_index(const void *a, const void *b) {
+    const journal_item *x = a;
+    const journal_item *y = b;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise a journal that records nothing.
+ * 
+ * @param j Target journal
+ */
+void journal_init(journal *j) {
+    j->fd = -1;
+    j->path = NULL;
+    j->header = NULL;
+    j->entries = NULL;
+    j->capacity = 0;
+    j->live = 0;
+}
+
+/**
+ * @brief Open a journal, creating it if it does not exist.
+ * 
+ * @param j Target journal
+ * @param path File of the journal, which must outlive the journal
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+int journal_open(journal *j, const char *path) {
+    journal_init(j);
+    j->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, JOURNAL_FILE_MODE);
+    if (j->fd < 0) {
+        return -1;
+    }
+    j->path = path;
+
+    /* Anything that is not a journal written by this version starts over */
+    struct stat st;
+    bool is_valid = fstat(j->fd, &st) == 0
+                 && (size_t)st.st_size >= journal_size(JOURNAL_MIN_CAPACITY);
+    uint64_t magic = 0;
+    if (is_valid && (pread(j->fd, &magic, sizeof(magic), 0) != sizeof(magic)
+                     || magic != JOURNAL_MAGIC)) {
+        is_valid = false;
+    }
+
+    size_t capacity = JOURNAL_MIN_CAPACITY;
+    if (is_valid) {
+        capacity = ((size_t)st.st_size - JOURNAL_HEADER_SIZE)
+                 / sizeof(journal_entry);
+    } else if (ftruncate(j->fd, 0) < 0
+               || ftruncate(j->fd, (off_t)journal_size(capacity)) < 0) {
+        int saved = errno;
+        journal_close(j);
+        errno = saved;
+        return -1;
+    }
+
+    if (journal_map(j, capacity) < 0) {
+        int saved = errno;
+        journal_close(j);
+        errno = saved;
+        return -1;
+    }
+
+    if (!is_valid) {
+        j->header->magic = JOURNAL_MAGIC;
+        atomic_store_explicit(&j->header->length, 0, memory_order_release);
+    } else if (atomic_load(&j->header->length) > j->capacity) {
+        atomic_store(&j->header->length, j->capacity);
+    }
+    return 0;
+}
+
+/**
+ * @brief Check whether changes are recorded.
+ * 
+ * @param j Target journal
+ * @return true The journal was opened successfully
+ */
+bool journal_enabled(const journal *j) {
+    return j->fd >= 0;
+}
+
+/**
+ * @brief Fold the entries into the jobs still alive when they were written.
+ * 
+ * @param j Open journal
+ * @param jobs Destination of one admission per live job, in admission order
+ * and with its latest stopped and killed state. Must be freed
+ * @return ssize_t Number of live jobs. -1 with errno set on failure
+ */
+ssize_t journal_replay(journal *j, journal_entry **jobs) {
+    size_t length = atomic_load_explicit(&j->header->length,
+                                         memory_order_acquire);
+    if (length > j->capacity) {
+        length = j->capacity;
+    }
+    journal_item *items = malloc((length > 0 ? length : 1)
+                                 * sizeof(journal_item));
+    if (items == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        items[i].entry = j->entries[i];
+        items[i].index = i;
+    }
+
+    /* Every job's changes end up next to each other and still in order */
+    qsort(items, length, sizeof(journal_item), journal_item_by_pid);
+
+    size_t count = 0;
+    for (size_t i = 0; i < length;) {
+        pid_t pid = items[i].entry.pid;
+        journal_item job = { .index = 0 };
+        bool is_live = false;
+        for (; i < length && items[i].entry.pid == pid; ++i) {
+            const journal_entry *e = &items[i].entry;
+            if (e->op == JOURNAL_ADMIT) {
+                job = items[i];
+                is_live = true;
+            } else if (e->op == JOURNAL_EXIT) {
+                is_live = false;
+            } else if (e->op == JOURNAL_KILL) {
+                job.entry.killed = is_live;
+            } else if (is_live) {
+                job.entry.stopped = e->op == JOURNAL_STOP;
+            }
+        }
+        if (is_live) {
+            items[count++] = job;
+        }
+    }
+    qsort(items, count, sizeof(journal_item), journal_item_by_index);
+
+    journal_entry *live = malloc((count > 0 ? count : 1)
+                                 * sizeof(journal_entry));
+    if (live == NULL) {
+        free(items);
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        live[i] = items[i].entry;
+    }
+    free(items);
+
+    j->live = count;
+    *jobs = live;
+    return (ssize_t)count;
+}
+
+/**
+ * @brief Read the live jobs of a journal another process writes.
+ * 
+ * The file is only mapped for reading, so its writer is never disturbed. A
+ * journal that grows meanwhile is read as far as it was mapped.
+ * 
+ * @param path File of the journal
+ * @param jobs Destination of one admission per live job, in admission order.
+ * Must be freed
+ * @return ssize_t Number of live jobs, 0 if there is no valid journal. -1
+ * with errno set on failure
+ */
+ssize_t journal_load(const char *path, journal_entry **jobs) {
+    *jobs = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    struct stat st;
+    uint64_t magic = 0;
+    if (fstat(fd, &st) < 0
+        || (size_t)st.st_size < journal_size(JOURNAL_MIN_CAPACITY)
+        || pread(fd, &magic, sizeof(magic), 0) != sizeof(magic)
+        || magic != JOURNAL_MAGIC) {
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = saved;
+        return -1;
+    }
+
+    journal j;
+    journal_init(&j);
+    j.header = map;
+    j.entries = (journal_entry *)((char *)map + JOURNAL_HEADER_SIZE);
+    j.capacity = ((size_t)st.st_size - JOURNAL_HEADER_SIZE)
+               / sizeof(journal_entry);
+    ssize_t count = journal_replay(&j, jobs);
+
+    saved = errno;
+    munmap(map, (size_t)st.st_size);
+    errno = saved;
+    return count;
+}
+
+/**
+ * @brief Check whether the journal should be rewritten before it grows.
+ * 
+ * @param j Open journal
+ * @return true The journal is full and at least half of it is dead entries
+ */
+bool journal_needs_compaction(const journal *j) {
+    size_t length = atomic_load_explicit(&j->header->length,
+                                         memory_order_relaxed);
+    return length == j->capacity && j->live * 2 <= j->capacity;
+}
+
+/**
+ * @brief Record one change.
+ * 
+ * The entry only counts once it is written in full, so a crash halfway
+ * through leaves the earlier entries intact.
+ * 
+ * @param j Open journal
+ * @param e Change to record
+ * @return int 0 if successful. -1 with errno set if the journal is full and
+ * could not grow
+ */
+int journal_append(journal *j, const journal_entry *e) {
+    size_t length = atomic_load_explicit(&j->header->length,
+                                         memory_order_relaxed);
+    if (length == j->capacity && journal_grow(j) < 0) {
+        return -1;
+    }
+
+    j->entries[length] = *e;
+    atomic_store_explicit(&j->header->length, length + 1,
+                          memory_order_release);
+
+    if (e->op == JOURNAL_ADMIT) {
+        j->live++;
+    } else if (e->op == JOURNAL_EXIT && j->live > 0) {
+        j->live--;
+    }
+    return 0;
+}
+
+/**
+ * @brief Replace every entry with the admissions of the live jobs.
+ * 
+ * The new entries are written to a separate file that replaces the journal
+ * in one rename, so a crash leaves either the old or the new journal.
+ * 
+ * @param j Open journal
+ * @param jobs One admission per live job
+ * @param count Number of live jobs
+ * @return int 0 if successful. -1 with errno set otherwise, leaving the
+ * journal as it was
+ */
+int journal_compact(journal *j, const journal_entry *jobs, size_t count) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s.tmp", j->path) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    /* Half empty afterwards, so the next compaction is as far away */
+    size_t capacity = JOURNAL_MIN_CAPACITY;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  JOURNAL_FILE_MODE);
+    if (fd < 0) {
+        return -1;
+    }
+
+    journal_header header = {
+        .magic = JOURNAL_MAGIC,
+        .length = count,
+        .slots = j->header->slots,
+    };
+    size_t size = count * sizeof(journal_entry);
+    if (ftruncate(fd, (off_t)journal_size(capacity)) < 0
+        || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)
+        || pwrite(fd, jobs, size, JOURNAL_HEADER_SIZE) != (ssize_t)size
+        || rename(path, j->path) < 0) {
+        int saved = errno;
+        close(fd);
+        unlink(path);
+        errno = saved;
+        return -1;
+    }
+
+    munmap(j->header, journal_size(j->capacity));
+    close(j->fd);
+    j->fd = fd;
+    j->live = count;
+    if (journal_map(j, capacity) < 0) {
+        int saved = errno;
+        journal_close(j);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the slots the writer held when it last saved them.
+ * 
+ * @param j Open journal
+ * @return journal_slots Saved slots. All 0 in a new journal
+ */
+journal_slots journal_saved_slots(const journal *j) {
+    return j->header->slots;
+}
+
+/**
+ * @brief Save the slots the writer holds.
+ * 
+ * @param j Open journal
+ * @param slots Slots held
+ */
+void journal_save_slots(journal *j, const journal_slots *slots) {
+    j->header->slots = *slots;
+}
+
+/**
+ * @brief Close the journal and keep its file for the next writer.
+ * 
+ * @param j Target journal
+ */
+void journal_close(journal *j) {
+    if (j->header != NULL) {
+        munmap(j->header, journal_size(j->capacity));
+    }
+    if (j->fd >= 0) {
+        close(j->fd);
+    }
+    journal_init(j);
+}
+
+/**
+ * @brief Close the journal and delete its file, once no job is left.
+ * 
+ * @param j Target journal
+ * @return int 0 if successful. -1 with errno set if the file could not be
+ * deleted
+ */
+int journal_discard(journal *j) {
+    int result = 0;
+    if (j->path != NULL && unlink(j->path) < 0 && errno != ENOENT) {
+        result = -1;
+    }
+    int saved = errno;
+    journal_close(j);
+    errno = saved;
+    return result;
+}
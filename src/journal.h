@@ -0,0 +1,177 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef enum journal_op {
+    JOURNAL_ADMIT = 1,
+    JOURNAL_STOP,
+    JOURNAL_RESUME,
+    JOURNAL_EXIT,
+    JOURNAL_KILL,
+} journal_op;
+
+/**
+ * One change to the process table. Entries name their job by pid, and an
+ * admission also carries what is needed to find the job again.
+ */
+typedef struct journal_entry {
+    uint32_t op;
+    pid_t pid;
+    uint64_t spawned_ns;    /* CLOCK_BOOTTIME at admission */
+    uint64_t cgroup_id;
+    pid_t cgroup_owner;     /* 0 if the job has no cgroup */
+    uint32_t stopped;       /* Admission of a job that is STOPPED */
+    uint32_t killed;        /* Admission of a job killed but not reaped */
+} journal_entry;
+
+/**
+ * Slots of a shared pool held by the writer, so whoever takes over its jobs
+ * also takes over its place in the pool.
+ */
+typedef struct journal_slots {
+    uint64_t lent;
+    uint64_t borrowed;
+    uint64_t wanted;
+} journal_slots;
+
+typedef struct journal_header {
+    uint64_t magic;
+    _Atomic uint64_t length;    /* Entries written in full */
+    journal_slots slots;
+} journal_header;
+
+/**
+ * Append-only log of the process table in a file mapped into memory, so an
+ * entry costs a copy and survives the writer crashing. Entries of jobs that
+ * are gone are dropped by rewriting the file with only the live ones.
+ */
+typedef struct journal {
+    int fd;
+    const char *path;
+    journal_header *header;
+    journal_entry *entries;
+    size_t capacity;        /* Entries the file has room for */
+    size_t live;            /* Jobs admitted and not exited */
+} journal;
+
+/**
+ * @brief Initialise a journal that records nothing.
+ * 
+ * @param j Target journal
+ */
+void journal_init(journal *j);
+
+/**
+ * @brief Open a journal, creating it if it does not exist.
+ * 
+ * @param j Target journal
+ * @param path File of the journal, which must outlive the journal
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+int journal_open(journal *j, const char *path);
+
+/**
+ * @brief Check whether changes are recorded.
+ * 
+ * @param j Target journal
+ * @return true The journal was opened successfully
+ */
+bool journal_enabled(const journal *j);
+
+/**
+ * @brief Fold the entries into the jobs still alive when they were written.
+ * 
+ * @param j Open journal
+ * @param jobs Destination of one admission per live job, in admission order
+ * and with its latest stopped and killed state. Must be freed
+ * @return ssize_t Number of live jobs. -1 with errno set on failure
+ */
+ssize_t journal_replay(journal *j, journal_entry **jobs);
+
+/**
+ * @brief Read the live jobs of a journal another process writes.
+ * 
+ * The file is only mapped for reading, so its writer is never disturbed. A
+ * journal that grows meanwhile is read as far as it was mapped.
+ * 
+ * @param path File of the journal
+ * @param jobs Destination of one admission per live job, in admission order.
+ * Must be freed
+ * @return ssize_t Number of live jobs, 0 if there is no valid journal. -1
+ * with errno set on failure
+ */
+ssize_t journal_load(const char *path, journal_entry **jobs);
+
+/**
+ * @brief Check whether the journal should be rewritten before it grows.
+ * 
+ * @param j Open journal
+ * @return true The journal is full and at least half of it is dead entries
+ */
+bool journal_needs_compaction(const journal *j);
+
+/**
+ * @brief Record one change.
+ * 
+ * The entry only counts once it is written in full, so a crash halfway
+ * through leaves the earlier entries intact.
+ * 
+ * @param j Open journal
+ * @param e Change to record
+ * @return int 0 if successful. -1 with errno set if the journal is full and
+ * could not grow
+ */
+int journal_append(journal *j, const journal_entry *e);
+
+/**
+ * @brief Replace every entry with the admissions of the live jobs.
+ * 
+ * The new entries are written to a separate file that replaces the journal
+ * in one rename, so a crash leaves either the old or the new journal.
+ * 
+ * @param j Open journal
+ * @param jobs One admission per live job
+ * @param count Number of live jobs
+ * @return int 0 if successful. -1 with errno set otherwise, leaving the
+ * journal as it was
+ */
+int journal_compact(journal *j, const journal_entry *jobs, size_t count);
+
+/**
+ * @brief Get the slots the writer held when it last saved them.
+ * 
+ * @param j Open journal
+ * @return journal_slots Saved slots. All 0 in a new journal
+ */
+journal_slots journal_saved_slots(const journal *j);
+
+/**
+ * @brief Save the slots the writer holds.
+ * 
+ * @param j Open journal
+ * @param slots Slots held
+ */
+void journal_save_slots(journal *j, const journal_slots *slots);
+
+/**
+ * @brief Close the journal and keep its file for the next writer.
+ * 
+ * @param j Target journal
+ */
+void journal_close(journal *j);
+
+/**
+ * @brief Close the journal and delete its file, once no job is left.
+ * 
+ * @param j Target journal
+ * @return int 0 if successful. -1 with errno set if the file could not be
+ * deleted
+ */
+int journal_discard(journal *j);
+
+#endif
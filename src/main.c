@@ -2,43 +2,305 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include "input.h"
 #include "runner.h"
 
-#define MAX_RUNNING_PROCESSES 3
-#define POLLING_INTERVAL 1
-#define BUFFER_SIZE 64
+#define COMMAND_EXIT "exit"
 
+/* Commands sent in one write before collecting their replies in batch mode */
+#define BATCH_WINDOW 256
 
-int main(void) {
-    runner rn;
-    if (rn_init(&rn, MAX_RUNNING_PROCESSES) < 0) {
-        perror("failed to start");
-        exit(EXIT_FAILURE);
-    };
-    
+#define USAGE "USAGE: %s [-z] [-f FILE] [-s POLICY] [-q MS] [-c SLOTS] [-a MODE]\n" \
+              "          [-g CGROUP] [-w PERCENT] [-i MS] [-p MIN] [-j WORKERS]\n" \
+              "          [-t THREADS] [-l DIR] [-r DIR]\n"                \
+              "    -z         launch jobs through a fork-server\n"           \
+              "    -f FILE    run commands from FILE without prompting\n"     \
+              "    -s POLICY  scheduling policy, fifo (default), rr or mlfq\n" \
+              "    -q MS      scheduling quantum of rr and mlfq\n"           \
+              "    -c SLOTS   jobs running at once, one per CPU by default\n" \
+              "    -a MODE    bind slots to none, cpu (default) or numa\n"  \
+              "    -g CGROUP  run each job in a cgroup under CGROUP\n"      \
+              "    -w PERCENT CPU share of waiting jobs, 0 (default) freezes\n" \
+              "    -i MS      job usage sampling interval, 0 disables\n"      \
+              "    -p MIN     adapt slots to host pressure, down to MIN\n"   \
+              "    -j WORKERS split jobs and slots between WORKERS workers\n" \
+              "    -t THREADS launch jobs from THREADS threads per worker\n" \
+              "    -l DIR     write the output of each job to DIR/PID-MS.log\n" \
+              "    -r DIR     journal jobs in DIR and restart workers that die\n"
+
+
+/**
+ * @brief Print the reply to a command.
+ * 
+ * @param r Reply to print
+ */
+static void print_reply(const reply *r) {
+    FILE *out = stdout;
+    if (r->status < 0) {
+        /* Keep errors in order with buffered output */
+        fflush(stdout);
+        out = stderr;
+    }
+    fwrite(r->text, sizeof(char), r->length, out);
+}
+
+/**
+ * @brief Run commands one at a time, prompting for each.
+ * 
+ * @param rn Runner executing the commands
+ * @param in Reader over the user's input
+ * @param r Reply storage
+ */
+static void run_interactive(runner *rn, reader *in, reply *r) {
     bool is_running = true;
 
     while (is_running) {
         printf("cs205$ ");
         fflush(stdout);
 
-        /* Get input from stdin */
-        char *input = read_all(STDIN_FILENO, BUFFER_SIZE, '\n');
+        /* Get input from stdin, end of input is the same as exit */
+        char *input = reader_record(in, '\n');
+        const char *command = input != NULL ? input : COMMAND_EXIT;
         
-        is_running = strcmp("exit", input) != 0;
+        is_running = strcmp(COMMAND_EXIT, command) != 0;
+
+        if (strlen(command) > 0) {
+            /* Returns once the worker has applied the command */
+            if (rn_send_input(rn, command, r) < 0) {
+                perror("worker stopped responding");
+                is_running = false;
+            } else {
+                print_reply(r);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Send every queued command and print all of their replies.
+ * 
+ * @param rn Runner executing the commands
+ * @param in_flight Number of queued commands
+ * @param r Reply storage
+ * @return int 0 if successful. -1 otherwise
+ */
+static int complete_window(runner *rn, size_t in_flight, reply *r) {
+    if (rn_flush(rn) < 0) {
+        return -1;
+    }
 
-        if (input && strlen(input) > 0) {
-            rn_send_input(&rn, input);
-            free(input);
-            if (is_running) {
-                sleep(POLLING_INTERVAL);
+    uint64_t id;
+    for (size_t i = 0; i < in_flight; ++i) {
+        if (rn_receive(rn, &id, r) < 0) {
+            return -1;
+        }
+        print_reply(r);
+    }
+    return 0;
+}
+
+/**
+ * @brief Stream commands to the worker without waiting for each one.
+ * 
+ * Commands are sent in windows of up to BATCH_WINDOW, or fewer when no more
+ * input is buffered yet. Replies are printed as they come back, which for
+ * fork-server launches is not always in order.
+ * 
+ * @param rn Runner executing the commands
+ * @param in Reader over the commands
+ * @param r Reply storage
+ */
+static void run_batch(runner *rn, reader *in, reply *r) {
+    size_t in_flight = 0;
+    bool is_running = true;
+    reply local;
+    reply_init(&local);
+
+    while (is_running) {
+        /* End of input is the same as exit */
+        char *input = reader_record(in, '\n');
+        const char *command = input != NULL ? input : COMMAND_EXIT;
+        is_running = strcmp(COMMAND_EXIT, command) != 0;
+
+        uint64_t id;
+        int queued = rn_submit(rn, command, &id, &local);
+        if (queued < 0) {
+            perror("failed to queue command");
+        } else if (queued == 0) {
+            /* Keep the output in input order by finishing earlier commands */
+            if (in_flight > 0) {
+                if (complete_window(rn, in_flight, r) < 0) {
+                    perror("worker stopped responding");
+                    break;
+                }
+                in_flight = 0;
+            }
+            print_reply(&local);
+        } else {
+            in_flight++;
+        }
+
+        /* Do not hold commands back while waiting for more input */
+        bool is_waiting = reader_buffered(in) == 0 || !is_running;
+        if (in_flight > 0 && (in_flight == BATCH_WINDOW || is_waiting)) {
+            if (complete_window(rn, in_flight, r) < 0) {
+                perror("worker stopped responding");
+                break;
             }
+            in_flight = 0;
         }
     }
 
+    reply_free(&local);
+}
+
+
+int main(int argc, char *argv[]) {
+    pm_config config;
+    pm_config_default(&config);
+
+    const char *script = NULL;
+    size_t shard_count = 1;
+    const char *journal_dir = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "zf:s:q:c:a:g:w:i:p:j:t:l:r:")) != -1) {
+        switch (opt) {
+        case 'z': /* Launch jobs through a fork-server */
+            config.fork_server = true;
+            break;
+
+        case 'f': /* Read commands from a file */
+            script = optarg;
+            break;
+
+        case 'q': /* Set the scheduling quantum */
+            config.quantum_ms = atol(optarg);
+            if (config.quantum_ms <= 0 || config.quantum_ms > QUANTUM_MAX_MS) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'c': /* Set the number of running slots */
+            if (atol(optarg) <= 0) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            config.max_running_processes = (size_t)atol(optarg);
+            break;
+
+        case 'p': /* Let host pressure take slots away, down to a minimum */
+            if (atol(optarg) <= 0) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            config.min_running_processes = (size_t)atol(optarg);
+            break;
+
+        case 'j': /* Split the process table between several workers */
+            if (atol(optarg) <= 0) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            shard_count = (size_t)atol(optarg);
+            break;
+
+        case 't': /* Launch jobs from spawner threads */
+            if (atol(optarg) <= 0) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            config.spawner_threads = (size_t)atol(optarg);
+            break;
+
+        case 'a': /* Pick how slots are bound to CPUs */
+            if (!strcmp(optarg, "none")) {
+                config.affinity = AFFINITY_NONE;
+            } else if (!strcmp(optarg, "cpu")) {
+                config.affinity = AFFINITY_CPU;
+            } else if (!strcmp(optarg, "numa")) {
+                config.affinity = AFFINITY_NUMA;
+            } else {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'l': /* Capture the output of jobs into log files */
+            config.log_path = optarg;
+            break;
+
+        case 'r': /* Let jobs outlive the worker managing them */
+            journal_dir = optarg;
+            break;
+
+        case 'g': /* Manage jobs through a delegated cgroup subtree */
+            config.cgroup_path = optarg;
+            break;
+
+        case 'w': /* Let waiting jobs keep a share of the CPU */
+            config.ready_share = atoi(optarg);
+            if (config.ready_share < 0 || config.ready_share >= 100) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'i': /* Set how often job resource usage is sampled */
+            config.sample_interval_ms = atol(optarg);
+            if (config.sample_interval_ms < 0) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 's': /* Pick a scheduling policy */
+            config.policy = sched_find(optarg);
+            if (config.policy == NULL) {
+                fprintf(stderr, USAGE, argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int input_fd = STDIN_FILENO;
+    if (script != NULL && (input_fd = open(script, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror(script);
+        exit(EXIT_FAILURE);
+    }
+
+    runner rn;
+    if (rn_init(&rn, &config, shard_count, journal_dir) < 0) {
+        perror("failed to start");
+        exit(EXIT_FAILURE);
+    };
+    
+    reply r;
+    reply_init(&r);
+    reader in;
+    reader_init(&in, input_fd);
+
+    /* Prompts only make sense when someone is typing */
+    if (script == NULL && isatty(input_fd)) {
+        run_interactive(&rn, &in, &r);
+    } else {
+        run_batch(&rn, &in, &r);
+    }
+
+    reader_free(&in);
+    reply_free(&r);
     rn_free(&rn);
+    if (script != NULL) {
+        close(input_fd);
+    }
 
     return EXIT_SUCCESS;
 }
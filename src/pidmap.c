@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pidmap.h"
+
+#define PIDMAP_INITIAL_CAPACITY 64
+
+/* Pids are always positive so these can never collide with a real key */
+#define SLOT_EMPTY 0
+#define SLOT_DELETED -1
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Get the home slot of a pid.
+ * 
+ * Sequential pids are scattered with a multiplicative hash so that linear
+ * probing does not degrade into long clusters. The slot comes from the high
+ * bits of the product, the low ones only depend on the low bits of the pid
+ * and would crowd pids with a power of two stride into a few slots.
+ * 
+ * @param pid Key
+ * @param capacity Table capacity, always a power of two
+ * @return size_t Slot index
+ */
+static size_t pidmap_slot(pid_t pid, size_t capacity) {
+    uint64_t h = (uint64_t)(uint32_t)pid * UINT64_C(0x9E3779B97F4A7C15);
+    return (size_t)(h >> (64 - __builtin_ctzll(capacity)));
+}
+
+/**
+ * @brief Find the slot holding a pid.
+ * 
+ * @param m Target map
+ * @param pid Key
+ * @return pidmap_entry* Entry with the pid. NULL if not found
+ */
+static pidmap_entry *pidmap_find(const pidmap *m, pid_t pid) {
+    if (m->capacity == 0) {
+        return NULL;
+    }
+
+    size_t mask = m->capacity - 1;
+    for (size_t i = pidmap_slot(pid, m->capacity);; i = (i + 1) & mask) {
+        pidmap_entry *e = &m->entries[i];
+        if (e->pid == pid) {
+            return e;
+        }
+        if (e->pid == SLOT_EMPTY) {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @brief Rebuild the table with a new capacity, dropping deleted slots.
+ * 
+ * @param m Target map
+ * @param capacity New capacity, must be a power of two
+ * @return int 0 if successful. -1 otherwise
+ */
+static int pidmap_rehash(pidmap *m, size_t capacity) {
+    pidmap_entry *entries = calloc(capacity, sizeof(pidmap_entry));
+    if (entries == NULL) {
+        return -1;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < m->capacity; ++i) {
+        pidmap_entry *e = &m->entries[i];
+        if (e->pid == SLOT_EMPTY || e->pid == SLOT_DELETED) {
+            continue;
+        }
+
+        size_t j = pidmap_slot(e->pid, capacity);
+        while (entries[j].pid != SLOT_EMPTY) {
+            j = (j + 1) & mask;
+        }
+        entries[j] = *e;
+    }
+
+    free(m->entries);
+    m->entries = entries;
+    m->capacity = capacity;
+    m->used = m->size;
+    return 0;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise an empty pid map.
+ * 
+ * @param m Target map
+ */
+void pidmap_init(pidmap *m) {
+    m->entries = NULL;
+    m->capacity = 0;
+    m->size = 0;
+    m->used = 0;
+}
+
+/**
+ * @brief Associate a value with a pid, replacing any previous value.
+ * 
+ * @param m Target map
+ * @param pid Key. Must be a positive pid
+ * @param value Value to store
+ * @return int 0 if successful. -1 if the map could not grow
+ */
+int pidmap_put(pidmap *m, pid_t pid, void *value) {
+    pidmap_entry *e = pidmap_find(m, pid);
+    if (e != NULL) {
+        e->value = value;
+        return 0;
+    }
+
+    /* Keep live and deleted slots under 70% so probes stay short */
+    if ((m->used + 1) * 10 > m->capacity * 7) {
+        size_t capacity = m->capacity ? m->capacity : PIDMAP_INITIAL_CAPACITY;
+        if (m->size * 2 >= capacity) {
+            capacity *= 2;
+        }
+        if (pidmap_rehash(m, capacity) < 0) {
+            return -1;
+        }
+    }
+
+    size_t mask = m->capacity - 1;
+    size_t i = pidmap_slot(pid, m->capacity);
+    while (m->entries[i].pid != SLOT_EMPTY && m->entries[i].pid != SLOT_DELETED) {
+        i = (i + 1) & mask;
+    }
+
+    if (m->entries[i].pid == SLOT_EMPTY) {
+        m->used++;
+    }
+    m->entries[i].pid = pid;
+    m->entries[i].value = value;
+    m->size++;
+    return 0;
+}
+
+/**
+ * @brief Look up the value associated with a pid.
+ * 
+ * @param m Target map
+ * @param pid Key
+ * @return void* Stored value. NULL if pid is not in the map
+ */
+void *pidmap_get(const pidmap *m, pid_t pid) {
+    pidmap_entry *e = pidmap_find(m, pid);
+    return e ? e->value : NULL;
+}
+
+/**
+ * @brief Remove a pid from the map. No-op if it is not present.
+ * 
+ * @param m Target map
+ * @param pid Key
+ */
+void pidmap_remove(pidmap *m, pid_t pid) {
+    pidmap_entry *e = pidmap_find(m, pid);
+    if (e != NULL) {
+        e->pid = SLOT_DELETED;
+        e->value = NULL;
+        m->size--;
+    }
+}
+
+/**
+ * @brief Remove every entry while keeping the allocated table.
+ * 
+ * @param m Target map
+ */
+void pidmap_clear(pidmap *m) {
+    if (m->entries != NULL) {
+        memset(m->entries, 0, m->capacity * sizeof(pidmap_entry));
+    }
+    m->size = 0;
+    m->used = 0;
+}
+
+/**
+ * @brief Deallocate memory used by the map.
+ * 
+ * @param m Target map
+ */
+void pidmap_free(pidmap *m) {
+    free(m->entries);
+    pidmap_init(m);
+}
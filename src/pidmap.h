@@ -0,0 +1,67 @@
+#ifndef PIDMAP_H
+#define PIDMAP_H
+
+#include <stddef.h>
+#include <unistd.h>
+
+typedef struct pidmap_entry {
+    pid_t pid;
+    void *value;
+} pidmap_entry;
+
+typedef struct pidmap {
+    pidmap_entry *entries;
+    size_t capacity;
+    size_t size;
+    size_t used;
+} pidmap;
+
+/**
+ * @brief Initialise an empty pid map.
+ * 
+ * @param m Target map
+ */
+void pidmap_init(pidmap *m);
+
+/**
+ * @brief Associate a value with a pid, replacing any previous value.
+ * 
+ * @param m Target map
+ * @param pid Key. Must be a positive pid
+ * @param value Value to store
+ * @return int 0 if successful. -1 if the map could not grow
+ */
+int pidmap_put(pidmap *m, pid_t pid, void *value);
+
+/**
+ * @brief Look up the value associated with a pid.
+ * 
+ * @param m Target map
+ * @param pid Key
+ * @return void* Stored value. NULL if pid is not in the map
+ */
+void *pidmap_get(const pidmap *m, pid_t pid);
+
+/**
+ * @brief Remove a pid from the map. No-op if it is not present.
+ * 
+ * @param m Target map
+ * @param pid Key
+ */
+void pidmap_remove(pidmap *m, pid_t pid);
+
+/**
+ * @brief Remove every entry while keeping the allocated table.
+ * 
+ * @param m Target map
+ */
+void pidmap_clear(pidmap *m);
+
+/**
+ * @brief Deallocate memory used by the map.
+ * 
+ * @param m Target map
+ */
+void pidmap_free(pidmap *m);
+
+#endif
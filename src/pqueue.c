@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "pqueue.h"
+#include "procman.h"
+
+#define PQUEUE_INITIAL_CAPACITY 16
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Check whether a process should be closer to the top than another.
+ * 
+ * @param q Queue providing the ordering
+ * @param a First process
+ * @param b Second process
+ * @return true a goes before b
+ * @return false otherwise
+ */
+static bool pq_before(const pqueue *q, const process *a, const process *b) {
+    return q->max_first ? a->priority > b->priority
+                        : a->priority < b->priority;
+}
+
+/**
+ * @brief Place a process at a heap position and record it in the process.
+ * 
+ * @param q Target queue
+ * @param i Heap position
+ * @param p Process to place
+ */
+static void pq_set(pqueue *q, size_t i, process *p) {
+    q->items[i] = p;
+    p->heap_index = i;
+}
+
+/**
+ * @brief Move the process at a position up until the heap is ordered.
+ * 
+ * @param q Target queue
+ * @param i Heap position
+ */
+static void pq_sift_up(pqueue *q, size_t i) {
+    process *p = q->items[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!pq_before(q, p, q->items[parent])) {
+            break;
+        }
+        pq_set(q, i, q->items[parent]);
+        i = parent;
+    }
+    pq_set(q, i, p);
+}
+
+/**
+ * @brief Move the process at a position down until the heap is ordered.
+ * 
+ * @param q Target queue
+ * @param i Heap position
+ */
+static void pq_sift_down(pqueue *q, size_t i) {
+    process *p = q->items[i];
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= q->size) {
+            break;
+        }
+        if (child + 1 < q->size && pq_before(q, q->items[child + 1], q->items[child])) {
+            child++;
+        }
+        if (!pq_before(q, q->items[child], p)) {
+            break;
+        }
+        pq_set(q, i, q->items[child]);
+        i = child;
+    }
+    pq_set(q, i, p);
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise an empty queue.
+ * 
+ * @param q Target queue
+ * @param max_first Order highest priority keys first instead of lowest
+ */
+void pq_init(pqueue *q, bool max_first) {
+    q->items = NULL;
+    q->size = 0;
+    q->capacity = 0;
+    q->max_first = max_first;
+}
+
+/**
+ * @brief Make sure the queue can hold a number of processes without
+ * allocating.
+ * 
+ * @param q Target queue
+ * @param capacity Number of processes
+ * @return int 0 if successful. -1 otherwise
+ */
+int pq_reserve(pqueue *q, size_t capacity) {
+    if (capacity <= q->capacity) {
+        return 0;
+    }
+
+    size_t new_capacity = q->capacity ? q->capacity : PQUEUE_INITIAL_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+
+    process **items = realloc(q->items, new_capacity * sizeof(process *));
+    if (items == NULL) {
+        return -1;
+    }
+
+    q->items = items;
+    q->capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Add a process to the queue.
+ * 
+ * @param q Target queue
+ * @param p Process not currently in any queue
+ * @return int 0 if successful. -1 otherwise
+ */
+int pq_push(pqueue *q, process *p) {
+    if (pq_reserve(q, q->size + 1) < 0) {
+        return -1;
+    }
+
+    q->items[q->size] = p;
+    pq_sift_up(q, q->size++);
+    return 0;
+}
+
+/**
+ * @brief Get the first process without removing it.
+ * 
+ * @param q Target queue
+ * @return process* First process. NULL if queue is empty
+ */
+process *pq_peek(const pqueue *q) {
+    return q->size > 0 ? q->items[0] : NULL;
+}
+
+/**
+ * @brief Remove and return the first process.
+ * 
+ * @param q Target queue
+ * @return process* First process. NULL if queue is empty
+ */
+process *pq_pop(pqueue *q) {
+    process *p = pq_peek(q);
+    if (p != NULL) {
+        pq_remove(q, p);
+    }
+    return p;
+}
+
+/**
+ * @brief Remove a process from anywhere in the queue.
+ * 
+ * @param q Target queue
+ * @param p Process currently in q
+ */
+void pq_remove(pqueue *q, process *p) {
+    size_t i = p->heap_index;
+    assert(i < q->size && q->items[i] == p);
+
+    process *last = q->items[--q->size];
+    if (i == q->size) {
+        return;
+    }
+
+    /* Refill the hole with the last item and restore order either way */
+    pq_set(q, i, last);
+    if (i > 0 && pq_before(q, last, q->items[(i - 1) / 2])) {
+        pq_sift_up(q, i);
+    } else {
+        pq_sift_down(q, i);
+    }
+}
+
+/**
+ * @brief Remove all processes while keeping the allocated storage.
+ * 
+ * @param q Target queue
+ */
+void pq_clear(pqueue *q) {
+    q->size = 0;
+}
+
+/**
+ * @brief Deallocate memory used by the queue.
+ * 
+ * @param q Target queue
+ */
+void pq_free(pqueue *q) {
+    free(q->items);
+    pq_init(q, q->max_first);
+}
@@ -0,0 +1,86 @@
+#ifndef PQUEUE_H
+#define PQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct process process;
+
+/**
+ * Binary heap of processes ordered by their priority key. Each process
+ * records its position in the heap so that it can be removed without
+ * searching. A process can be in at most one queue at a time.
+ */
+typedef struct pqueue {
+    process **items;
+    size_t size;
+    size_t capacity;
+    bool max_first;
+} pqueue;
+
+/**
+ * @brief Initialise an empty queue.
+ * 
+ * @param q Target queue
+ * @param max_first Order highest priority keys first instead of lowest
+ */
+void pq_init(pqueue *q, bool max_first);
+
+/**
+ * @brief Make sure the queue can hold a number of processes without
+ * allocating.
+ * 
+ * @param q Target queue
+ * @param capacity Number of processes
+ * @return int 0 if successful. -1 otherwise
+ */
+int pq_reserve(pqueue *q, size_t capacity);
+
+/**
+ * @brief Add a process to the queue.
+ * 
+ * @param q Target queue
+ * @param p Process not currently in any queue
+ * @return int 0 if successful. -1 otherwise
+ */
+int pq_push(pqueue *q, process *p);
+
+/**
+ * @brief Get the first process without removing it.
+ * 
+ * @param q Target queue
+ * @return process* First process. NULL if queue is empty
+ */
+process *pq_peek(const pqueue *q);
+
+/**
+ * @brief Remove and return the first process.
+ * 
+ * @param q Target queue
+ * @return process* First process. NULL if queue is empty
+ */
+process *pq_pop(pqueue *q);
+
+/**
+ * @brief Remove a process from anywhere in the queue.
+ * 
+ * @param q Target queue
+ * @param p Process currently in q
+ */
+void pq_remove(pqueue *q, process *p);
+
+/**
+ * @brief Remove all processes while keeping the allocated storage.
+ * 
+ * @param q Target queue
+ */
+void pq_clear(pqueue *q);
+
+/**
+ * @brief Deallocate memory used by the queue.
+ * 
+ * @param q Target queue
+ */
+void pq_free(pqueue *q);
+
+#endif
@@ -0,0 +1,136 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "pressure.h"
+
+#define PSI_SIZE 256
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Read the 10 second average of one line of a pressure file.
+ * 
+ * @param fd Open /proc/pressure file
+ * @param line "some" or "full"
+ * @param value Destination in percent
+ * @return int 0 if successful. -1 otherwise
+ */
+static int read_psi(int fd, const char *line, double *value) {
+    char text[PSI_SIZE];
+    ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    text[n] = '\0';
+
+    char *avg = strstr(text, line);
+    if (avg == NULL || (avg = strstr(avg, "avg10=")) == NULL) {
+        return -1;
+    }
+    *value = strtod(avg + strlen("avg10="), NULL);
+    return 0;
+}
+
+/**
+ * @brief Estimate CPU pressure from the 1 minute load average.
+ * 
+ * Load above the number of CPUs means runnable tasks are waiting, so the
+ * excess is taken as the share of time they were stalled.
+ * 
+ * @param ps Open sources
+ * @param value Destination in percent
+ * @return int 0 if successful. -1 otherwise
+ */
+static int read_loadavg(const pressure *ps, double *value) {
+    char text[PSI_SIZE];
+    ssize_t n = pread(ps->loadavg_fd, text, sizeof(text) - 1, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    text[n] = '\0';
+
+    double cpus = (double)ps->cpu_count;
+    double excess = (strtod(text, NULL) - cpus) / cpus * 100.0;
+    *value = excess < 0.0 ? 0.0 : excess > 100.0 ? 100.0 : excess;
+    return 0;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Open the pressure sources of the host.
+ * 
+ * @param ps Target sources
+ * @return int 0 if successful. -1 if neither pressure stall information nor
+ * the load average can be read
+ */
+int pressure_init(pressure *ps) {
+    ps->cpu_fd = open("/proc/pressure/cpu", O_RDONLY | O_CLOEXEC);
+    ps->memory_fd = open("/proc/pressure/memory", O_RDONLY | O_CLOEXEC);
+    ps->io_fd = open("/proc/pressure/io", O_RDONLY | O_CLOEXEC);
+    ps->loadavg_fd = -1;
+    ps->cpu_count = affinity_cpu_count();
+
+    if (ps->cpu_fd >= 0 && ps->memory_fd >= 0 && ps->io_fd >= 0) {
+        return 0;
+    }
+
+    /* Kernels without PSI, or with it disabled, still have the load */
+    pressure_free(ps);
+    ps->loadavg_fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    return ps->loadavg_fd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Read the current pressure of the host.
+ * 
+ * CPU and memory use the share of time some task was stalled. I/O uses the
+ * share of time every task was, since a single job waiting on I/O is normal.
+ * 
+ * @param ps Open sources
+ * @param level Destination
+ * @return int 0 if successful. -1 otherwise
+ */
+int pressure_read(const pressure *ps, pressure_level *level) {
+    level->cpu = 0.0;
+    level->memory = 0.0;
+    level->io = 0.0;
+
+    if (ps->loadavg_fd >= 0) {
+        return read_loadavg(ps, &level->cpu);
+    }
+
+    if (read_psi(ps->cpu_fd, "some", &level->cpu) < 0
+        || read_psi(ps->memory_fd, "some", &level->memory) < 0
+        || read_psi(ps->io_fd, "full", &level->io) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Close the pressure sources.
+ * 
+ * @param ps Target sources
+ */
+void pressure_free(pressure *ps) {
+    int *fds[] = { &ps->cpu_fd, &ps->memory_fd, &ps->io_fd, &ps->loadavg_fd };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
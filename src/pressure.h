@@ -0,0 +1,56 @@
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <stddef.h>
+
+/**
+ * Open sources of host pressure. Pressure stall information is used when the
+ * kernel provides it, otherwise CPU pressure is estimated from the load
+ * average and memory and I/O pressure are unknown.
+ */
+typedef struct pressure {
+    int cpu_fd;
+    int memory_fd;
+    int io_fd;
+    int loadavg_fd;
+    size_t cpu_count;
+} pressure;
+
+/**
+ * Percent of the last 10 seconds the host was stalled on each resource.
+ */
+typedef struct pressure_level {
+    double cpu;
+    double memory;
+    double io;
+} pressure_level;
+
+/**
+ * @brief Open the pressure sources of the host.
+ * 
+ * @param ps Target sources
+ * @return int 0 if successful. -1 if neither pressure stall information nor
+ * the load average can be read
+ */
+int pressure_init(pressure *ps);
+
+/**
+ * @brief Read the current pressure of the host.
+ * 
+ * CPU and memory use the share of time some task was stalled. I/O uses the
+ * share of time every task was, since a single job waiting on I/O is normal.
+ * 
+ * @param ps Open sources
+ * @param level Destination
+ * @return int 0 if successful. -1 otherwise
+ */
+int pressure_read(const pressure *ps, pressure_level *level);
+
+/**
+ * @brief Close the pressure sources.
+ * 
+ * @param ps Target sources
+ */
+void pressure_free(pressure *ps);
+
+#endif
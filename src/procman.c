@@ -1,23 +1,83 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <signal.h>
+#include <poll.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
 
 #include "procman.h"
-#include "argparse.h"
+#include "spawn.h"
+#include "spawner.h"
+#include "zygote.h"
 
 #define error(msg) do { perror("[error] " msg); } while (0);
 
-#define USAGE "COMMANDS:\n"                     \
-              "    run [program] [arguments]\n" \
-              "    stop [PID]\n"                \
-              "    kill [PID]\n"                \
-              "    resume [PID]\n"              \
-              "    list\n"                      \
-              "    exit\n"
+#define MAX_EVENTS 64
+
+/* Handles always have a generation of at least 1, so 0 is free to mark the
+ * fork-server socket or the spawner threads in the event set
+ */
+#define LAUNCH_EVENT 0
+
+/* Marks the set of job output pipes, nested in the event set like pidfds */
+#define OUTPUT_EVENT 1
+
+/* Marks the set of job cgroups waiting to be removed, nested the same way */
+#define CGROUP_EVENT 2
+
+/* Output moved from one job per wakeup, so a chatty job cannot hold up the
+ * event loop. A whole pipe at its default size
+ */
+#define OUTPUT_BATCH_SIZE (64 * 1024)
+
+/* Batches still drained from a job that exited, a pipe's worth is left at
+ * most unless something outside its process group keeps writing
+ */
+#define OUTPUT_DRAIN_BATCHES 4
+
+/* Time jobs get at exit to write their last output before their pipes close */
+#define EXIT_GRACE_MS 200
+#define DEFAULT_HISTORY_CAPACITY 64
+#define DEFAULT_QUANTUM_MS 100
+#define DEFAULT_SAMPLE_INTERVAL_MS 1000
+
+/* A sweep of /proc may take at most 1/SAMPLE_COST_RATIO of the time between
+ * sweeps, so sampling costs under 1% of a core however many jobs there are
+ */
+#define SAMPLE_COST_RATIO 100
+
+/* Admission control reads host pressure this often, in line with the 10
+ * second averages it is based on
+ */
+#define PRESSURE_INTERVAL_MS 2000
+
+/* Percent of time stalled that takes running slots away (HIGH) or allows
+ * one more (LOW). Memory stalls halve the slots to stop thrashing quickly
+ */
+#define CPU_PRESSURE_HIGH 40.0
+#define CPU_PRESSURE_LOW 10.0
+#define MEMORY_PRESSURE_HIGH 10.0
+#define MEMORY_PRESSURE_LOW 1.0
+#define IO_PRESSURE_HIGH 20.0
+#define IO_PRESSURE_LOW 5.0
+
+/* How often a worker sharing slots checks whether it can take one or has to
+ * give one back
+ */
+#define BALANCE_INTERVAL_MS 50
+
+/* Hot fields of a process are kept in the process table's compact arrays */
+#define status_of(pm, p) ((pm)->table.statuses[(p)->id])
+#define pid_of(pm, p) ((pm)->table.pids[(p)->id])
 
 
 /******************************************************************************
@@ -25,489 +85,2240 @@
  ******************************************************************************/
 
 
-/**
- * @brief Search a chain of processes for specified pid.
- * 
- * @param processes Beginning of process chain
- * @param pid Target pid
- * @return process* The process with target pid. NULL if no processes found
- */
-static process *find_process(process *processes, pid_t pid) {
-    for (process *p = processes; p != NULL; p = p->next) {
-        /* Assuming there are never duplicated pid stored */
-        if (p->pid == pid) {
-            return p;
+/**
+ * @brief Get the name of a status as printed by list.
+ * 
+ * @param status Target status
+ * @return const char* Name of the status
+ */
+static const char *status_name(pstatus status) {
+    static const char *const names[] = {
+        [RUNNING] = "RUNNING",
+        [READY] = "READY",
+        [STOPPED] = "STOPPED",
+        [TERMINATED] = "TERMINATED",
+    };
+    return status < UNUSED ? names[status] : "UNUSED";
+}
+
+/**
+ * @brief Start managing a newly allocated process and index its pid.
+ * 
+ * A terminated process sharing the same recycled pid is shadowed in the index
+ * so that lookups always find the newest process. The process is given the
+ * next ticket, which orders it after every earlier process, and its priority
+ * under the scheduling policy.
+ *
+ * @param pm Target process manager
+ * @param p The process to track
+ */
+static void pm_track_process(procman *pm, process *p) {
+    if (pidmap_put(&pm->index, pid_of(pm, p), p) < 0) {
+        error("failed to index process");
+    }
+
+    p->ticket = pm->next_ticket++;
+    p->priority = pm->policy->priority(p, pm->next_sequence++);
+
+    /* Room for every process in the ready queue, so scheduling never
+     * allocates
+     */
+    if (pq_reserve(&pm->ready, pm->table.size) < 0) {
+        error("failed to grow ready queue");
+    }
+}
+
+/**
+ * @brief Return the record of a reaped process to the pool.
+ * 
+ * @param pm Target process manager
+ * @param p Reaped process
+ */
+static void pm_reclaim_process(procman *pm, process *p) {
+    /* The pid may already name a newer process */
+    if (pidmap_get(&pm->index, pid_of(pm, p)) == p) {
+        pidmap_remove(&pm->index, pid_of(pm, p));
+    }
+    pt_release(&pm->table, p);
+}
+
+/**
+ * @brief Subtract two timespecs into a timeval.
+ * 
+ * @param end Later time
+ * @param start Earlier time
+ * @return struct timeval end - start
+ */
+static struct timeval timespec_elapsed(const struct timespec *end,
+                                       const struct timespec *start) {
+    long long ns = (long long)(end->tv_sec - start->tv_sec) * 1000000000LL
+                 + (end->tv_nsec - start->tv_nsec);
+    struct timeval elapsed = {
+        .tv_sec = (time_t)(ns / 1000000000LL),
+        .tv_usec = (suseconds_t)(ns % 1000000000LL / 1000),
+    };
+    return elapsed;
+}
+
+/**
+ * @brief Subtract two timespecs into milliseconds.
+ * 
+ * @param end Later time
+ * @param start Earlier time
+ * @return long end - start in milliseconds
+ */
+static long timespec_elapsed_ms(const struct timespec *end,
+                                const struct timespec *start) {
+    return (long)(end->tv_sec - start->tv_sec) * 1000L
+         + (end->tv_nsec - start->tv_nsec) / 1000000L;
+}
+
+/**
+ * @brief Pick the earlier of two timeouts.
+ * 
+ * @param timeout Earliest timeout so far. -1 if there is none
+ * @param left Time left until another deadline, negative if it has passed
+ * @return long The earlier timeout, never below 0
+ */
+static long earliest_deadline(long timeout, long left) {
+    if (left < 0) {
+        left = 0;
+    }
+    return timeout < 0 || left < timeout ? left : timeout;
+}
+
+/**
+ * @brief Get how far CLOCK_BOOTTIME, which /proc start times are on, is
+ * ahead of CLOCK_MONOTONIC, which processes are timed with.
+ * 
+ * @return long long Nanoseconds the host has spent suspended
+ */
+static long long boot_clock_offset_ns(void) {
+    struct timespec monotonic;
+    struct timespec boot;
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    return (long long)(boot.tv_sec - monotonic.tv_sec) * 1000000000LL
+         + (boot.tv_nsec - monotonic.tv_nsec);
+}
+
+/**
+ * @brief Describe a process the way its admission is journaled.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ * @return journal_entry Admission of the process in its current state
+ */
+static journal_entry pm_journal_admission(const procman *pm,
+                                          const process *p) {
+    journal_entry e = {
+        .op = JOURNAL_ADMIT,
+        .pid = pid_of(pm, p),
+        .spawned_ns = p->spawned_ns,
+        .cgroup_id = p->cgroup.id,
+        .cgroup_owner = p->cgroup.fd >= 0 ? p->cgroup.owner : 0,
+        .stopped = status_of(pm, p) == STOPPED,
+        .killed = status_of(pm, p) == TERMINATED,
+    };
+    return e;
+}
+
+/**
+ * @brief Rewrite the journal with only the processes in the table.
+ * 
+ * @param pm Target process manager with an open journal
+ */
+static void pm_compact_journal(procman *pm) {
+    const ptable *t = &pm->table;
+    journal_entry *jobs = malloc((t->size > 0 ? t->size : 1)
+                                 * sizeof(journal_entry));
+    if (jobs == NULL) {
+        error("failed to compact journal");
+        return;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < t->capacity; ++i) {
+        if (t->pids[i] != 0) {
+            jobs[count++] = pm_journal_admission(pm, pt_get(t, (uint32_t)i));
+        }
+    }
+
+    if (journal_compact(&pm->journal, jobs, count) < 0) {
+        error("failed to compact journal");
+    }
+    free(jobs);
+}
+
+/**
+ * @brief Record a change to a process in the journal.
+ * 
+ * @param pm Process manager owning the process
+ * @param op Change to record
+ * @param p Target process
+ */
+static void pm_journal(procman *pm, journal_op op, const process *p) {
+    if (!journal_enabled(&pm->journal)) {
+        return;
+    }
+
+    /* Once most jobs are gone, dropping them is cheaper than growing */
+    if (journal_needs_compaction(&pm->journal)) {
+        pm_compact_journal(pm);
+    }
+
+    journal_entry e = { .op = op, .pid = pid_of(pm, p) };
+    if (op == JOURNAL_ADMIT) {
+        e = pm_journal_admission(pm, p);
+    }
+    if (journal_enabled(&pm->journal)
+        && journal_append(&pm->journal, &e) < 0) {
+        error("failed to write journal");
+    }
+}
+
+/**
+ * @brief Record the slots held from the pool in the journal.
+ * 
+ * @param pm Target process manager
+ */
+static void pm_save_slots(procman *pm) {
+    if (pm->pool == NULL || !journal_enabled(&pm->journal)) {
+        return;
+    }
+
+    journal_slots held = {
+        .lent = pm->slots_lent,
+        .borrowed = pm->slots_borrowed,
+        .wanted = pm->slots_wanted,
+    };
+    journal_save_slots(&pm->journal, &held);
+}
+
+/**
+ * @brief Move a reaped process into the terminated history.
+ * 
+ * Only active processes stay in the process table. The exit status and
+ * resource usage of the reaped process are kept in the bounded history ring
+ * and its record is reclaimed immediately.
+ * 
+ * @param pm Target process manager
+ * @param p Reaped process with status TERMINATED
+ * @param info Exit information from waitid()
+ * @param usage Resource usage from waitid()
+ */
+static void pm_retire_process(procman *pm, process *p, const siginfo_t *info,
+                              const struct rusage *usage) {
+    pm_journal(pm, JOURNAL_EXIT, p);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    job_record record = {
+        .pid = pid_of(pm, p),
+        .spawned_ns = p->spawned_ns,
+        .signaled = info->si_code != CLD_EXITED,
+        .code = info->si_status,
+        .wall_time = timespec_elapsed(&now, &p->spawned_at),
+        .user_time = usage->ru_utime,
+        .system_time = usage->ru_stime,
+        .max_rss = usage->ru_maxrss,
+    };
+    history_push(&pm->terminated, &record);
+
+    pm_reclaim_process(pm, p);
+}
+
+/**
+ * @brief Hand the reply of a completed command to the reply handler.
+ * 
+ * @param pm Target process manager
+ * @param id Id of the completed command
+ * @param r Reply of the command
+ */
+static void pm_complete(procman *pm, uint64_t id, const reply *r) {
+    if (pm->reply_handler != NULL) {
+        pm->reply_handler(pm->reply_context, id, r);
+    }
+}
+
+/**
+ * @brief Send a signal to every process of a live job.
+ * 
+ * Jobs run in their own process group, so the whole group is signaled and
+ * anything the job forked is stopped, continued and terminated along with
+ * it. The group id is the pid of the unreaped leader, which can't be
+ * recycled. If the group is gone the signal still reaches the leader
+ * through its pidfd.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ * @param sig Signal to send
+ */
+static void pm_signal_process(procman *pm, process *p, int sig) {
+    if (p->pidfd < 0) {
+        return;
+    }
+
+    if (killpg(pid_of(pm, p), sig) < 0
+        && pidfd_send_signal(p->pidfd, sig, NULL, 0) < 0 && errno != ESRCH) {
+        error("pidfd_send_signal() failed");
+    }
+
+    /* Remember what the process should look like to tell apart stops and
+     * continues caused by someone else
+     */
+    if (sig == SIGSTOP) {
+        p->suspended = true;
+    } else if (sig == SIGCONT) {
+        p->suspended = false;
+    }
+}
+
+/**
+ * @brief Keep a process off the CPU while it does not hold a slot.
+ * 
+ * Jobs with a cgroup are frozen as a whole, or only throttled when they are
+ * waiting for a slot and READY jobs are given a share of the CPU. Jobs
+ * without one are sent SIGSTOP.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ * @param waiting Whether the process is only waiting for a slot
+ */
+static void pm_suspend_process(procman *pm, process *p, bool waiting) {
+    if (p->cgroup.fd >= 0) {
+        if (p->frozen || (waiting && p->throttled)) {
+            return;
+        }
+        if (waiting && pm->ready_share > 0
+            && cg_throttle(&pm->cgroups, &p->cgroup, pm->ready_share) == 0) {
+            p->throttled = true;
+            /* Jobs held back at launch get their share like any other */
+            if (p->suspended) {
+                pm_signal_process(pm, p, SIGCONT);
+            }
+            return;
+        }
+        if (cg_freeze(&p->cgroup, true) == 0) {
+            p->frozen = true;
+            return;
+        }
+    }
+
+    pm_signal_process(pm, p, SIGSTOP);
+}
+
+/**
+ * @brief Thaw and uncap the cgroup of a process, leaving signal stops alone.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ */
+static void pm_lift_cgroup_limits(procman *pm, process *p) {
+    if (p->throttled) {
+        if (cg_throttle(&pm->cgroups, &p->cgroup, 100) < 0) {
+            error("failed to lift CPU cap");
+        }
+        p->throttled = false;
+    }
+    if (p->frozen) {
+        if (cg_freeze(&p->cgroup, false) < 0) {
+            error("failed to thaw cgroup");
+        }
+        p->frozen = false;
+    }
+}
+
+/**
+ * @brief Undo whatever kept a process off the CPU.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ */
+static void pm_continue_process(procman *pm, process *p) {
+    pm_lift_cgroup_limits(pm, p);
+    if (p->suspended) {
+        pm_signal_process(pm, p, SIGCONT);
+    }
+}
+
+/**
+ * @brief Move pending output of a job into its log.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ * @param batches Largest number of batches to move
+ */
+static void pm_spool_process_output(procman *pm, process *p, int batches) {
+    for (int i = 0; i < batches && joblog_is_open(&p->output); ++i) {
+        ssize_t n = joblog_spool(&pm->logs, &p->output, OUTPUT_BATCH_SIZE);
+        if (n < 0 && errno != EAGAIN) {
+            error("failed to spool job output");
+            joblog_close(&p->output);
+        }
+        if (n <= 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Move the output of a process into its log until it exits.
+ * 
+ * Output is spooled as it comes, so the process never blocks on a full pipe.
+ * What is left once it exits is spooled when it is released.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ * @param deadline Time to give up waiting at, on CLOCK_MONOTONIC
+ */
+static void pm_drain_process_output(procman *pm, process *p,
+                                    const struct timespec *deadline) {
+    struct pollfd fds[2] = {
+        { .fd = p->pidfd, .events = POLLIN },
+        { .events = POLLIN },
+    };
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long left;
+    while (p->pidfd >= 0 && joblog_is_open(&p->output)
+           && (left = timespec_elapsed_ms(deadline, &now)) > 0) {
+        fds[1].fd = p->output.pipe_fd;
+        if (poll(fds, 2, (int)left) <= 0 || fds[0].revents != 0) {
+            return;
+        }
+        pm_spool_process_output(pm, p, 1);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+}
+
+/**
+ * @brief Stop watching a process and release its pidfd, output and cgroup.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Target process
+ */
+static void pm_release_process(procman *pm, process *p) {
+    if (p->pidfd >= 0) {
+        /* Closing the last reference also removes it from the epoll set */
+        close(p->pidfd);
+        p->pidfd = -1;
+    }
+    pm_spool_process_output(pm, p, OUTPUT_DRAIN_BATCHES);
+    joblog_close(&p->output);
+    procstat_close(&p->probe);
+    cg_remove(&pm->cgroups, &p->cgroup);
+}
+
+
+/******************************************************************************
+ *                               COMMAND HANDLERS                             *
+ ******************************************************************************/
+
+
+/**
+ * @brief Prints all process status in sequence of the process table,
+ * followed by the history of terminated processes
+ * 
+ * @param pm Process manager with target process table
+ */
+static void pm_list_processes(procman *pm, reply *r) {
+    /* Active as pid,status,cpu,cpu%,rss,voluntary,involuntary from the
+     * latest sample
+     */
+    const ptable *t = &pm->table;
+    for (size_t i = 0; i < t->capacity; ++i) {
+        if (t->pids[i] != 0) {
+            const process *p = pt_get(t, (uint32_t)i);
+            const proc_usage *u = &p->usage;
+            reply_printf(r, "%d,%s,%lu.%03lu,%d,%ld,%lu,%lu\n",
+                         t->pids[i], status_name(t->statuses[i]),
+                         (unsigned long)(u->cpu_ms / 1000),
+                         (unsigned long)(u->cpu_ms % 1000),
+                         p->cpu_percent, u->rss_kb,
+                         (unsigned long)u->voluntary_switches,
+                         (unsigned long)u->involuntary_switches);
+        }
+    }
+
+    /* Recently terminated as pid,status,exit,wall,user,sys,maxrss where a
+     * negative exit is the killing signal
+     */
+    for (size_t i = 0; i < pm->terminated.count; ++i) {
+        const job_record *j = history_get(&pm->terminated, i);
+        reply_printf(r, "%d,%s,%d,%ld.%03ld,%ld.%03ld,%ld.%03ld,%ld\n",
+                     j->pid, status_name(TERMINATED),
+                     j->signaled ? -j->code : j->code,
+                     (long)j->wall_time.tv_sec, (long)j->wall_time.tv_usec / 1000,
+                     (long)j->user_time.tv_sec, (long)j->user_time.tv_usec / 1000,
+                     (long)j->system_time.tv_sec, (long)j->system_time.tv_usec / 1000,
+                     j->max_rss);
+    }
+}
+
+/**
+ * @brief Queue a process to be given a slot by the scheduler.
+ * 
+ * @param pm Target process manager
+ * @param p Target process with status READY
+ */
+static void pm_make_ready(procman *pm, process *p) {
+    assert(status_of(pm, p) == READY);
+    pq_push(&pm->ready, p);
+    pm->reschedule = true;
+}
+
+/**
+ * @brief Get the number of processes allowed to run at once.
+ * 
+ * @param pm Target process manager
+ * @return size_t Slots of the process manager's own share that are not lent
+ * out, plus slots borrowed from other workers
+ */
+static size_t pm_slot_limit(const procman *pm) {
+    size_t limit = pm->processes_running_limit;
+    size_t own = limit > pm->slots_lent ? limit - pm->slots_lent : 0;
+    return own + pm->slots_borrowed;
+}
+
+/**
+ * @brief Get one more slot from the workers sharing slots.
+ * 
+ * Slots lent out are taken back first. Slots of other workers are only
+ * borrowed once every own slot is in use.
+ * 
+ * @param pm Target process manager
+ * @return true The slot limit grew by one
+ * @return false No slot is available
+ */
+static bool pm_acquire_slot(procman *pm) {
+    if (pm->pool == NULL) {
+        return false;
+    }
+
+    if (pm->slots_lent > 0) {
+        if (!slot_pool_reclaim(pm->pool)) {
+            return false;
+        }
+        pm->slots_lent--;
+        pm_save_slots(pm);
+        return true;
+    }
+
+    if (pm->processes_running_count + 1 > pm->processes_running_max
+        || !slot_pool_borrow(pm->pool)) {
+        return false;
+    }
+    pm->slots_borrowed++;
+    pm_save_slots(pm);
+    return true;
+}
+
+/**
+ * @brief Give a free slot to a process and let it run.
+ * 
+ * The process is bound to the CPUs of the slot. In NUMA mode a slot on the
+ * node the process last ran on is preferred, so its memory stays local.
+ * 
+ * @param pm Target process manager
+ * @param p Target process with status READY, not in any queue
+ */
+static void pm_assign_slot(procman *pm, process *p) {
+    assert(pm->processes_running_count < pm->processes_running_max);
+
+    size_t free_count = pm->processes_running_max - pm->processes_running_count;
+    size_t pick = free_count - 1;
+
+    /* Go back to the node the process last ran on if it has a free slot */
+    if (pm->placement.mode == AFFINITY_NUMA && p->node >= 0) {
+        for (size_t i = 0; i < free_count; ++i) {
+            if (affinity_node(&pm->placement, pm->free_slots[i]) == p->node) {
+                pick = i;
+                break;
+            }
+        }
+    }
+
+    p->slot = pm->free_slots[pick];
+    pm->free_slots[pick] = pm->free_slots[free_count - 1];
+    p->node = affinity_node(&pm->placement, p->slot);
+    if (affinity_apply(&pm->placement, p->slot, pid_of(pm, p)) < 0
+        && errno != ESRCH) {
+        error("sched_setaffinity() failed");
+    }
+
+    pm->processes_running[p->slot] = p;
+    pm->processes_running_count += 1;
+    pq_push(&pm->running, p);
+
+    status_of(pm, p) = RUNNING;
+    if (pm->policy->quantum != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &p->dispatched_at);
+    }
+    pm_continue_process(pm, p);
+}
+
+/**
+ * @brief Remove a process from whichever scheduling queue it is in.
+ * 
+ * Running processes give up their slot and ready processes leave the ready
+ * queue. The caller is responsible for updating the status.
+ * 
+ * @param pm Process manager with target list
+ * @param p Target process. No-op for STOPPED and TERMINATED states
+ */
+static void pm_unschedule_process(procman *pm, process *p) {
+    if (status_of(pm, p) == READY) {
+        pq_remove(&pm->ready, p);
+
+    } else if (status_of(pm, p) == RUNNING) {
+        /* Time spent running counts towards the quantum across preemptions */
+        if (pm->policy->quantum != NULL) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            p->used_ms += timespec_elapsed_ms(&now, &p->dispatched_at);
+        }
+
+        pq_remove(&pm->running, p);
+        pm->processes_running[p->slot] = NULL;
+        pm->processes_running_count -= 1;
+
+        size_t free_count = pm->processes_running_max - pm->processes_running_count;
+        pm->free_slots[free_count - 1] = p->slot;
+        pm->reschedule = true;
+    }
+}
+
+/**
+ * @brief Stop a process and removes it from running list if it is running.
+ * 
+ * @param pm Process manager with target list
+ * @param p Target process. No-op if status is TERMINATED or STOPPED
+ */
+static void pm_stop_process(procman *pm, process *p) {
+    if (status_of(pm, p) == TERMINATED || status_of(pm, p) == STOPPED) {
+        return;
+    }
+    
+    pm_unschedule_process(pm, p);
+    pm_suspend_process(pm, p, false);
+    status_of(pm, p) = STOPPED;
+    pm_journal(pm, JOURNAL_STOP, p);
+}
+
+/**
+ * @brief Terminate a process and removes it from running list if it is running.
+ * 
+ * @param pm Process manager with target list
+ * @param p Target process. No-op if status is TERMINATED
+ */
+static void pm_terminate_process(procman *pm, process *p) {
+    if (status_of(pm, p) == TERMINATED) {
+        return;
+    }
+    
+    pm_unschedule_process(pm, p);
+    pm_signal_process(pm, p, SIGTERM);
+    /* Suspended processes only act on SIGTERM once thawed and continued */
+    pm_continue_process(pm, p);
+    status_of(pm, p) = TERMINATED;
+    pm_journal(pm, JOURNAL_KILL, p);
+}
+
+/**
+ * @brief Resume a stopped process.
+ *
+ * @param pm Process manager to queue the process in
+ * @param p Target process that must have status STOPPED
+ *
+ * @note Unlike other command handlers, only process management state is
+ * updated. No signals are sent to the underlying process
+ */
+static void pm_resume_process(procman *pm, process *p) {
+    assert(status_of(pm, p) == STOPPED);
+    status_of(pm, p) = READY;
+    pm_journal(pm, JOURNAL_RESUME, p);
+    pm_make_ready(pm, p);
+    /* Don't send SIGCONT and let the rescheduler decide whether the process
+     * should run.
+     */
+}
+
+/**
+ * @brief Watch for the exit of a new process.
+ * 
+ * @param pm Target process manager
+ * @param p New process
+ */
+static void pm_watch_process(procman *pm, process *p) {
+    /* Pidfd becomes readable once the process exits */
+    struct epoll_event ev = {
+        .events = EPOLLIN, .data.u64 = pt_handle(&pm->table, p)
+    };
+    if (epoll_ctl(pm->event_fd, EPOLL_CTL_ADD, p->pidfd, &ev) < 0) {
+        error("epoll_ctl() failed");
+    }
+}
+
+/**
+ * @brief Check whether a new process may run right away.
+ * 
+ * The newest process can only take a slot nobody else is waiting for. A slot
+ * taken from other workers for it stays in the slot limit even if the process
+ * never comes.
+ * 
+ * @param pm Target process manager
+ * @return true A slot is free for the new process
+ */
+static bool pm_claim_slot(procman *pm) {
+    return pq_peek(&pm->ready) == NULL
+        && (pm->processes_running_count < pm_slot_limit(pm)
+            || pm_acquire_slot(pm));
+}
+
+/**
+ * @brief Let a new process run, or suspend and queue it.
+ * 
+ * @param pm Target process manager
+ * @param p New process with status READY, not in any queue
+ * @param has_slot Whether a slot was claimed for the process
+ */
+static void pm_start_process(procman *pm, process *p, bool has_slot) {
+    if (has_slot) {
+        pm_assign_slot(pm, p);
+    } else {
+        pm_suspend_process(pm, p, true);
+        pm_make_ready(pm, p);
+    }
+}
+
+/**
+ * @brief Spool the output of a new job into its log file.
+ * 
+ * A job whose log file could not be created only keeps the tail of its
+ * output rather than writing to the terminal.
+ * 
+ * @param pm Target process manager
+ * @param p New process
+ * @param output_fd Read end of the job's output pipe. -1 if not captured
+ */
+static void pm_capture_output(procman *pm, process *p, int output_fd) {
+    joblog_init(&p->output);
+    if (output_fd < 0) {
+        return;
+    }
+
+    if (joblog_open(&pm->logs, &p->output, output_fd, pid_of(pm, p),
+                    p->spawned_ns) < 0) {
+        error("failed to create job log");
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN, .data.u64 = pt_handle(&pm->table, p)
+    };
+    if (epoll_ctl(pm->output_fd, EPOLL_CTL_ADD, output_fd, &ev) < 0) {
+        error("epoll_ctl() failed");
+    }
+}
+
+/**
+ * @brief Start managing a freshly launched child.
+ * 
+ * The child runs immediately if a slot is free and nothing is waiting for
+ * one, otherwise it is suspended and queued into the process manager in a
+ * READY state to be run according to the scheduler. A child launched before
+ * its slot was known waits for SIGCONT before executing the program and is
+ * only continued once it gets a slot.
+ * 
+ * @param pm Target process manager
+ * @param pid Pid of the running child
+ * @param pidfd Pidfd of the child, owned by the process manager from now on
+ * @param cgroup Cgroup of the child, owned by the process manager from now on.
+ * NULL if it has none
+ * @param output_fd Read end of the child's output pipe, owned by the process
+ * manager from now on. -1 if its output is not captured
+ * @param suspended Whether the child waits for SIGCONT before executing the
+ * program. Otherwise it runs in a slot claimed before it was launched
+ */
+static void pm_admit_process(procman *pm, pid_t pid, int pidfd,
+                             cgroup_job *cgroup, int output_fd,
+                             bool suspended) {
+    cgroup_job none = { .fd = -1, .id = 0 };
+    if (cgroup == NULL) {
+        cgroup = &none;
+    }
+
+    process *p = pt_alloc(&pm->table, pid);
+    if (p == NULL) {
+        error("failed to allocate process");
+        siginfo_t info;
+        pidfd_send_signal(pidfd, SIGKILL, NULL, 0);
+        waitid(P_PIDFD, (id_t)pidfd, &info, WEXITED);
+        close(pidfd);
+        cg_remove(&pm->cgroups, cgroup);
+        if (output_fd >= 0) {
+            close(output_fd);
+        }
+        return;
+    }
+    p->pidfd = pidfd;
+    p->cgroup = *cgroup;
+    p->suspended = suspended;
+    procstat_init(&p->probe);
+    clock_gettime(CLOCK_MONOTONIC, &p->spawned_at);
+    p->spawned_ns = (uint64_t)((long long)p->spawned_at.tv_sec * 1000000000LL
+                               + p->spawned_at.tv_nsec
+                               + boot_clock_offset_ns());
+    pm_capture_output(pm, p, output_fd);
+    p->node = -1;
+    status_of(pm, p) = READY;
+    pm_track_process(pm, p);
+    pm_journal(pm, JOURNAL_ADMIT, p);
+    pm_watch_process(pm, p);
+    pm_start_process(pm, p, !suspended || pm_claim_slot(pm));
+}
+
+/**
+ * @brief Take over a job journaled by a worker that died.
+ * 
+ * The pid still names the job only if the process under it started before
+ * the job was admitted, since a process reusing the pid starts after the
+ * job exits. Whatever state the job was left in, it is stopped, thawed and
+ * uncapped, then kept stopped, queued or continued like a new one. A job
+ * that was killed is only thawed and watched until it exits.
+ * 
+ * @param pm Target process manager
+ * @param e Admission of the job with its latest stopped and killed state
+ */
+static void pm_adopt_process(procman *pm, const journal_entry *e) {
+    /* Jobs that exited while no worker watched them are gone for good */
+    int pidfd = pidfd_open(e->pid, 0);
+    if (pidfd < 0) {
+        return;
+    }
+
+    procstat probe;
+    uint64_t started_ns;
+    procstat_init(&probe);
+    if (procstat_open(&probe, e->pid) < 0
+        || procstat_start_time(&probe, &started_ns) < 0
+        || started_ns > e->spawned_ns) {
+        procstat_close(&probe);
+        close(pidfd);
+        return;
+    }
+
+    cgroup_job cgroup = { .fd = -1, .id = 0 };
+    if (e->cgroup_owner != 0 && cg_enabled(&pm->cgroups)
+        && cg_adopt(&pm->cgroups, e->cgroup_owner, e->cgroup_id,
+                    &cgroup) < 0) {
+        error("failed to reopen job cgroup");
+    }
+
+    process *p = pt_alloc(&pm->table, e->pid);
+    if (p == NULL) {
+        error("failed to allocate process");
+        procstat_close(&probe);
+        close(pidfd);
+        if (cgroup.fd >= 0) {
+            close(cgroup.fd);
+        }
+        return;
+    }
+    p->pidfd = pidfd;
+    p->cgroup = cgroup;
+    p->probe = probe;
+    procstat_read(&p->probe, &p->usage);
+    joblog_init(&p->output);
+    p->node = -1;
+    p->adopted = true;
+
+    p->spawned_ns = e->spawned_ns;
+    long long spawned_ns = (long long)e->spawned_ns - boot_clock_offset_ns();
+    if (spawned_ns < 0) {
+        spawned_ns = 0;
+    }
+    p->spawned_at.tv_sec = (time_t)(spawned_ns / 1000000000LL);
+    p->spawned_at.tv_nsec = (long)(spawned_ns % 1000000000LL);
+
+    /* A killed job only has to be seen exiting. Any other job is stopped
+     * while its cgroup is thawed and uncapped, so it only runs again once it
+     * holds a slot
+     */
+    if (!e->killed) {
+        pm_signal_process(pm, p, SIGSTOP);
+    }
+    p->frozen = cgroup.fd >= 0;
+    p->throttled = cgroup.fd >= 0 && pm->cgroups.has_cpu;
+    pm_lift_cgroup_limits(pm, p);
+
+    status_of(pm, p) = e->killed ? TERMINATED : e->stopped ? STOPPED : READY;
+    pm_track_process(pm, p);
+    pm_watch_process(pm, p);
+    if (e->killed) {
+        pm_signal_process(pm, p, SIGCONT);
+    } else if (e->stopped) {
+        pm_suspend_process(pm, p, false);
+    } else {
+        pm_start_process(pm, p, pm_claim_slot(pm));
+    }
+}
+
+/**
+ * @brief Take over every job still alive from the journal.
+ * 
+ * The journal is then rewritten with only the jobs taken over.
+ * 
+ * @param pm Target process manager with an open journal
+ */
+static void pm_recover_processes(procman *pm) {
+    journal_entry *jobs;
+    ssize_t count = journal_replay(&pm->journal, &jobs);
+    if (count < 0) {
+        error("failed to read journal");
+        return;
+    }
+
+    for (ssize_t i = 0; i < count; ++i) {
+        pm_adopt_process(pm, &jobs[i]);
+    }
+    free(jobs);
+    pm_compact_journal(pm);
+}
+
+/**
+ * @brief Find a job array with launches in flight.
+ * 
+ * @param pm Target process manager
+ * @param id Id of the run command that launched the array
+ * @return job_array* Pending array. NULL if not found
+ */
+static job_array *pm_find_array(procman *pm, uint64_t id) {
+    /* Only a handful of arrays are ever in flight at once */
+    for (size_t i = 0; i < pm->array_count; ++i) {
+        if (pm->arrays[i].id == id) {
+            return &pm->arrays[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Start waiting for the launches of a job array.
+ * 
+ * @param pm Target process manager
+ * @param id Id of the run command
+ * @param count Number of jobs in the array
+ * @return int 0 if successful. -1 otherwise
+ */
+static int pm_add_array(procman *pm, uint64_t id, uint32_t count) {
+    if (pm->array_count == pm->array_capacity) {
+        size_t capacity = pm->array_capacity ? pm->array_capacity * 2 : 4;
+        job_array *arrays = realloc(pm->arrays, capacity * sizeof(job_array));
+        if (arrays == NULL) {
+            return -1;
+        }
+        pm->arrays = arrays;
+        pm->array_capacity = capacity;
+    }
+
+    job_array *array = &pm->arrays[pm->array_count++];
+    array->id = id;
+    array->remaining = count;
+    reply_init(&array->r);
+    return 0;
+}
+
+/**
+ * @brief Complete the run command of a job array once every launch is done.
+ * 
+ * @param pm Target process manager
+ * @param array Array without launches left, invalidated by this call
+ */
+static void pm_finish_array(procman *pm, job_array *array) {
+    pm_complete(pm, array->id, &array->r);
+    reply_free(&array->r);
+    *array = pm->arrays[--pm->array_count];
+}
+
+/**
+ * @brief Create the cgroup a new job moves itself into.
+ * 
+ * A job whose cgroup could not be created still runs and is managed with
+ * signals only.
+ * 
+ * @param pm Target process manager
+ * @param cgroup Destination of the job's cgroup. Its fd is -1 if it has none
+ * @return int Writable cgroup.procs of the cgroup. -1 if it has none
+ */
+static int pm_prepare_cgroup(procman *pm, cgroup_job *cgroup) {
+    int procs_fd = -1;
+    cgroup->fd = -1;
+    cgroup->id = 0;
+    if (cg_enabled(&pm->cgroups)
+        && (cg_create(&pm->cgroups, cgroup) < 0
+            || (procs_fd = cg_procs_fd(cgroup)) < 0)) {
+        error("failed to create cgroup");
+        cg_remove(&pm->cgroups, cgroup);
+    }
+    return procs_fd;
+}
+
+/**
+ * @brief Spawn a child directly, inside a cgroup of its own when a cgroup
+ * tree is in use.
+ * 
+ * @param pm Target process manager
+ * @param argv Program and its arguments. Last item must be NULL
+ * @param pidfd Destination of a pidfd referring to the child
+ * @param cgroup Destination of the child's cgroup. Its fd is -1 if it has none
+ * @param output_fd Destination of the read end of the child's output pipe.
+ * -1 if its output is not captured
+ * @param suspended Hold the child back before it executes the program
+ * @return pid_t Pid of the running or waiting child. -1 with errno set on
+ * failure
+ */
+static pid_t pm_launch(procman *pm, char *const argv[], int *pidfd,
+                       cgroup_job *cgroup, int *output_fd, bool suspended) {
+    int procs_fd = pm_prepare_cgroup(pm, cgroup);
+
+    /* Only the child keeps the write end once it has been launched */
+    int output[2] = { -1, -1 };
+    if (joblog_dir_enabled(&pm->logs) && pipe2(output, O_CLOEXEC) < 0) {
+        error("failed to create output pipe");
+        output[0] = output[1] = -1;
+    }
+
+    pid_t pid = spawn_process(argv, pidfd, procs_fd, output[1], suspended);
+    int saved = errno;
+    if (procs_fd >= 0) {
+        close(procs_fd);
+    }
+    if (output[1] >= 0) {
+        close(output[1]);
+    }
+    if (pid < 0) {
+        cg_remove(&pm->cgroups, cgroup);
+        if (output[0] >= 0) {
+            close(output[0]);
+            output[0] = -1;
+        }
+    }
+    *output_fd = output[0];
+    errno = saved;
+    return pid;
+}
+
+/**
+ * @brief Check whether launches complete after the run command returns.
+ * 
+ * @param pm Target process manager
+ * @return true Launches go through a fork-server or spawner threads
+ * @return false Launches are done directly
+ */
+static bool pm_launches_async(const procman *pm) {
+    return pm->zygote != NULL || pm->spawner != NULL;
+}
+
+/**
+ * @brief Count launches requested but not admitted yet.
+ * 
+ * @param pm Target process manager
+ * @return size_t Number of launches in flight
+ */
+static size_t pm_launches_in_flight(const procman *pm) {
+    if (pm->zygote != NULL) {
+        return pm->zygote->in_flight;
+    }
+    return pm->spawner != NULL ? pm->spawner->in_flight : 0;
+}
+
+/**
+ * @brief Account for a launch that completed asynchronously in the reply of
+ * the run command that requested it, admitting the child if there is one.
+ * 
+ * @param pm Target process manager
+ * @param tag Id of the run command
+ * @param pid Pid of the launched child
+ * @param pidfd pidfd referring to the child
+ * @param cgroup Cgroup of the child. Its fd is -1 if it has none
+ * @param output_fd Read end of the child's output pipe. -1 if not captured
+ * @param launch_error errno value of a failed launch. 0 on success
+ * @param program Program that was launched
+ */
+static void pm_finish_launch(procman *pm, uint64_t tag, pid_t pid, int pidfd,
+                             cgroup_job *cgroup, int output_fd,
+                             int launch_error, const char *program) {
+    /* Jobs of an array add up into the reply of the whole array */
+    job_array *array = pm_find_array(pm, tag);
+    reply *r = array != NULL ? &array->r : &pm->launch_reply;
+    if (array == NULL) {
+        reply_reset(r);
+    }
+
+    if (launch_error == 0) {
+        pm_admit_process(pm, pid, pidfd, cgroup, output_fd, true);
+        r->value = array != NULL ? r->value + 1 : pid;
+    } else {
+        reply_error(r, "error running %s: %s\n", program,
+                    strerror(launch_error));
+    }
+
+    /* The run command that requested the launch completes now */
+    if (array == NULL) {
+        pm_complete(pm, tag, r);
+    } else if (--array->remaining == 0) {
+        pm_finish_array(pm, array);
+    }
+}
+
+/**
+ * @brief Admit every launch the fork-server or the spawner threads have
+ * finished.
+ * 
+ * @param pm Target process manager launching asynchronously
+ * @param block Wait for at least one launch to finish
+ */
+static void pm_collect_launches(procman *pm, bool block) {
+    int received;
+
+    if (pm->spawner != NULL) {
+        spawner_reply spawn;
+        while ((received = spawner_receive(pm->spawner, &spawn, block)) > 0) {
+            block = false;
+            if (spawn.error != 0) {
+                cg_remove(&pm->cgroups, &spawn.cgroup);
+            }
+            pm_finish_launch(pm, spawn.tag, spawn.pid, spawn.pidfd,
+                             &spawn.cgroup, spawn.output_fd, spawn.error,
+                             spawn.argv[0]);
+            free(spawn.argv);
+        }
+
+        if (received < 0) {
+            error("failed to receive from spawner threads");
+        }
+        return;
+    }
+
+    zygote_reply launch;
+    while ((received = zygote_receive(pm->zygote, &launch, block)) > 0) {
+        block = false;
+
+        /* The child is moved while it waits, before it runs anything */
+        cgroup_job cgroup = { .fd = -1, .id = 0 };
+        if (launch.error == 0 && cg_enabled(&pm->cgroups)
+            && (cg_create(&pm->cgroups, &cgroup) < 0
+                || cg_attach(&cgroup, launch.pid) < 0)) {
+            error("failed to move job into its cgroup");
+            cg_remove(&pm->cgroups, &cgroup);
+        }
+
+        /* The child that failed to exec is ours to reap */
+        if (launch.error != 0 && launch.pidfd >= 0) {
+            siginfo_t info;
+            waitid(P_PIDFD, (id_t)launch.pidfd, &info, WEXITED);
+            close(launch.pidfd);
+        }
+
+        pm_finish_launch(pm, launch.tag, launch.pid, launch.pidfd, &cgroup,
+                         launch.output_fd, launch.error, launch.program);
+        free(launch.program);
+    }
+
+    if (received < 0) {
+        error("failed to receive from fork-server");
+    }
+}
+
+/**
+ * @brief Hand a launch to the fork-server or the spawner threads.
+ * 
+ * Spawner threads get the job's cgroup ready made, so the child enters it
+ * before executing the program.
+ * 
+ * @param pm Target process manager launching asynchronously
+ * @param argv Program and its arguments. Last item must be NULL
+ * @param id Id of the run command
+ * @return int 0 if the launch was requested. -1 with errno set otherwise
+ */
+static int pm_request_launch(procman *pm, char *const argv[], uint64_t id) {
+    if (pm->zygote != NULL) {
+        /* Bound launches in flight so neither side blocks on a full socket */
+        if (pm->zygote->in_flight == ZYGOTE_MAX_IN_FLIGHT) {
+            pm_collect_launches(pm, true);
+        }
+        return zygote_request(pm->zygote, argv,
+                              joblog_dir_enabled(&pm->logs), id);
+    }
+
+    cgroup_job cgroup;
+    int procs_fd = pm_prepare_cgroup(pm, &cgroup);
+    if (spawner_request(pm->spawner, argv, procs_fd,
+                        joblog_dir_enabled(&pm->logs), &cgroup, id) < 0) {
+        int saved = errno;
+        if (procs_fd >= 0) {
+            close(procs_fd);
+        }
+        cg_remove(&pm->cgroups, &cgroup);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Spawn a child process that executes a given shell command.
+ * 
+ * A child with a free slot executes the program right away and exec failures
+ * are reported here. Any other child waits before executing it until it gets
+ * a slot, and only reports an exec failure through its exit status. When a
+ * fork-server or spawner threads are used the launch completes
+ * asynchronously and the child is always admitted waiting.
+ * 
+ * @param pm Target process manager
+ * @param argv Array of strings representing tokens of the command. Last token
+ * must be NULL to indicate the end of the array
+ * @param id Id of the run command
+ * @param r Reply receiving the new pid or an error
+ * @return true The reply is complete
+ * @return false The reply is sent once the launch has completed
+ */
+static bool pm_spawn_process(procman *pm, char *const argv[], uint64_t id,
+                             reply *r) {
+    if (pm_launches_async(pm)) {
+        if (pm_request_launch(pm, argv, id) < 0) {
+            reply_error(r, "error running %s: %s\n", argv[0], strerror(errno));
+            return true;
+        }
+        return false;
+    }
+
+    int pidfd = -1;
+    int output_fd = -1;
+    cgroup_job cgroup;
+    bool suspended = !pm_claim_slot(pm);
+    pid_t child_pid = pm_launch(pm, argv, &pidfd, &cgroup, &output_fd,
+                                suspended);
+    if (child_pid < 0) {
+        reply_error(r, "error running %s: %s\n", argv[0], strerror(errno));
+        return true;
+    }
+
+    pm_admit_process(pm, child_pid, pidfd, &cgroup, output_fd, suspended);
+    r->value = child_pid;
+    return true;
+}
+
+/**
+ * @brief Launch every job of a job array.
+ * 
+ * Each job gets the arguments of the command with its index substituted,
+ * counting from the value of the command.
+ * The reply value is the number of jobs launched and the text lists the ones
+ * that failed.
+ * 
+ * @param pm Target process manager
+ * @param c Run command with a count
+ * @param id Id of the run command
+ * @param r Reply of the command
+ * @return true The reply is complete
+ * @return false The reply is sent once every launch has completed
+ */
+static bool pm_spawn_array(procman *pm, const command *c, uint64_t id,
+                           reply *r) {
+    bool async = pm_launches_async(pm);
+    if (async && pm_add_array(pm, id, c->count) < 0) {
+        reply_error(r, "error running %s: %s\n", c->argv[0], strerror(errno));
+        return true;
+    }
+
+    for (uint32_t i = 0; i < c->count; ++i) {
+        uint32_t index = (uint32_t)c->value + i;
+        char *const *argv = job_argv_expand(&pm->array_argv, c, index);
+        if (argv != NULL && async && pm_request_launch(pm, argv, id) == 0) {
+            continue;
+        }
+
+        /* Collecting launches may have moved the array */
+        job_array *array = async ? pm_find_array(pm, id) : NULL;
+        reply *target = array != NULL ? &array->r : r;
+        int pidfd = -1;
+        int output_fd = -1;
+        cgroup_job cgroup;
+        pid_t child_pid = -1;
+        bool suspended = true;
+        if (argv != NULL && array == NULL) {
+            suspended = !pm_claim_slot(pm);
+            child_pid = pm_launch(pm, argv, &pidfd, &cgroup, &output_fd,
+                                  suspended);
+        }
+
+        if (child_pid < 0) {
+            reply_error(target, "error running %s: %s\n",
+                        argv != NULL ? argv[0] : c->argv[0], strerror(errno));
+        } else {
+            pm_admit_process(pm, child_pid, pidfd, &cgroup, output_fd,
+                             suspended);
+            target->value++;
+        }
+
+        if (array != NULL && --array->remaining == 0) {
+            pm_finish_array(pm, array);
+        }
+    }
+
+    return !async;
+}
+
+/**
+ * @brief Terminate all managed processes and remove their handle.
+ * 
+ * @param pm Target process manager
+ */
+static void pm_clear_processes(procman *pm) {
+    /* Launches in flight still produce children that must be terminated */
+    while (pm_launches_in_flight(pm) > 0) {
+        pm_collect_launches(pm, true);
+    }
+
+    /* Scan the process table to terminate each process */
+    ptable *t = &pm->table;
+    for (size_t i = 0; i < t->capacity; ++i) {
+        if (t->pids[i] != 0 && t->statuses[i] != TERMINATED) {
+            process *p = pt_get(t, (uint32_t)i);
+            pm_signal_process(pm, p, SIGTERM);
+            pm_continue_process(pm, p);
+        }
+    }
+
+    /* Closing the pipes right away would drop the last output of the jobs
+     * and kill those still writing with SIGPIPE
+     */
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += EXIT_GRACE_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    for (size_t i = 0; i < t->capacity; ++i) {
+        if (t->pids[i] != 0) {
+            process *p = pt_get(t, (uint32_t)i);
+            pm_drain_process_output(pm, p, &deadline);
+            pm_release_process(pm, p);
+        }
+    }
+    pt_clear(t);
+    
+    for (size_t i = 0; i < pm->processes_running_max; ++i) {
+        pm->processes_running[i] = NULL;
+        pm->free_slots[i] = i;
+    }
+    
+    history_clear(&pm->terminated);
+    pm->processes_running_count = 0;
+    pq_clear(&pm->ready);
+    pq_clear(&pm->running);
+    pidmap_clear(&pm->index);
+}
+
+
+/******************************************************************************
+ *                              COMMAND DISPATCHER                            *
+ ******************************************************************************/
+
+
+/**
+ * @brief Report a pid missing from the process table.
+ * 
+ * @param pm Target process manager
+ * @param pid Pid that was not found
+ * @param r Reply to the command, with the pid as value if it was managed here
+ */
+static void report_unknown_pid(procman *pm, pid_t pid, reply *r) {
+    /* Reaped processes only remain in the history */
+    if (history_find(&pm->terminated, pid) != NULL) {
+        reply_error(r, "Already terminated (%d)\n", pid);
+        r->value = pid;
+    } else {
+        reply_error(r, "PID not found (%d)\n", pid);
+    }
+}
+
+/**
+ * @brief Print the latest output of a job.
+ * 
+ * Live jobs are served from the tail kept in memory, terminated ones from
+ * the end of their log file.
+ * 
+ * @param pm Process manager with target process table
+ * @param pid Pid of the job
+ * @param r Reply to the command, with the pid as value if it was managed here
+ */
+static void pm_show_logs(procman *pm, pid_t pid, reply *r) {
+    process *p = pidmap_get(&pm->index, pid);
+    const job_record *record = history_find(&pm->terminated, pid);
+    if (p == NULL && record == NULL) {
+        reply_error(r, "PID not found (%d)\n", pid);
+        return;
+    }
+    r->value = pid;
+
+    if (!joblog_dir_enabled(&pm->logs)) {
+        reply_error(r, "Output not captured (%d)\n", pid);
+        return;
+    }
+
+    /* Whatever is still in the pipe belongs to the tail too */
+    char tail[JOBLOG_TAIL_SIZE];
+    ssize_t length;
+    if (p != NULL) {
+        pm_spool_process_output(pm, p, 1);
+        length = (ssize_t)joblog_tail(&p->output, tail);
+    } else {
+        length = joblog_dir_read_tail(&pm->logs, pid, record->spawned_ns,
+                                      tail, sizeof(tail));
+    }
+
+    if (length < 0) {
+        reply_error(r, "No log for %d: %s\n", pid, strerror(errno));
+    } else {
+        reply_printf(r, "%.*s", (int)length, tail);
+    }
+}
+
+/**
+ * @brief Execute command handlers based on received commands.
+ * 
+ * Commands arrive already parsed and validated, so only their effect on
+ * the managed processes is checked here.
+ * 
+ * @param pm Target process manager to run command handlers on
+ * @param c Command to dispatch
+ * @param id Id of the command
+ * @param r Reply to fill with the result of the command
+ * @return true The reply is complete
+ * @return false The command completes later through the reply handler
+ */
+static bool dispatch(procman *pm, const command *c, uint64_t id, reply *r) {
+    process *p = NULL;
+    if (c->op == OP_STOP || c->op == OP_KILL || c->op == OP_RESUME) {
+        p = pidmap_get(&pm->index, c->pid);
+        if (p == NULL) {
+            report_unknown_pid(pm, c->pid, r);
+            return true;
+        }
+
+        /* Tells the shell this process manager is the one managing the pid */
+        r->value = c->pid;
+    }
+
+    switch (c->op) {
+    case OP_RUN:
+        if (c->count > 1) {
+            return pm_spawn_array(pm, c, id, r);
+        }
+        return pm_spawn_process(pm, c->argv, id, r);
+
+    case OP_STOP:
+        if (status_of(pm, p) == TERMINATED) {
+            reply_error(r, "Already terminated (%d)\n", c->pid);
+        } else if (status_of(pm, p) == STOPPED) {
+            reply_error(r, "Already stopped (%d)\n", c->pid);
+        } else {
+            pm_stop_process(pm, p);
+        }
+        break;
+
+    case OP_KILL:
+        if (status_of(pm, p) == TERMINATED) {
+            reply_error(r, "Already terminated (%d)\n", c->pid);
+        } else {
+            pm_terminate_process(pm, p);
+        }
+        break;
+
+    case OP_RESUME:
+        if (status_of(pm, p) == RUNNING) {
+            reply_error(r, "Already running (%d)\n", c->pid);
+        } else if (status_of(pm, p) == READY) {
+            reply_error(r, "Already ready (%d)\n", c->pid);
+        } else if (status_of(pm, p) == TERMINATED) {
+            reply_error(r, "Already terminated (%d)\n", c->pid);
+        } else {
+            pm_resume_process(pm, p);
+        }
+        break;
+
+    case OP_LIST:
+        pm_list_processes(pm, r);
+        break;
+
+    case OP_LOGS:
+        pm_show_logs(pm, c->pid, r);
+        break;
+
+    case OP_QUANTUM:
+        if (c->value > 0) {
+            pm->quantum_ms = c->value;
+        }
+        reply_printf(r, "policy=%s quantum=%ldms context_switches=%lu\n",
+                     pm->policy->name, pm->quantum_ms,
+                     (unsigned long)pm->context_switches);
+        break;
+
+    case OP_EXIT:
+        pm_clear_processes(pm);
+        break;
+
+    case OP_NONE:
+        break;
+    }
+
+    return true;
+}
+
+
+/******************************************************************************
+ *                             MAIN-LOOP PROCEDURES                           * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Move pending output of running jobs into their logs.
+ * 
+ * Each job with output pending gets a single batch per call, so a job that
+ * writes faster than its log can take it only delays itself.
+ * 
+ * @param pm Target process manager
+ */
+static void pm_spool_output(procman *pm) {
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(pm->output_fd, events, MAX_EVENTS, 0);
+    if (n < 0 && errno != EINTR) {
+        error("epoll_wait() failed");
+    }
+
+    for (int i = 0; i < n; ++i) {
+        process *p = pt_resolve(&pm->table, events[i].data.u64);
+        if (p != NULL) {
+            pm_spool_process_output(pm, p, 1);
+        }
+    }
+}
+
+/**
+ * @brief Find out how an adopted process exited, in place of waitid().
+ * 
+ * Adopted processes are children of the shell, which leaves them zombies
+ * until their exit is journaled, so their exit status can still be read from
+ * /proc. A status that is gone is reported as a kill by signal 0.
+ * 
+ * @param pm Process manager owning the process
+ * @param p Adopted process whose pidfd became readable
+ * @param info Destination of the exit information
+ * @param usage Destination of the resource usage
+ */
+static void pm_collect_adopted(procman *pm, process *p, siginfo_t *info,
+                               struct rusage *usage) {
+    memset(info, 0, sizeof(siginfo_t));
+    memset(usage, 0, sizeof(struct rusage));
+    info->si_pid = pid_of(pm, p);
+    info->si_code = CLD_KILLED;
+
+    int status;
+    uint64_t user_ms;
+    uint64_t system_ms;
+    if (procstat_read_exit(&p->probe, &status, &user_ms, &system_ms) < 0) {
+        return;
+    }
+
+    if (WIFEXITED(status)) {
+        info->si_code = CLD_EXITED;
+        info->si_status = WEXITSTATUS(status);
+    } else {
+        info->si_status = WTERMSIG(status);
+    }
+    usage->ru_utime.tv_sec = (time_t)(user_ms / 1000);
+    usage->ru_utime.tv_usec = (suseconds_t)(user_ms % 1000 * 1000);
+    usage->ru_stime.tv_sec = (time_t)(system_ms / 1000);
+    usage->ru_stime.tv_usec = (suseconds_t)(system_ms % 1000 * 1000);
+}
+
+/**
+ * @brief Remove zombie children and update their status to TERMINATED.
+ * 
+ * Only processes whose pidfd became readable are collected, each through its
+ * own pidfd, so no other child of the worker can be reaped by accident. Every
+ * exited process is collected on each call, not just the first one.
+ * 
+ * @param pm Target process manager
+ */
+static void pm_reap_terminated_process(procman *pm) {
+    struct epoll_event events[MAX_EVENTS];
+    int n = MAX_EVENTS;
+    bool spooled = false;
+
+    /* A full batch means more exits may still be pending */
+    while (n == MAX_EVENTS) {
+        n = epoll_wait(pm->event_fd, events, MAX_EVENTS, 0);
+        if (n < 0 && errno != EINTR) {
+            error("epoll_wait() failed");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == LAUNCH_EVENT) {
+                pm_collect_launches(pm, false);
+                continue;
+            }
+
+            /* Output keeps coming as long as jobs run, one round is enough */
+            if (events[i].data.u64 == OUTPUT_EVENT) {
+                if (!spooled) {
+                    pm_spool_output(pm);
+                    spooled = true;
+                }
+                continue;
+            }
+
+            if (events[i].data.u64 == CGROUP_EVENT) {
+                cg_reap(&pm->cgroups);
+                continue;
+            }
+
+            process *p = pt_resolve(&pm->table, events[i].data.u64);
+            if (p == NULL) {
+                continue;
+            }
+
+            /* Only peek for now, the leader is reaped further down */
+            siginfo_t info;
+            struct rusage usage;
+            info.si_pid = 0;
+            if (p->adopted) {
+                pm_collect_adopted(pm, p, &info, &usage);
+            } else if (waitid(P_PIDFD, (id_t)p->pidfd, &info,
+                              WEXITED | WNOHANG | WNOWAIT) < 0) {
+                error("waitid() failed");
+                continue;
+            }
+
+            /* Readable pidfd with nothing to collect yet */
+            if (info.si_pid == 0) {
+                continue;
+            }
+
+            /* Members left behind by the leader would escape the slot
+             * limit, so they go down with it. The leader is not reaped yet,
+             * so its pid can't name another group
+             */
+            if (killpg(pid_of(pm, p), SIGKILL) < 0 && errno != ESRCH) {
+                error("killpg() failed");
+            }
+
+            /* Raw waitid() also reports resource usage of the child */
+            if (!p->adopted && syscall(SYS_waitid, P_PIDFD, p->pidfd, &info,
+                                       WEXITED | WNOHANG, &usage) < 0) {
+                error("waitid() failed");
+                continue;
+            }
+
+            pm_unschedule_process(pm, p);
+            status_of(pm, p) = TERMINATED;
+            pm_release_process(pm, p);
+            pm_retire_process(pm, p, &info, &usage);
         }
     }
-
-    return NULL;
 }
 
 /**
- * @brief Links a process to the end of process chain. 
+ * @brief Reflect stops and continues that were not caused by the manager.
+ * 
+ * A RUNNING process stopped from outside gives up its slot and becomes
+ * STOPPED. A suspended process continued from outside is treated like a
+ * resume: it becomes READY and is suspended again until the scheduler gives
+ * it a slot. Events matching what the manager did itself are ignored.
  * 
- * @warning No checks are done to prevent cycles in the chain if a duplicate
- * process is added.
- *
  * @param pm Target process manager
- * @param p The process to link
  */
-static void pm_enqueue_process(procman *pm, process *p) {
-    /* Add process as first in chain */
-    if (pm->processes == NULL) {
-        p->next = NULL;
-        p->previous = NULL;
-        pm->processes = p;
-        pm->last_process = p;
-
-    } else { /* Add process to the tail of the chain */
+static void pm_track_external_signals(procman *pm) {
+    while (true) {
+        siginfo_t info;
+        info.si_pid = 0;
+
+        /* Exits are left for the pidfds, only stop/continue reports drained */
+        if (waitid(P_ALL, 0, &info, WSTOPPED | WCONTINUED | WNOHANG) < 0) {
+            if (errno != ECHILD && errno != EINTR) {
+                error("waitid() failed");
+            }
+            return;
+        }
 
-        pm->last_process->next = p;
-        p->previous = pm->last_process;
-        p->next = NULL;
-        pm->last_process = p;
-    }
-}
+        if (info.si_pid == 0) {
+            return;
+        }
 
+        process *p = pidmap_get(&pm->index, info.si_pid);
+        if (p == NULL || status_of(pm, p) == TERMINATED) {
+            continue;
+        }
 
-/******************************************************************************
- *                               COMMAND HANDLERS                             *
- ******************************************************************************/
+        if (info.si_code == CLD_CONTINUED) {
+            if (p->suspended) {
+                p->suspended = false;
+                if (status_of(pm, p) == STOPPED) {
+                    pm_resume_process(pm, p);
+                }
+                pm_suspend_process(pm, p, true);
+            }
 
+        } else if (!p->suspended) { /* CLD_STOPPED or CLD_TRAPPED */
+            p->suspended = true;
+            if (status_of(pm, p) == RUNNING) {
+                pm_unschedule_process(pm, p);
+                status_of(pm, p) = STOPPED;
+                pm_journal(pm, JOURNAL_STOP, p);
+            }
+        }
+    }
+}
 
 /**
- * @brief Prints all process status in sequence of the process chain
+ * @brief Give every live process its top priority again.
+ * 
+ * The queues are rebuilt since every priority key changes at once.
  * 
- * @param pm Process manager with target process chain
+ * @param pm Target process manager
  */
-static void pm_list_processes(procman *pm) {
-    for (process *p = pm->processes; p != NULL; p = p->next) {
-        printf("%d,%d\n", p->pid, p->status);
+static void pm_boost_processes(procman *pm) {
+    pq_clear(&pm->ready);
+    pq_clear(&pm->running);
+
+    ptable *t = &pm->table;
+    for (size_t i = 0; i < t->capacity; ++i) {
+        if (t->pids[i] == 0 || t->statuses[i] == TERMINATED) {
+            continue;
+        }
+
+        process *p = pt_get(t, (uint32_t)i);
+        pm->policy->boost(p);
+        p->used_ms = 0;
+        p->priority = pm->policy->priority(p, pm->next_sequence++);
+
+        if (t->statuses[i] == READY) {
+            pq_push(&pm->ready, p);
+        } else if (t->statuses[i] == RUNNING) {
+            pq_push(&pm->running, p);
+        }
     }
+
+    pm->reschedule = true;
 }
 
 /**
- * @brief Remove a running process from the running process list.
+ * @brief Apply the time based parts of the scheduling policy.
  * 
- * @param pm Process manager with target list
- * @param p Target process with status RUNNING. No-op for other states
+ * Running processes that used up their quantum get a new priority from the
+ * policy, which lets the rescheduler preempt them for anything that now
+ * ranks higher. Everything is boosted once every boost interval.
+ * 
+ * @param pm Target process manager
  */
-static void pm_remove_running_process(procman *pm, process *p) {
-    if (p->status != RUNNING) {
+static void pm_expire_quanta(procman *pm) {
+    const sched_policy *policy = pm->policy;
+    if (policy->quantum == NULL) {
         return;
     }
 
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (policy->boost != NULL
+        && timespec_elapsed_ms(&now, &pm->boosted_at) >= policy->boost_interval) {
+        pm->boosted_at = now;
+        pm_boost_processes(pm);
+    }
+
     for (size_t i = 0; i < pm->processes_running_max; ++i) {
-        if (pm->processes_running[i] && pm->processes_running[i] == p) {
-            pm->processes_running[i] = NULL;
-            pm->processes_running_count -= 1;
-            break;
+        process *p = pm->processes_running[i];
+        if (p == NULL) {
+            continue;
+        }
+
+        long used = p->used_ms + timespec_elapsed_ms(&now, &p->dispatched_at);
+        if (used < policy->quantum(p, pm->quantum_ms)) {
+            continue;
         }
+
+        /* Running heap is keyed by priority, so re-key outside of it */
+        pq_remove(&pm->running, p);
+        policy->expire(p);
+        p->used_ms = 0;
+        p->dispatched_at = now;
+        p->priority = policy->priority(p, pm->next_sequence++);
+        pq_push(&pm->running, p);
+        pm->reschedule = true;
     }
 }
 
 /**
- * @brief Stop a process and removes it from running list if it is running.
+ * @brief Sample the resource usage of every live process once the sampling
+ * period is over.
  * 
- * @param pm Process manager with target list
- * @param p Target process. No-op if status is TERMINATED or STOPPED
+ * The /proc files of a process are opened on the first sweep it takes part
+ * in, so jobs that finish before then never pay for them. The period grows
+ * with the cost of a sweep to keep sampling overhead bounded.
+ * 
+ * @param pm Target process manager
  */
-static void pm_stop_process(procman *pm, process *p) {
-    if (p->status == TERMINATED || p->status == STOPPED) {
+static void pm_sample_processes(procman *pm) {
+    if (pm->sample_interval_ms <= 0) {
         return;
     }
-    
-    pm_remove_running_process(pm, p);
-    kill(p->pid, SIGSTOP);
-    p->status = STOPPED;
-}
 
-/**
- * @brief Terminate a process and removes it from running list if it is running.
- * 
- * @param pm Process manager with target list
- * @param p Target process. No-op if status is TERMINATED
- */
-static void pm_terminate_process(procman *pm, process *p) {
-    if (p->status == TERMINATED) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = timespec_elapsed_ms(&now, &pm->sampled_at);
+    if (elapsed < pm->sample_period_ms) {
         return;
     }
-    
-    pm_remove_running_process(pm, p);
-    kill(p->pid, SIGTERM);
-    p->status = TERMINATED;
-}
 
-/**
- * @brief Resume a stopped process.
- *
- * @param p Target process that must have status STOPPED
- *
- * @note Unlike other command handlers, only process management state is
- * updated. No signals are sent to the underlying process
- */
-static void pm_resume_process(process *p) {
-    assert(p->status == STOPPED);
-    p->status = READY;
-    /* Don't send SIGCONT and let the rescheduler decide whether the process
-     * should run.
-     */
+    ptable *t = &pm->table;
+    for (size_t i = 0; i < t->capacity; ++i) {
+        if (t->pids[i] == 0 || t->statuses[i] == TERMINATED) {
+            continue;
+        }
+
+        process *p = pt_get(t, (uint32_t)i);
+        bool first = !procstat_is_open(&p->probe);
+        if (first && procstat_open(&p->probe, t->pids[i]) < 0) {
+            continue;
+        }
+
+        proc_usage usage;
+        if (procstat_read(&p->probe, &usage) < 0) {
+            continue;
+        }
+
+        /* Without an earlier sample the average since spawning is used */
+        long span = first ? timespec_elapsed_ms(&now, &p->spawned_at)
+                          : elapsed;
+        uint64_t used = usage.cpu_ms - (first ? 0 : p->usage.cpu_ms);
+        p->cpu_percent = span > 0 ? (int)(used * 100 / (uint64_t)span) : 0;
+        p->usage = usage;
+    }
+
+    struct timespec done;
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    long cost = timespec_elapsed_ms(&done, &now) * SAMPLE_COST_RATIO;
+    pm->sample_period_ms = cost > pm->sample_interval_ms
+                         ? cost : pm->sample_interval_ms;
+    pm->sampled_at = now;
 }
 
 /**
- * @brief Spawn a child process that executes a given shell command.
+ * @brief Grow or shrink the number of running slots with host pressure.
  * 
- * Child is spawned and suspended. It will be queued into the
- * process manager in a READY state to be according to the scheduler.
+ * Slots are taken away one at a time under CPU or I/O pressure and halved
+ * under memory pressure, and given back one at a time while the host is
+ * calm and processes are waiting. Running processes above the new limit are
+ * preempted by the rescheduler.
  * 
  * @param pm Target process manager
- * @param argv Array of strings representing tokens of the command. Last token
- * must be NULL to indicate the end of the array
  */
-static void pm_spawn_process(procman *pm, char *const argv[]) {
-    pid_t child_pid = fork();
-
-    switch (child_pid) {
-    case -1:
-        error("fork() failed");
+static void pm_adjust_slots(procman *pm) {
+    if (pm->processes_running_min >= pm->processes_running_share) {
         return;
-
-    case 0: {
-        /* Suspend process to wait for parent to resume it before execvp() */
-        if (raise(SIGSTOP) == 0) {
-            if (execvp(argv[0], argv) < 0) {
-                /* Print exec() error, usually due to program not found */
-                char *msg = "error running ";
-                msg = malloc(1 + (strlen(msg) + strlen(argv[0])));
-                strcpy(msg, "error running ");
-                strcat(msg, argv[0]);
-                perror(msg);
-                free(msg);
-            }
-        }
-
-        exit(EXIT_FAILURE);
     }
 
-    default: {
-        /* Wait for child process to suspend before enqueuing */
-        int status;
-        int w_pid = waitpid(child_pid, &status, WSTOPPED);
-
-        while (w_pid < 0) {
-
-            /* Continue waiting when interrupted by other signals */
-            if (errno != EINTR) {
-                error("error waiting for process to spawn");
-                return;
-            }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (timespec_elapsed_ms(&now, &pm->pressure_at) < PRESSURE_INTERVAL_MS) {
+        return;
+    }
+    pm->pressure_at = now;
 
-            w_pid = waitpid(child_pid, &status, WSTOPPED);
-        }
-        
-        /* Child suspended with stop signal */
-        if (WIFSTOPPED(status)) {
-            /* Enqueue process */
-            process *p = malloc(sizeof(process));
-            p->pid = child_pid;
-            p->status = READY;
-            pm_enqueue_process(pm, p);
-        }
+    pressure_level level;
+    if (pressure_read(&pm->host, &level) < 0) {
+        return;
+    }
 
-        /* No-op when child is unexpectedly terminated and not stopped */
+    size_t limit = pm->processes_running_limit;
+    if (level.memory > MEMORY_PRESSURE_HIGH) {
+        limit /= 2;
+    } else if (level.cpu > CPU_PRESSURE_HIGH || level.io > IO_PRESSURE_HIGH) {
+        limit -= 1;
+    } else if (level.cpu < CPU_PRESSURE_LOW
+               && level.memory < MEMORY_PRESSURE_LOW
+               && level.io < IO_PRESSURE_LOW && pq_peek(&pm->ready) != NULL) {
+        limit += 1;
+    }
 
-        break;
+    if (limit < pm->processes_running_min) {
+        limit = pm->processes_running_min;
+    } else if (limit > pm->processes_running_share) {
+        limit = pm->processes_running_share;
     }
+
+    if (limit != pm->processes_running_limit) {
+        pm->processes_running_limit = limit;
+        pm->reschedule = true;
     }
 }
 
 /**
- * @brief Terminate all managed processes and remove their handle.
+ * @brief Share slots with the other workers of a runner.
+ * 
+ * Borrowed slots go back once they are idle or their owners want them.
+ * Own slots are lent out while nothing is waiting for them, and while
+ * processes wait for lent slots the other workers are asked to give them
+ * back. Slots are taken from the pool by the rescheduler.
  * 
  * @param pm Target process manager
  */
-static void pm_clear_processes(procman *pm) {
-    /* Iterate process chain to terminate each process and free its pointer */
-    process *p = pm->processes;
-    while (p != NULL) {
-        kill(p->pid, SIGTERM);
-        process *next = p->next;
-        free(p);
-        p = next;
-    }
-    
-    for (size_t i = 0; i < pm->processes_running_max; ++i) {
-        pm->processes_running[i] = NULL;
+static void pm_balance_slots(procman *pm) {
+    if (pm->pool == NULL) {
+        return;
     }
-    
-    pm->processes = NULL;
-    pm->last_process = NULL;
-    pm->processes_running_count = 0;
-}
 
+    while (pm->slots_borrowed > 0
+           && (pm->processes_running_count < pm_slot_limit(pm)
+               || slot_pool_is_short(pm->pool))) {
+        pm->slots_borrowed--;
+        slot_pool_give(pm->pool, 1);
+        pm->reschedule = true;
+    }
 
-/******************************************************************************
- *                              COMMAND DISPATCHER                            *
- ******************************************************************************/
+    size_t waiting = pm->ready.size;
+    size_t limit = pm_slot_limit(pm);
+    if (waiting == 0 && limit > pm->processes_running_count) {
+        size_t idle = limit - pm->processes_running_count;
+        pm->slots_lent += idle;
+        slot_pool_give(pm->pool, idle);
+    }
 
+    size_t wanted = waiting < pm->slots_lent ? waiting : pm->slots_lent;
+    if (wanted != pm->slots_wanted) {
+        slot_pool_want(pm->pool, (long)wanted - (long)pm->slots_wanted);
+        pm->slots_wanted = wanted;
+    }
+    pm_save_slots(pm);
 
-/**
- * @brief Ensure number of required arguments is hit.
- * 
- * @param a Target argument
- * @param n Minimum number of tokens
- * @param message Message to print when lacking tokens
- * @return true Reached token count
- * @return false Less than token count
- */
-static bool ensure_args_length(args *a, size_t n, const char *message) {
-    if (a->token_count < n) {
-        fwrite(message, sizeof(char), strlen(message) + 1, stderr);
-        return false;
+    /* Slots may have turned up in the pool since processes started waiting */
+    if (waiting > 0) {
+        pm->reschedule = true;
     }
-    
-    return true;
 }
 
 /**
- * @brief Parse a string representing a pid into a pid_t type
+ * @brief Take the slot of a running process and queue it again.
  * 
- * @param pid Target pid
- * @return pid_t Parsed pid. 0 if string was an invalid pid
+ * @param pm Target process manager
+ * @param p Target process with status RUNNING
  */
-static pid_t parse_pid(const char *pid) {
-    int num = atoi(pid);
-    /* atoi() returns 0 on invalid input but 0 is also an invalid pid for us */
-    if (num == 0) {
-        error("Invalid pid");
-    }
-    return num;
+static void pm_preempt_process(procman *pm, process *p) {
+    pm_unschedule_process(pm, p);
+    pm_suspend_process(pm, p, true);
+    status_of(pm, p) = READY;
+    pq_push(&pm->ready, p);
+    pm->context_switches++;
 }
 
 /**
- * @brief Execute command handlers based on received commands.
+ * @brief Reshedule processes to run based on availability and priority.
  * 
- * @param pm Target process manager to run command handlers on
- * @param a Command to dispatch
+ * Priority is given to processes in status READY OR RUNNING with the lowest
+ * priority key, which the scheduling policy decides. The number of running
+ * processes is set by the process manager and processes with lower priority
+ * have to wait for high priority processes to finish if every slot admission
+ * control allows is already taken.
+ * 
+ * Ready and running processes are kept in heaps that only change when a
+ * process changes state, so nothing is done unless a transition happened
+ * since the last call.
+ * 
+ * @param pm Target process manager
  */
-static void dispatch(procman *pm, args *a) {
-    /* No-op when empty command received */
-    if (a->token_count == 0) {
+static void pm_reschedule_processes(procman *pm) {
+    if (!pm->reschedule) {
         return;
     }
+    pm->reschedule = false;
 
-    const char *command = a->argv[0];
-
-    if (!strcmp(command, "run")) {
-        if (ensure_args_length(a, 2, "USAGE: run [program] [arguments]\n")) {
-            pm_spawn_process(pm, a->argv + 1);
-        }
-
-    } else if (!strcmp(command, "stop")) {
-        if (ensure_args_length(a, 2, "USAGE: stop [PID]\n")) {
-            pid_t pid = parse_pid(a->argv[1]);
-            process *p = find_process(pm->processes, pid);
-            if (p) {
-                if (p->status == TERMINATED) {
-                    fprintf(stderr, "Already terminated (%d)\n", pid);
-                } else if (p->status == STOPPED) {
-                    fprintf(stderr, "Already stopped (%d)\n", pid);
-                } else {
-                    pm_stop_process(pm, p);
-                }
-            } else {
-                fprintf(stderr, "PID not found (%d)\n", pid);
-            }
-        }
+    /* Give up slots admission control or other workers took away, latest
+     * processes first
+     */
+    while (pm->processes_running_count > pm_slot_limit(pm)) {
+        pm_preempt_process(pm, pq_peek(&pm->running));
+    }
 
-    } else if (!strcmp(command, "kill")) {
-        if (ensure_args_length(a, 2, "USAGE: kill [PID]\n")) {
-            pid_t pid = parse_pid(a->argv[1]);
-            process *p = find_process(pm->processes, pid);
-            if (p) {
-                if (p->status == TERMINATED) {
-                    fprintf(stderr, "Already terminated (%d)\n", pid);
-                } else {
-                    pm_terminate_process(pm, p);
-                }
-            } else {
-                fprintf(stderr, "PID not found (%d)\n", pid);
-            }
-        }
+    process *next;
+    while ((next = pq_peek(&pm->ready)) != NULL) {
 
-    } else if (!strcmp(command, "resume")) {
-        if (ensure_args_length(a, 2, "USAGE: resume [PID]\n")) {
-            pid_t pid = parse_pid(a->argv[1]);
-            process *p = find_process(pm->processes, pid);
-            if (p) {
-                if (p->status == RUNNING) {
-                    fprintf(stderr, "Already running (%d)\n", pid);
-                } else if (p->status == READY) {
-                    fprintf(stderr, "Already ready (%d)\n", pid);
-                } else if (p->status == TERMINATED) {
-                    fprintf(stderr, "Already terminated (%d)\n", pid);
-                } else {
-                    pm_resume_process(p);
-                }
-            } else {
-                fprintf(stderr, "PID not found (%d)\n", pid);
+        /* Make room by suspending the latest running process if it was
+         * spawned after the earliest ready one
+         */
+        if (pm->processes_running_count >= pm_slot_limit(pm)
+            && !pm_acquire_slot(pm)) {
+            process *latest = pq_peek(&pm->running);
+            if (latest == NULL || latest->priority < next->priority) {
+                break;
             }
+            pm_preempt_process(pm, latest);
         }
 
-    } else if (!strcmp(command, "list")) {
-        pm_list_processes(pm);
-
-    } else if (!strcmp(command, "exit")) {
-        pm_clear_processes(pm);
-
-    } else { /* Unrecognised command received */
-        fprintf(stderr, USAGE);
+        pq_pop(&pm->ready);
+        pm_assign_slot(pm, next);
     }
 }
 
 
 /******************************************************************************
- *                             MAIN-LOOP PROCEDURES                           * 
+ *                             PUBLIC INTERFACE                               * 
  ******************************************************************************/
 
 
 /**
- * @brief Remove zombie children and update their status to TERMINATED.
+ * @brief Fill a configuration with default values.
  * 
- * @param pm Target process manager
+ * @param config Target configuration
  */
-static void pm_reap_terminated_process(procman *pm) {
-    int status = 0;
-
-    pid_t pid = waitpid(-1, &status, WNOHANG);
-    
-    /* No-op if waitpid return -1 or 0 */
-    switch (pid) {
-        case -1:
-            if (ECHILD != errno) {  /* Ignore if there's no children */
-                perror("wait() failed");
-            }
-        case 0:
-            return;
-
-        default: { /* A process has terminated */
-            process *p = find_process(pm->processes, pid);
-
-            /* The process here should always be managed by us */
-            assert(p != NULL);
-            
-
-            /* Status indicates termination normally or by signal */
-            if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                pm_remove_running_process(pm, p);
-                p->status = TERMINATED;
-            }
-        }
-    }
+void pm_config_default(pm_config *config) {
+    config->max_running_processes = affinity_cpu_count();
+    config->min_running_processes = 0;
+    config->affinity = AFFINITY_CPU;
+    config->history_capacity = DEFAULT_HISTORY_CAPACITY;
+    config->fork_server = false;
+    config->policy = &sched_fifo;
+    config->quantum_ms = DEFAULT_QUANTUM_MS;
+    config->cgroup_path = NULL;
+    config->ready_share = 0;
+    config->sample_interval_ms = DEFAULT_SAMPLE_INTERVAL_MS;
+    config->pool = NULL;
+    config->first_slot = 0;
+    config->shared_slots = 0;
+    config->spawner_threads = 0;
+    config->log_path = NULL;
+    config->journal_path = NULL;
+    config->restarted = false;
 }
 
 /**
- * @brief Reshedule processes to run based on availability and priority.
+ * @brief Initialise a process manager.
  * 
- * Priority is given to earliest spawned processes that are in status READY OR
- * RUNNING. The number of running process is set by the process manager and
- * processes with lower priority have to wait for high priority processes to
- * finish if the max number of processes is already running.
+ * With a journal, jobs recorded in it by an earlier process manager that
+ * are still alive are taken over.
  * 
  * @param pm Target process manager
+ * @param config Process manager configuration
  */
-static void pm_reschedule_processes(procman *pm) {
-    
-    /* Collect earliest process to be ran */
-    process **to_run = malloc(sizeof(process *) * pm->processes_running_max);
-    {
-        size_t idx = 0;
-        process *p = pm->processes;
-
-        while (idx < pm->processes_running_max && p != NULL) {
-            if (p->status == RUNNING || p->status == READY) {
-                to_run[idx++] = p;
-            }
-            p = p->next;
-        }
-        
-        while (idx < pm->processes_running_max) {
-            to_run[idx++] = NULL;
-        }
+void pm_init(procman *pm, const pm_config *config) {
+    size_t max_running_processes = config->max_running_processes;
+
+    pm->event_fd = epoll_create1(EPOLL_CLOEXEC);
+    pm->zygote = NULL;
+    pm->spawner = NULL;
+    pm->reply_handler = NULL;
+    pm->reply_context = NULL;
+    reply_init(&pm->command_reply);
+    reply_init(&pm->launch_reply);
+    job_argv_init(&pm->array_argv);
+    pm->arrays = NULL;
+    pm->array_count = 0;
+    pm->array_capacity = 0;
+    pt_init(&pm->table);
+    pidmap_init(&pm->index);
+    pq_init(&pm->ready, false);
+    pq_init(&pm->running, true);
+    pq_reserve(&pm->running, max_running_processes);
+    pm->next_ticket = 0;
+    pm->next_sequence = 0;
+    pm->reschedule = false;
+    pm->policy = config->policy != NULL ? config->policy : &sched_fifo;
+    pm->quantum_ms = config->quantum_ms > 0 ? config->quantum_ms
+                                            : DEFAULT_QUANTUM_MS;
+    pm->context_switches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &pm->boosted_at);
+
+    if (history_init(&pm->terminated, config->history_capacity) < 0) {
+        error("failed to allocate history");
     }
 
-    /* Stop currently running processes that should not be running */
-    for (size_t i = 0; i < pm->processes_running_max; ++i) {
-        process *p_running = pm->processes_running[i];
+    /* Workers sharing slots may end up running every shared slot */
+    size_t slot_count = max_running_processes;
+    if (config->pool != NULL && config->shared_slots > slot_count) {
+        slot_count = config->shared_slots;
+    }
 
-        if (p_running == NULL) {
-            continue;
-        }
+    pm->processes_running_count = 0;
+    pm->processes_running_max = slot_count;
+    pm->processes_running_share = max_running_processes;
+    pm->processes_running = calloc(slot_count, sizeof(process *));
+    pm->free_slots = malloc(slot_count * sizeof(size_t));
+    for (size_t i = 0; i < slot_count; ++i) {
+        pm->free_slots[i] = i;
+    }
 
-        bool process_should_run = false;
-        for (size_t j = 0; j < pm->processes_running_max; ++j) {
-            if (p_running == to_run[j]) {
-                process_should_run = true;
-                break;
-            }
+    if (affinity_init(&pm->placement, config->affinity, config->first_slot,
+                      slot_count) < 0) {
+        error("failed to place slots on CPUs");
+    }
+
+    pm->sample_interval_ms = config->sample_interval_ms;
+    pm->sample_period_ms = config->sample_interval_ms;
+    clock_gettime(CLOCK_MONOTONIC, &pm->sampled_at);
+
+    /* Adaptive slots start at one per CPU and move within the bounds. A
+     * lower bound of 0 keeps every slot active
+     */
+    size_t min_running_processes = config->min_running_processes;
+    if (min_running_processes == 0
+        || min_running_processes > max_running_processes) {
+        min_running_processes = max_running_processes;
+    }
+    size_t cpu_count = affinity_cpu_count();
+    pm->processes_running_min = min_running_processes;
+    pm->processes_running_limit = max_running_processes;
+    pm->host.cpu_fd = pm->host.memory_fd = pm->host.io_fd = -1;
+    pm->host.loadavg_fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &pm->pressure_at);
+    if (min_running_processes < max_running_processes) {
+        if (pressure_init(&pm->host) < 0) {
+            error("host pressure unreadable, keeping every slot");
+            pm->processes_running_min = max_running_processes;
+        } else if (cpu_count < max_running_processes) {
+            pm->processes_running_limit = cpu_count > min_running_processes
+                                        ? cpu_count : min_running_processes;
         }
+    }
 
-        if (!process_should_run) {
-            p_running->status = READY;
-            kill(p_running->pid, SIGSTOP);
+    journal_init(&pm->journal);
+    if (config->journal_path != NULL
+        && journal_open(&pm->journal, config->journal_path) < 0) {
+        error("journal unusable, jobs are lost if the worker dies");
+    }
 
-        } else {
-            /* Process in running list but not running is a bug */
-            assert(p_running->status == RUNNING);
+    /* Every slot starts out lent and is taken back once it is needed. A
+     * worker replacing one that died carries on with the slots it held
+     */
+    pm->pool = config->pool;
+    pm->slots_lent = 0;
+    pm->slots_borrowed = 0;
+    pm->slots_wanted = 0;
+    if (pm->pool != NULL && config->restarted
+        && journal_enabled(&pm->journal)) {
+        journal_slots held = journal_saved_slots(&pm->journal);
+        pm->slots_lent = (size_t)held.lent;
+        pm->slots_borrowed = (size_t)held.borrowed;
+        pm->slots_wanted = (size_t)held.wanted;
+    } else if (pm->pool != NULL) {
+        pm->slots_lent = pm->processes_running_limit;
+        slot_pool_give(pm->pool, pm->slots_lent);
+    }
+    pm_save_slots(pm);
+
+    /* Job output pipes are nested like the fork-server and spawner threads */
+    pm->logs.dir_fd = -1;
+    pm->output_fd = -1;
+    if (config->log_path != NULL) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = OUTPUT_EVENT };
+        if (joblog_dir_init(&pm->logs, config->log_path) < 0
+            || (pm->output_fd = epoll_create1(EPOLL_CLOEXEC)) < 0
+            || epoll_ctl(pm->event_fd, EPOLL_CTL_ADD, pm->output_fd, &ev) < 0) {
+            error("job output unusable, jobs write to the terminal");
+            joblog_dir_free(&pm->logs);
         }
     }
-    
-    /* Run all processes that needs to run */
-    for (size_t i = 0; i < pm->processes_running_max; ++i) {
-        process *p_to_run = to_run[i];
-        if (p_to_run != NULL && p_to_run->status == READY) {
-            p_to_run->status = RUNNING;
-            kill(p_to_run->pid, SIGCONT);
+
+    pm->cgroups.root_fd = -1;
+    pm->ready_share = config->ready_share;
+    if (config->cgroup_path != NULL) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = CGROUP_EVENT };
+        if (cg_init(&pm->cgroups, config->cgroup_path) < 0) {
+            error("cgroup tree unusable, falling back to signals");
+        } else if (epoll_ctl(pm->event_fd, EPOLL_CTL_ADD,
+                             cg_events_fd(&pm->cgroups), &ev) < 0) {
+            error("epoll_ctl() failed");
         }
     }
 
-    /* Replace running list */
-    free(pm->processes_running);
-    pm->processes_running = to_run;
+    if (journal_enabled(&pm->journal)) {
+        pm_recover_processes(pm);
+    }
 }
 
+/**
+ * @brief Launch processes through a fork-server instead of directly.
+ * 
+ * @param pm Target process manager
+ * @param z Running fork-server, which must outlive the process manager
+ */
+void pm_use_zygote(procman *pm, zygote *z) {
+    pm->zygote = z;
 
-/******************************************************************************
- *                             PUBLIC INTERFACE                               * 
- ******************************************************************************/
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = LAUNCH_EVENT };
+    if (epoll_ctl(pm->event_fd, EPOLL_CTL_ADD, z->fd, &ev) < 0) {
+        error("epoll_ctl() failed");
+    }
+}
+
+/**
+ * @brief Launch processes from a pool of spawner threads instead of directly.
+ * 
+ * Commands and exits keep being handled while launches are in flight, and
+ * only the calling thread ever touches the slots and the process table.
+ * 
+ * @param pm Target process manager
+ * @param s Running spawner threads, which must outlive the process manager
+ */
+void pm_use_spawner(procman *pm, spawner *s) {
+    pm->spawner = s;
 
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = LAUNCH_EVENT };
+    if (epoll_ctl(pm->event_fd, EPOLL_CTL_ADD, s->fd, &ev) < 0) {
+        error("epoll_ctl() failed");
+    }
+}
 
 /**
- * @brief Initialise a process manager.
+ * @brief Get a pollable descriptor that becomes readable when a managed
+ * process exits.
  * 
  * @param pm Target process manager
- * @param max_running_processes Number of processes allowed to be running
+ * @return int epoll file descriptor watching every live process
  */
-void pm_init(procman *pm, size_t max_running_processes) {
-    pm->processes = NULL;
-    pm->last_process = NULL;
-    pm->processes_running_count = 0;
-    pm->processes_running_max = max_running_processes;
-    pm->processes_running = malloc(max_running_processes * sizeof(process *));
+int pm_event_fd(const procman *pm) {
+    return pm->event_fd;
+}
+
+/**
+ * @brief Set the function receiving the reply of every command.
+ * 
+ * @param pm Target process manager
+ * @param handler Reply handler. NULL to discard replies
+ * @param context Passed back to the handler
+ */
+void pm_set_reply_handler(procman *pm, pm_reply_handler handler, void *context) {
+    pm->reply_handler = handler;
+    pm->reply_context = context;
 }
 
 /**
- * @brief Dispatch a command to the process manager.
+ * @brief Execute a command on the process manager.
+ * 
+ * The reply handler is called with the result once the command completes,
+ * which is before returning for every command except a run launched through
+ * a fork-server or spawner threads.
  * 
  * @param pm Target process manager
- * @param command The command string
+ * @param id Id passed back to the reply handler
+ * @param c The parsed command
  */
-void pm_send_command(procman *pm, const char *command) {
-    if (command != NULL) {
-        args a;
-        args_parse(&a, command);
-        dispatch(pm, &a);
-        args_free(&a);
+void pm_execute(procman *pm, uint64_t id, const command *c) {
+    reply *r = &pm->command_reply;
+    reply_reset(r);
+    if (dispatch(pm, c, id, r)) {
+        pm_complete(pm, id, r);
     }
 }
 
@@ -518,9 +2329,75 @@ void pm_send_command(procman *pm, const char *command) {
  */
 void pm_run(procman *pm) {
     pm_reap_terminated_process(pm);
+    pm_track_external_signals(pm);
+    pm_sample_processes(pm);
+    pm_adjust_slots(pm);
+    pm_balance_slots(pm);
+    pm_expire_quanta(pm);
     pm_reschedule_processes(pm);
 }
 
+/**
+ * @brief Get the time left until the scheduling policy, the sampler or
+ * admission control next needs to run.
+ * 
+ * @param pm Target process manager
+ * @return long Milliseconds until a quantum expires, a boost is due, live
+ * processes are due to be sampled or host pressure is due to be read. -1 if
+ * nothing is due
+ */
+long pm_next_timeout(const procman *pm) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long timeout = -1;
+    if (pm->sample_interval_ms > 0 && pm->table.size > 0) {
+        timeout = earliest_deadline(timeout, pm->sample_period_ms
+                                    - timespec_elapsed_ms(&now, &pm->sampled_at));
+    }
+
+    /* Slots can only grow while processes wait and only shrink down to the
+     * lower bound
+     */
+    if (pm->processes_running_min < pm->processes_running_share
+        && (pq_peek(&pm->ready) != NULL
+            || pm->processes_running_limit > pm->processes_running_min)) {
+        timeout = earliest_deadline(timeout, PRESSURE_INTERVAL_MS
+                                    - timespec_elapsed_ms(&now, &pm->pressure_at));
+    }
+
+    /* Spare slots and owners wanting theirs back are only noticed by
+     * looking
+     */
+    if (pm->pool != NULL
+        && (pq_peek(&pm->ready) != NULL || pm->slots_borrowed > 0)) {
+        timeout = earliest_deadline(timeout, BALANCE_INTERVAL_MS);
+    }
+
+    const sched_policy *policy = pm->policy;
+    if (policy->quantum == NULL || pm->processes_running_count == 0) {
+        return timeout;
+    }
+
+    if (policy->boost != NULL) {
+        timeout = earliest_deadline(timeout, policy->boost_interval
+                                    - timespec_elapsed_ms(&now, &pm->boosted_at));
+    }
+
+    for (size_t i = 0; i < pm->processes_running_max; ++i) {
+        const process *p = pm->processes_running[i];
+        if (p == NULL) {
+            continue;
+        }
+
+        long left = policy->quantum(p, pm->quantum_ms) - p->used_ms
+                  - timespec_elapsed_ms(&now, &p->dispatched_at);
+        timeout = earliest_deadline(timeout, left);
+    }
+
+    return timeout;
+}
+
 /**
  * @brief Free all resources and spawned processes.
  * 
@@ -528,9 +2405,41 @@ void pm_run(procman *pm) {
  */
 void pm_shutdown(procman *pm) {
     pm_clear_processes(pm);
+
+    /* Nothing is left to take over */
+    if (journal_enabled(&pm->journal) && journal_discard(&pm->journal) < 0) {
+        error("failed to delete journal");
+    }
+
+    pidmap_free(&pm->index);
+    pt_free(&pm->table);
+    history_free(&pm->terminated);
+    reply_free(&pm->command_reply);
+    reply_free(&pm->launch_reply);
+    job_argv_free(&pm->array_argv);
+    free(pm->arrays);
+    pm->arrays = NULL;
+    pm->array_capacity = 0;
     if (pm->processes_running != NULL) {
         free(pm->processes_running);
         pm->processes_running = NULL;
     }
+    free(pm->free_slots);
+    pm->free_slots = NULL;
+    affinity_free(&pm->placement);
+    cg_free(&pm->cgroups);
+    pressure_free(&pm->host);
+    joblog_dir_free(&pm->logs);
+    if (pm->output_fd >= 0) {
+        close(pm->output_fd);
+        pm->output_fd = -1;
+    }
     pm->processes_running_max = 0;
+    pq_free(&pm->ready);
+    pq_free(&pm->running);
+
+    if (pm->event_fd >= 0) {
+        close(pm->event_fd);
+        pm->event_fd = -1;
+    }
 }
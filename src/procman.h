@@ -1,47 +1,189 @@
 #ifndef PROCMAN_H
 #define PROCMAN_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 
-typedef enum pstatus {
-    RUNNING,
-    READY,
-    STOPPED,
-    TERMINATED,
-} pstatus;
-
-typedef struct process process;
-struct process {
-    pid_t pid;
-    pstatus status;
-    process *previous;
-    process *next;
-};
+#include "affinity.h"
+#include "cgroup.h"
+#include "command.h"
+#include "history.h"
+#include "joblog.h"
+#include "journal.h"
+#include "pidmap.h"
+#include "pqueue.h"
+#include "pressure.h"
+#include "ptable.h"
+#include "reply.h"
+#include "sched.h"
+#include "slotpool.h"
+#include "spawner.h"
+#include "zygote.h"
+
+typedef struct pm_config {
+    size_t max_running_processes;
+    size_t min_running_processes;
+    affinity_mode affinity;
+    size_t history_capacity;
+    bool fork_server;
+    const sched_policy *policy;
+    long quantum_ms;
+    const char *cgroup_path;
+    int ready_share;
+    long sample_interval_ms;
+    slot_pool *pool;
+    size_t first_slot;
+    size_t shared_slots;
+    size_t spawner_threads;
+    const char *log_path;
+    const char *journal_path;
+    bool restarted;     /* Replaces a worker that died, journal_path is its */
+} pm_config;
+
+/**
+ * Job array whose launches are still in flight. The reply counts launched
+ * jobs in its value and collects every launch error.
+ */
+typedef struct job_array {
+    uint64_t id;
+    uint32_t remaining;
+    reply r;
+} job_array;
+
+/**
+ * Receives the reply of a completed command along with the id it was sent
+ * with.
+ */
+typedef void (*pm_reply_handler)(void *context, uint64_t id, const reply *r);
 
 typedef struct procman {
-    process *processes;
-    process *last_process;
+    int event_fd;
+    zygote *zygote;
+    spawner *spawner;
+
+    pm_reply_handler reply_handler;
+    void *reply_context;
+    reply command_reply;
+    reply launch_reply;
+
+    job_argv array_argv;
+    job_array *arrays;
+    size_t array_count;
+    size_t array_capacity;
+
+    ptable table;
+    pidmap index;
+
+    history terminated;
+
+    pqueue ready;
+    pqueue running;
+    uint64_t next_ticket;
+    uint64_t next_sequence;
+    bool reschedule;
+    const sched_policy *policy;
+    long quantum_ms;
+    uint64_t context_switches;
+    struct timespec boosted_at;
 
     process **processes_running;
+    size_t *free_slots;
     size_t processes_running_max;
     size_t processes_running_count;
+    affinity placement;
+
+    size_t processes_running_share;
+    size_t processes_running_limit;
+    size_t processes_running_min;
+    pressure host;
+    struct timespec pressure_at;
+
+    slot_pool *pool;
+    size_t slots_lent;
+    size_t slots_borrowed;
+    size_t slots_wanted;
+
+    cgroup_tree cgroups;
+    int ready_share;
+
+    joblog_dir logs;
+    int output_fd;
+
+    journal journal;
+
+    long sample_interval_ms;
+    long sample_period_ms;
+    struct timespec sampled_at;
 } procman;
 
+/**
+ * @brief Fill a configuration with default values.
+ * 
+ * @param config Target configuration
+ */
+void pm_config_default(pm_config *config);
+
 /**
  * @brief Initialise a process manager.
  * 
+ * With a journal, jobs recorded in it by an earlier process manager that
+ * are still alive are taken over.
+ * 
+ * @param pm Target process manager
+ * @param config Process manager configuration
+ */
+void pm_init(procman *pm, const pm_config *config);
+
+/**
+ * @brief Launch processes through a fork-server instead of directly.
+ * 
  * @param pm Target process manager
- * @param max_running_processes Number of processes allowed to be running
+ * @param z Running fork-server, which must outlive the process manager
  */
-void pm_init(procman *pm, size_t max_running_processes);
+void pm_use_zygote(procman *pm, zygote *z);
 
 /**
- * @brief Dispatch a command to the process manager.
+ * @brief Launch processes from a pool of spawner threads instead of directly.
+ * 
+ * Commands and exits keep being handled while launches are in flight, and
+ * only the calling thread ever touches the slots and the process table.
  * 
  * @param pm Target process manager
- * @param command The command string
+ * @param s Running spawner threads, which must outlive the process manager
  */
-void pm_send_command(procman *pm, const char *command);
+void pm_use_spawner(procman *pm, spawner *s);
+
+/**
+ * @brief Get a pollable descriptor that becomes readable when a managed
+ * process exits.
+ * 
+ * @param pm Target process manager
+ * @return int epoll file descriptor watching every live process
+ */
+int pm_event_fd(const procman *pm);
+
+/**
+ * @brief Set the function receiving the reply of every command.
+ * 
+ * @param pm Target process manager
+ * @param handler Reply handler. NULL to discard replies
+ * @param context Passed back to the handler
+ */
+void pm_set_reply_handler(procman *pm, pm_reply_handler handler, void *context);
+
+/**
+ * @brief Execute a command on the process manager.
+ * 
+ * The reply handler is called with the result once the command completes,
+ * which is before returning for every command except a run launched through
+ * a fork-server or spawner threads.
+ * 
+ * @param pm Target process manager
+ * @param id Id passed back to the reply handler
+ * @param c The parsed command
+ */
+void pm_execute(procman *pm, uint64_t id, const command *c);
 
 /**
  * @brief Run process management procedures. Should be called repeatedly.
@@ -50,6 +192,17 @@ void pm_send_command(procman *pm, const char *command);
  */
 void pm_run(procman *pm);
 
+/**
+ * @brief Get the time left until the scheduling policy, the sampler or
+ * admission control next needs to run.
+ * 
+ * @param pm Target process manager
+ * @return long Milliseconds until a quantum expires, a boost is due, live
+ * processes are due to be sampled or host pressure is due to be read. -1 if
+ * nothing is due
+ */
+long pm_next_timeout(const procman *pm);
+
 /**
  * @brief Free all resources and spawned processes.
  * 
@@ -0,0 +1,251 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "procstat.h"
+
+/* /proc/<pid>/stat fields counted from the state, the first after the name */
+#define STAT_UTIME 11
+#define STAT_STIME 12
+#define STAT_START_TIME 19
+#define STAT_RSS 21
+#define STAT_EXIT_CODE 49
+
+#define STAT_SIZE 1024
+#define STATUS_SIZE 4096
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Read a whole /proc file from the start.
+ * 
+ * @param fd Open /proc file
+ * @param buffer Destination, NUL-terminated on success
+ * @param size Size of the destination
+ * @return int 0 if successful. -1 otherwise
+ */
+static int read_proc_file(int fd, char *buffer, size_t size) {
+    ssize_t n = pread(fd, buffer, size - 1, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    buffer[n] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Find the value of a "Name:\tvalue" line of /proc/<pid>/status.
+ * 
+ * @param status Contents of the status file
+ * @param name Name including the colon
+ * @return uint64_t Value of the line. 0 if it is missing
+ */
+static uint64_t status_value(const char *status, const char *name) {
+    const char *line = strstr(status, name);
+    if (line == NULL) {
+        return 0;
+    }
+    return strtoull(line + strlen(name), NULL, 10);
+}
+
+
+/**
+ * @brief Find a field of /proc/<pid>/stat.
+ * 
+ * @param stat Contents of the stat file
+ * @param index Index of the field counted from the state
+ * @return const char* Start of the field. NULL if it is missing
+ */
+static const char *stat_field(const char *stat, int index) {
+    /* The name may contain anything, fields start after its last ')' */
+    const char *field = strrchr(stat, ')');
+    if (field == NULL || field[1] == '\0') {
+        return NULL;
+    }
+    field += 2;
+
+    for (int i = 0; i < index; ++i) {
+        field = strchr(field, ' ');
+        if (field == NULL) {
+            return NULL;
+        }
+        field++;
+    }
+    return field;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Mark a probe as not opened yet.
+ * 
+ * @param s Target probe
+ */
+void procstat_init(procstat *s) {
+    s->stat_fd = -1;
+    s->status_fd = -1;
+}
+
+/**
+ * @brief Check whether a probe has been opened.
+ * 
+ * @param s Target probe
+ * @return true The /proc files are open
+ * @return false The probe was never opened or failed to open
+ */
+bool procstat_is_open(const procstat *s) {
+    return s->stat_fd >= 0;
+}
+
+/**
+ * @brief Open the /proc files of a process.
+ * 
+ * The pid must not be reaped yet, otherwise the files may belong to another
+ * process that reused it.
+ * 
+ * @param s Target probe
+ * @param pid Target process
+ * @return int 0 if successful. -1 otherwise
+ */
+int procstat_open(procstat *s, pid_t pid) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d", pid);
+
+    int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        return -1;
+    }
+
+    s->stat_fd = openat(dir_fd, "stat", O_RDONLY | O_CLOEXEC);
+    s->status_fd = openat(dir_fd, "status", O_RDONLY | O_CLOEXEC);
+    int saved = errno;
+    close(dir_fd);
+
+    if (s->stat_fd < 0 || s->status_fd < 0) {
+        procstat_close(s);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sample the resource usage of a process.
+ * 
+ * @param s Open probe
+ * @param usage Destination
+ * @return int 0 if successful. -1 otherwise
+ */
+int procstat_read(const procstat *s, proc_usage *usage) {
+    char stat[STAT_SIZE];
+    char status[STATUS_SIZE];
+    if (read_proc_file(s->stat_fd, stat, sizeof(stat)) < 0
+        || read_proc_file(s->status_fd, status, sizeof(status)) < 0) {
+        return -1;
+    }
+
+    const char *utime = stat_field(stat, STAT_UTIME);
+    const char *stime = stat_field(stat, STAT_STIME);
+    const char *rss = stat_field(stat, STAT_RSS);
+    if (utime == NULL || stime == NULL || rss == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t ticks = strtoull(utime, NULL, 10) + strtoull(stime, NULL, 10);
+    long pages = strtol(rss, NULL, 10);
+
+    usage->cpu_ms = ticks * 1000 / (uint64_t)sysconf(_SC_CLK_TCK);
+    usage->rss_kb = pages * (sysconf(_SC_PAGESIZE) / 1024);
+    usage->voluntary_switches = status_value(status,
+                                             "\nvoluntary_ctxt_switches:");
+    usage->involuntary_switches = status_value(status,
+                                               "nonvoluntary_ctxt_switches:");
+    return 0;
+}
+
+/**
+ * @brief Get when a process started.
+ * 
+ * @param s Open probe
+ * @param boot_ns Destination of the start time on CLOCK_BOOTTIME
+ * @return int 0 if successful. -1 otherwise
+ */
+int procstat_start_time(const procstat *s, uint64_t *boot_ns) {
+    char stat[STAT_SIZE];
+    if (read_proc_file(s->stat_fd, stat, sizeof(stat)) < 0) {
+        return -1;
+    }
+
+    const char *field = stat_field(stat, STAT_START_TIME);
+    if (field == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t ticks = strtoull(field, NULL, 10);
+    *boot_ns = ticks * (1000000000 / (uint64_t)sysconf(_SC_CLK_TCK));
+    return 0;
+}
+
+/**
+ * @brief Read how a process that is not a child of the caller exited.
+ * 
+ * The process must be a zombie, whose parent has not collected it yet.
+ * 
+ * @param s Open probe
+ * @param status Destination of the status waitpid() would have returned
+ * @param user_ms Destination of the CPU time spent in user mode
+ * @param system_ms Destination of the CPU time spent in the kernel
+ * @return int 0 if successful. -1 otherwise, including when the process
+ * has not exited or was already collected
+ */
+int procstat_read_exit(const procstat *s, int *status, uint64_t *user_ms,
+                       uint64_t *system_ms) {
+    char stat[STAT_SIZE];
+    if (read_proc_file(s->stat_fd, stat, sizeof(stat)) < 0) {
+        return -1;
+    }
+
+    const char *state = stat_field(stat, 0);
+    const char *utime = stat_field(stat, STAT_UTIME);
+    const char *stime = stat_field(stat, STAT_STIME);
+    const char *code = stat_field(stat, STAT_EXIT_CODE);
+    if (state == NULL || *state != 'Z' || utime == NULL || stime == NULL
+        || code == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t tick_ms = 1000 / (uint64_t)sysconf(_SC_CLK_TCK);
+    *status = atoi(code);
+    *user_ms = strtoull(utime, NULL, 10) * tick_ms;
+    *system_ms = strtoull(stime, NULL, 10) * tick_ms;
+    return 0;
+}
+
+/**
+ * @brief Close the /proc files of a process.
+ * 
+ * @param s Target probe
+ */
+void procstat_close(procstat *s) {
+    if (s->stat_fd >= 0) {
+        close(s->stat_fd);
+    }
+    if (s->status_fd >= 0) {
+        close(s->status_fd);
+    }
+    procstat_init(s);
+}
@@ -0,0 +1,95 @@
+#ifndef PROCSTAT_H
+#define PROCSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Open /proc files of a live process. They are opened once and read again
+ * with pread() on every sample, so sampling never walks a path.
+ */
+typedef struct procstat {
+    int stat_fd;
+    int status_fd;
+} procstat;
+
+/**
+ * Resource usage of a process at the time it was sampled.
+ */
+typedef struct proc_usage {
+    uint64_t cpu_ms;
+    long rss_kb;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+} proc_usage;
+
+/**
+ * @brief Mark a probe as not opened yet.
+ * 
+ * @param s Target probe
+ */
+void procstat_init(procstat *s);
+
+/**
+ * @brief Check whether a probe has been opened.
+ * 
+ * @param s Target probe
+ * @return true The /proc files are open
+ * @return false The probe was never opened or failed to open
+ */
+bool procstat_is_open(const procstat *s);
+
+/**
+ * @brief Open the /proc files of a process.
+ * 
+ * The pid must not be reaped yet, otherwise the files may belong to another
+ * process that reused it.
+ * 
+ * @param s Target probe
+ * @param pid Target process
+ * @return int 0 if successful. -1 otherwise
+ */
+int procstat_open(procstat *s, pid_t pid);
+
+/**
+ * @brief Sample the resource usage of a process.
+ * 
+ * @param s Open probe
+ * @param usage Destination
+ * @return int 0 if successful. -1 otherwise
+ */
+int procstat_read(const procstat *s, proc_usage *usage);
+
+/**
+ * @brief Get when a process started.
+ * 
+ * @param s Open probe
+ * @param boot_ns Destination of the start time on CLOCK_BOOTTIME
+ * @return int 0 if successful. -1 otherwise
+ */
+int procstat_start_time(const procstat *s, uint64_t *boot_ns);
+
+/**
+ * @brief Read how a process that is not a child of the caller exited.
+ * 
+ * The process must be a zombie, whose parent has not collected it yet.
+ * 
+ * @param s Open probe
+ * @param status Destination of the status waitpid() would have returned
+ * @param user_ms Destination of the CPU time spent in user mode
+ * @param system_ms Destination of the CPU time spent in the kernel
+ * @return int 0 if successful. -1 otherwise, including when the process
+ * has not exited or was already collected
+ */
+int procstat_read_exit(const procstat *s, int *status, uint64_t *user_ms,
+                       uint64_t *system_ms);
+
+/**
+ * @brief Close the /proc files of a process.
+ * 
+ * @param s Target probe
+ */
+void procstat_close(procstat *s);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ptable.h"
+
+#define PTABLE_CHUNK_SIZE 256
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Grow a table by one chunk of records.
+ * 
+ * @param t Target table
+ * @return int 0 if successful. -1 otherwise
+ */
+static int pt_grow(ptable *t) {
+    size_t capacity = t->capacity + PTABLE_CHUNK_SIZE;
+    if (capacity > UINT32_MAX) {
+        return -1;
+    }
+
+    process *chunk = calloc(PTABLE_CHUNK_SIZE, sizeof(process));
+    process **chunks = realloc(t->chunks, (t->chunk_count + 1) * sizeof(process *));
+    if (chunk == NULL || chunks == NULL) {
+        free(chunk);
+        if (chunks != NULL) {
+            t->chunks = chunks;
+        }
+        return -1;
+    }
+    t->chunks = chunks;
+
+    pid_t *pids = realloc(t->pids, capacity * sizeof(pid_t));
+    if (pids != NULL) {
+        t->pids = pids;
+    }
+    pstatus *statuses = realloc(t->statuses, capacity * sizeof(pstatus));
+    if (statuses != NULL) {
+        t->statuses = statuses;
+    }
+    uint32_t *generations = realloc(t->generations, capacity * sizeof(uint32_t));
+    if (generations != NULL) {
+        t->generations = generations;
+    }
+    uint32_t *free_ids = realloc(t->free_ids, capacity * sizeof(uint32_t));
+    if (free_ids != NULL) {
+        t->free_ids = free_ids;
+    }
+    if (!pids || !statuses || !generations || !free_ids) {
+        free(chunk);
+        return -1;
+    }
+
+    t->chunks[t->chunk_count++] = chunk;
+
+    /* Push new ids in reverse so that lower ids are handed out first */
+    for (size_t i = capacity; i > t->capacity; --i) {
+        uint32_t id = (uint32_t)(i - 1);
+        t->pids[id] = 0;
+        t->statuses[id] = UNUSED;
+        t->generations[id] = 1;
+        t->free_ids[t->free_count++] = id;
+    }
+    t->capacity = capacity;
+
+    return 0;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise an empty process table.
+ * 
+ * @param t Target table
+ */
+void pt_init(ptable *t) {
+    memset(t, 0, sizeof(ptable));
+}
+
+/**
+ * @brief Take a record from the pool.
+ * 
+ * Records are carved out of fixed-size chunks that never move, so a pointer
+ * to a record stays valid until it is released.
+ * 
+ * @param t Target table
+ * @param pid Pid of the new process
+ * @return process* Zeroed record with status UNUSED. NULL if out of memory
+ */
+process *pt_alloc(ptable *t, pid_t pid) {
+    if (t->free_count == 0 && pt_grow(t) < 0) {
+        return NULL;
+    }
+
+    uint32_t id = t->free_ids[--t->free_count];
+    process *p = pt_get(t, id);
+    memset(p, 0, sizeof(process));
+    p->id = id;
+    p->pidfd = -1;
+
+    t->pids[id] = pid;
+    t->size++;
+    return p;
+}
+
+/**
+ * @brief Return a record to the pool and invalidate handles to it.
+ * 
+ * @param t Target table
+ * @param p Record taken from t
+ */
+void pt_release(ptable *t, process *p) {
+    assert(t->pids[p->id] != 0);
+
+    t->pids[p->id] = 0;
+    t->statuses[p->id] = UNUSED;
+    t->generations[p->id]++;
+    t->free_ids[t->free_count++] = p->id;
+    t->size--;
+}
+
+/**
+ * @brief Get the record stored under an id.
+ * 
+ * @param t Target table
+ * @param id Record id below the table capacity
+ * @return process* Record, which may be unused
+ */
+process *pt_get(const ptable *t, uint32_t id) {
+    return &t->chunks[id / PTABLE_CHUNK_SIZE][id % PTABLE_CHUNK_SIZE];
+}
+
+/**
+ * @brief Make a generation-tagged handle to a record.
+ * 
+ * @param t Target table
+ * @param p Record in use
+ * @return phandle Handle to p
+ */
+phandle pt_handle(const ptable *t, const process *p) {
+    return (phandle)t->generations[p->id] << 32 | p->id;
+}
+
+/**
+ * @brief Resolve a handle back to its record.
+ * 
+ * @param t Target table
+ * @param h Handle returned by pt_handle()
+ * @return process* Record. NULL if it was released since
+ */
+process *pt_resolve(const ptable *t, phandle h) {
+    uint32_t id = (uint32_t)h;
+    uint32_t generation = (uint32_t)(h >> 32);
+
+    if (id >= t->capacity || t->generations[id] != generation) {
+        return NULL;
+    }
+    return pt_get(t, id);
+}
+
+/**
+ * @brief Release every record while keeping the allocated pool.
+ * 
+ * @param t Target table
+ */
+void pt_clear(ptable *t) {
+    for (size_t i = 0; i < t->capacity; ++i) {
+        if (t->pids[i] != 0) {
+            pt_release(t, pt_get(t, (uint32_t)i));
+        }
+    }
+}
+
+/**
+ * @brief Deallocate memory used by the table.
+ * 
+ * @param t Target table
+ */
+void pt_free(ptable *t) {
+    for (size_t i = 0; i < t->chunk_count; ++i) {
+        free(t->chunks[i]);
+    }
+    free(t->chunks);
+    free(t->pids);
+    free(t->statuses);
+    free(t->generations);
+    free(t->free_ids);
+    pt_init(t);
+}
@@ -0,0 +1,141 @@
+#ifndef PTABLE_H
+#define PTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "joblog.h"
+#include "procstat.h"
+
+typedef enum pstatus {
+    RUNNING,
+    READY,
+    STOPPED,
+    TERMINATED,
+    UNUSED,
+} pstatus;
+
+/**
+ * Reference to a process record that stays safe to hold after the record is
+ * reclaimed. The upper half is the generation of the record and the lower half
+ * its id, so a stale handle no longer resolves once the id is reused.
+ */
+typedef uint64_t phandle;
+
+/**
+ * Cold per-process data. The hot fields, pid and status, live in the table's
+ * compact arrays and are indexed by id.
+ */
+typedef struct process process;
+struct process {
+    uint32_t id;
+    int pidfd;
+    bool suspended;
+    bool frozen;
+    bool throttled;
+    bool adopted;       /* Taken over from a worker that died */
+    uint8_t level;
+    uint64_t ticket;
+    uint64_t priority;
+    size_t heap_index;
+    size_t slot;
+    int node;
+    long used_ms;
+    struct timespec dispatched_at;
+    struct timespec spawned_at;
+    uint64_t spawned_ns;    /* CLOCK_BOOTTIME at admission, names the job */
+    cgroup_job cgroup;
+    procstat probe;
+    joblog output;
+    proc_usage usage;
+    int cpu_percent;
+};
+
+typedef struct ptable {
+    pid_t *pids;
+    pstatus *statuses;
+    uint32_t *generations;
+
+    process **chunks;
+    size_t chunk_count;
+
+    uint32_t *free_ids;
+    size_t free_count;
+
+    size_t size;
+    size_t capacity;
+} ptable;
+
+/**
+ * @brief Initialise an empty process table.
+ * 
+ * @param t Target table
+ */
+void pt_init(ptable *t);
+
+/**
+ * @brief Take a record from the pool.
+ * 
+ * Records are carved out of fixed-size chunks that never move, so a pointer
+ * to a record stays valid until it is released.
+ * 
+ * @param t Target table
+ * @param pid Pid of the new process
+ * @return process* Zeroed record with status UNUSED. NULL if out of memory
+ */
+process *pt_alloc(ptable *t, pid_t pid);
+
+/**
+ * @brief Return a record to the pool and invalidate handles to it.
+ * 
+ * @param t Target table
+ * @param p Record taken from t
+ */
+void pt_release(ptable *t, process *p);
+
+/**
+ * @brief Get the record stored under an id.
+ * 
+ * @param t Target table
+ * @param id Record id below the table capacity
+ * @return process* Record, which may be unused
+ */
+process *pt_get(const ptable *t, uint32_t id);
+
+/**
+ * @brief Make a generation-tagged handle to a record.
+ * 
+ * @param t Target table
+ * @param p Record in use
+ * @return phandle Handle to p
+ */
+phandle pt_handle(const ptable *t, const process *p);
+
+/**
+ * @brief Resolve a handle back to its record.
+ * 
+ * @param t Target table
+ * @param h Handle returned by pt_handle()
+ * @return process* Record. NULL if it was released since
+ */
+process *pt_resolve(const ptable *t, phandle h);
+
+/**
+ * @brief Release every record while keeping the allocated pool.
+ * 
+ * @param t Target table
+ */
+void pt_clear(ptable *t);
+
+/**
+ * @brief Deallocate memory used by the table.
+ * 
+ * @param t Target table
+ */
+void pt_free(ptable *t);
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "reply.h"
+
+#define REPLY_INITIAL_CAPACITY 256
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Append formatted text to a reply.
+ * 
+ * @param r Target reply
+ * @param format printf() format
+ * @param args Format arguments
+ */
+static void reply_vprintf(reply *r, const char *format, va_list args) {
+    va_list retry;
+    va_copy(retry, args);
+
+    size_t available = r->capacity - r->length;
+    char *end = r->text != NULL ? r->text + r->length : NULL;
+    int len = vsnprintf(end, available, format, args);
+    if (len < 0) {
+        va_end(retry);
+        return;
+    }
+
+    /* Grow and format again if the text did not fit */
+    if ((size_t)len >= available) {
+        size_t capacity = r->capacity ? r->capacity : REPLY_INITIAL_CAPACITY;
+        while (capacity - r->length <= (size_t)len) {
+            capacity *= 2;
+        }
+
+        char *text = realloc(r->text, capacity);
+        if (text == NULL) {
+            va_end(retry);
+            return;
+        }
+        r->text = text;
+        r->capacity = capacity;
+        vsnprintf(r->text + r->length, capacity - r->length, format, retry);
+    }
+
+    r->length += (size_t)len;
+    va_end(retry);
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise an empty successful reply.
+ * 
+ * @param r Target reply
+ */
+void reply_init(reply *r) {
+    r->text = NULL;
+    r->capacity = 0;
+    reply_reset(r);
+}
+
+/**
+ * @brief Empty a reply for reuse while keeping its buffer.
+ * 
+ * @param r Target reply
+ */
+void reply_reset(reply *r) {
+    r->status = 0;
+    r->value = 0;
+    r->length = 0;
+    if (r->text != NULL) {
+        r->text[0] = '\0';
+    }
+}
+
+/**
+ * @brief Append formatted text to a reply.
+ * 
+ * @param r Target reply
+ * @param format printf() format
+ */
+void reply_printf(reply *r, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    reply_vprintf(r, format, args);
+    va_end(args);
+}
+
+/**
+ * @brief Mark a reply as failed and append a formatted message.
+ * 
+ * @param r Target reply
+ * @param format printf() format
+ */
+void reply_error(reply *r, const char *format, ...) {
+    r->status = -1;
+
+    va_list args;
+    va_start(args, format);
+    reply_vprintf(r, format, args);
+    va_end(args);
+}
+
+/**
+ * @brief Deallocate memory used by a reply.
+ * 
+ * @param r Target reply
+ */
+void reply_free(reply *r) {
+    free(r->text);
+    reply_init(r);
+}
@@ -0,0 +1,57 @@
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <stddef.h>
+
+/**
+ * Result of a command: a status, an optional value such as a new pid, and
+ * text to show to the user.
+ */
+typedef struct reply {
+    int status;
+    int value;
+    char *text;
+    size_t length;
+    size_t capacity;
+} reply;
+
+/**
+ * @brief Initialise an empty successful reply.
+ * 
+ * @param r Target reply
+ */
+void reply_init(reply *r);
+
+/**
+ * @brief Empty a reply for reuse while keeping its buffer.
+ * 
+ * @param r Target reply
+ */
+void reply_reset(reply *r);
+
+/**
+ * @brief Append formatted text to a reply.
+ * 
+ * @param r Target reply
+ * @param format printf() format
+ */
+void reply_printf(reply *r, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Mark a reply as failed and append a formatted message.
+ * 
+ * @param r Target reply
+ * @param format printf() format
+ */
+void reply_error(reply *r, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Deallocate memory used by a reply.
+ * 
+ * @param r Target reply
+ */
+void reply_free(reply *r);
+
+#endif
@@ -1,100 +1,1075 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <fcntl.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/prctl.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 #include "runner.h"
+#include "command.h"
 #include "input.h"
 #include "procman.h"
 
-#define COMMAND_STOP_WORKER "exit"
 #define BUFFER_SIZE 64
+#define MAX_EVENTS 8
+
+/* A worker that keeps dying before it replies is given up on */
+#define MAX_RESTARTS 8
 #define error(msg) do { perror("[error] " msg); } while (0);
 
+/* Fixed part of every reply sent from the worker to the shell */
+typedef struct reply_header {
+    uint64_t id;
+    int32_t status;
+    int32_t value;
+    uint32_t length;
+} reply_header;
+
 
 /******************************************************************************
  *                                 UTILITIES                                  * 
  ******************************************************************************/
 
 
+/**
+ * @brief Write a whole buffer to a blocking file descriptor.
+ * 
+ * @param fd Target file descriptor
+ * @param buffer Bytes to write
+ * @param size Number of bytes
+ * @return int 0 if successful. -1 otherwise
+ */
+static int write_exact(int fd, const void *buffer, size_t size) {
+    const char *iter = buffer;
+    while (size > 0) {
+        ssize_t written = write(fd, iter, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        iter += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read exactly a number of bytes from a blocking file descriptor.
+ * 
+ * @param fd Source file descriptor
+ * @param buffer Destination
+ * @param size Number of bytes
+ * @return int 0 if successful. -1 on error or end of file
+ */
+static int read_exact(int fd, void *buffer, size_t size) {
+    char *iter = buffer;
+    while (size > 0) {
+        ssize_t len = read(fd, iter, size);
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        iter += len;
+        size -= (size_t)len;
+    }
+    return 0;
+}
+
+/**
+ * @brief Queue the reply of a completed command for the shell.
+ * 
+ * Replies are only buffered here and written out by rn_flush_replies(), so
+ * the worker never blocks on a shell that is still busy sending commands.
+ * 
+ * @param context Target runner
+ * @param id Id of the completed command
+ * @param r Reply of the command
+ */
+static void rn_reply(void *context, uint64_t id, const reply *r) {
+    runner *rn = context;
+    reply_header header = {
+        .id = id,
+        .status = r->status,
+        .value = r->value,
+        .length = (uint32_t)r->length,
+    };
+
+    if (buffer_reserve(&rn->outbox, sizeof(header) + r->length) < 0) {
+        error("failed to queue reply");
+        return;
+    }
+    buffer_append(&rn->outbox, &header, sizeof(header));
+    buffer_append(&rn->outbox, r->text, r->length);
+}
+
+/**
+ * @brief Write as many queued replies as the reply pipe accepts.
+ * 
+ * The reply pipe is only watched for EPOLLOUT while replies are left over.
+ * 
+ * @param rn Target runner
+ */
+static void rn_flush_replies(runner *rn) {
+    buffer *out = &rn->outbox;
+    while (buffer_size(out) > 0) {
+        ssize_t written = write(rn->reply_fd, out->data + out->start,
+                                buffer_size(out));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                /* Shell is gone, nobody is left to read the replies */
+                buffer_consume(out, buffer_size(out));
+            }
+            break;
+        }
+        buffer_consume(out, (size_t)written);
+    }
+
+    bool is_blocked = buffer_size(out) > 0;
+    if (is_blocked != rn->reply_blocked) {
+        struct epoll_event ev = { .events = EPOLLOUT,
+                                  .data.fd = rn->reply_fd };
+        int op = is_blocked ? EPOLL_CTL_ADD : EPOLL_CTL_DEL;
+        if (epoll_ctl(rn->epoll_fd, op, rn->reply_fd, &ev) < 0) {
+            error("failed to watch reply pipe");
+        }
+        rn->reply_blocked = is_blocked;
+    }
+}
+
+/**
+ * @brief Read everything available on the command pipe and execute every
+ * complete frame.
+ * 
+ * A frame split across reads stays in the receive buffer until the rest of
+ * it arrives.
+ * 
+ * @param rn Target runner
+ * @return true The worker should keep running
+ * @return false The shell asked the worker to exit or closed the pipe
+ */
+static bool rn_receive_commands(runner *rn) {
+    buffer *in = &rn->commands.data;
+    if (reader_fill(&rn->commands) < 0) {
+        error("failed to read commands");
+    }
+
+    ssize_t size;
+    uint64_t id;
+    while ((size = command_decode(&rn->scratch, &id, in)) > 0) {
+        pm_execute(rn->pm, id, &rn->scratch);
+        buffer_consume(in, (size_t)size);
+        if (rn->scratch.op == OP_EXIT) {
+            return false;
+        }
+    }
+
+    if (size < 0 || rn->commands.eof) {
+        /* Shell is gone or garbled, stop as if it said goodbye */
+        if (size < 0) {
+            error("malformed command frame");
+        }
+        command exit_command = { .op = OP_EXIT };
+        pm_execute(rn->pm, rn->next_id++, &exit_command);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Create the epoll set the worker sleeps on.
+ * 
+ * The set contains the command pipe, a signalfd receiving SIGCHLD, a
+ * timerfd firing when the scheduling policy is next due and the process
+ * manager's own set of pidfds. SIGCHLD is blocked so that it is
+ * only delivered through the signalfd and SIGPIPE is ignored.
+ * 
+ * @param rn Target runner
+ * @return int 0 if successful. -1 otherwise
+ */
+static int rn_setup_events(runner *rn) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        return -1;
+    }
+
+    /* A vanished shell shows up as a failed write, not a fatal signal */
+    signal(SIGPIPE, SIG_IGN);
+
+    rn->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    rn->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    rn->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (rn->signal_fd < 0 || rn->timer_fd < 0 || rn->epoll_fd < 0) {
+        return -1;
+    }
+
+    int fds[] = {
+        rn->command_fd, rn->signal_fd, rn->timer_fd, pm_event_fd(rn->pm)
+    };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fds[i] };
+        if (epoll_ctl(rn->epoll_fd, EPOLL_CTL_ADD, fds[i], &ev) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Discard everything pending on a signalfd or timerfd.
+ * 
+ * The worker only needs to know that the event happened, the process manager
+ * will find out the details when it is run.
+ * 
+ * @param fd Non-blocking file descriptor to drain
+ */
+static void rn_drain_fd(int fd) {
+    char buffer[sizeof(struct signalfd_siginfo) * MAX_EVENTS];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+        continue;
+    }
+}
+
+/**
+ * @brief Arm the timer for the next time the process manager has periodic
+ * work due.
+ * 
+ * The timer stays disarmed while nothing is due, so an idle worker is only
+ * woken up by commands and child events.
+ * 
+ * @param rn Target runner
+ */
+static void rn_arm_timer(runner *rn) {
+    long timeout = pm_next_timeout(rn->pm);
+    struct itimerspec deadline = { 0 };
+    if (timeout >= 0) {
+        /* A zero value disarms the timer, so fire at the earliest instead */
+        deadline.it_value.tv_sec = timeout / 1000;
+        deadline.it_value.tv_nsec = timeout % 1000 * 1000000L + 1;
+    }
+
+    if (timerfd_settime(rn->timer_fd, 0, &deadline, NULL) < 0) {
+        error("failed to arm scheduling timer");
+    }
+}
+
 /**
  * @brief Start the main loop of a worker runner
  * 
+ * The worker sleeps until a command arrives, a child changes state or a
+ * quantum expires. Process management procedures are only run after
+ * one of those events.
+ * 
  * @param rn Target runner
  */
 static void rn_start_worker(runner *rn) {
+    struct epoll_event events[MAX_EVENTS];
     bool is_running = true;
+
     while (is_running) {
-        char *input = read_all(rn->pipe[0], BUFFER_SIZE, '\0');
-        if (input != NULL) {
-            pm_send_command(rn->pm, input);
-            is_running = strcmp(COMMAND_STOP_WORKER, input) != 0;
-            free(input);
+        int n = epoll_wait(rn->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno != EINTR) {
+                error("epoll_wait() failed");
+                break;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+
+            if (fd == rn->command_fd) {
+                is_running = rn_receive_commands(rn) && is_running;
+
+            } else if (fd == rn->signal_fd || fd == rn->timer_fd) {
+                rn_drain_fd(fd);
+            }
         }
+
         pm_run(rn->pm);
+        rn_flush_replies(rn);
+        rn_arm_timer(rn);
     }
     
-    close(rn->pipe[0]);
+    close(rn->epoll_fd);
+    close(rn->timer_fd);
+    close(rn->signal_fd);
+    close(rn->command_fd);
     pm_shutdown(rn->pm);
     free(rn->pm);
     rn->pm = NULL;
+
+    /* Hand over the last replies, waiting for the shell if needed */
+    int flags = fcntl(rn->reply_fd, F_GETFL);
+    fcntl(rn->reply_fd, F_SETFL, flags & ~O_NONBLOCK);
+    write_exact(rn->reply_fd, rn->outbox.data + rn->outbox.start,
+                buffer_size(&rn->outbox));
+    close(rn->reply_fd);
+    buffer_free(&rn->outbox);
+    reader_free(&rn->commands);
+    command_free(&rn->scratch);
+
+    if (rn->zygote.fd >= 0) {
+        zygote_stop(&rn->zygote);
+    }
+    if (rn->spawner.fd >= 0) {
+        spawner_stop(&rn->spawner);
+    }
 }
 
 
-/******************************************************************************
- *                             PUBLIC INTERFACE                               * 
- ******************************************************************************/
+/**
+ * @brief Pick the worker that runs a command.
+ * 
+ * Ids are handed out in sequence, so they are scattered with a
+ * multiplicative hash rather than dealt out in a fixed rotation.
+ * 
+ * @param rn Target runner
+ * @param id Id of the command
+ * @return size_t Index of the worker
+ */
+static size_t rn_shard_of(const runner *rn, uint64_t id) {
+    return (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 32) % rn->shard_count;
+}
+
+/**
+ * @brief Add an id to a list.
+ * 
+ * @param list Target list
+ * @param id Id to add
+ * @return int 0 if successful. -1 otherwise
+ */
+static int rn_ids_push(rn_ids *list, uint64_t id) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity > 0 ? list->capacity * 2 : 16;
+        uint64_t *ids = realloc(list->ids, capacity * sizeof(uint64_t));
+        if (ids == NULL) {
+            return -1;
+        }
+        list->ids = ids;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = id;
+    return 0;
+}
 
+/**
+ * @brief Remove an id from a list, keeping the others in order.
+ * 
+ * Replies mostly come back in the order the commands were sent, so the id
+ * is usually found first.
+ * 
+ * @param list Target list
+ * @param id Id to remove. No-op if it is not in the list
+ */
+static void rn_ids_remove(rn_ids *list, uint64_t id) {
+    for (size_t i = 0; i < list->count; ++i) {
+        if (list->ids[i] == id) {
+            memmove(&list->ids[i], &list->ids[i + 1],
+                    (list->count - i - 1) * sizeof(uint64_t));
+            list->count--;
+            return;
+        }
+    }
+}
 
 /**
- * @brief Initialise the runner with a corresponding background worker process
+ * @brief Start collecting the replies of a command sent to several workers.
  * 
  * @param rn Target runner
- * @param pm_max_running_processes Max number of running processes
+ * @param id Id of the command
+ * @param op Opcode of the command
+ * @param parts Number of workers the command is sent to
  * @return int 0 if successful. -1 otherwise
  */
-int rn_init(runner *rn, size_t pm_max_running_processes) {
-    rn->pm = NULL;
-    if (pipe(rn->pipe) < 0) {
+static int rn_add_merge(runner *rn, uint64_t id, opcode op, size_t parts) {
+    if (rn->merge_count == rn->merge_capacity) {
+        size_t capacity = rn->merge_capacity > 0 ? rn->merge_capacity * 2 : 8;
+        rn_merge *merges = realloc(rn->merges, capacity * sizeof(rn_merge));
+        if (merges == NULL) {
+            return -1;
+        }
+        rn->merges = merges;
+        rn->merge_capacity = capacity;
+    }
+
+    rn_merge *m = &rn->merges[rn->merge_count++];
+    m->id = id;
+    m->op = op;
+    m->remaining = parts;
+    m->has_reply = false;
+    m->is_owned = false;
+    reply_init(&m->r);
+    return 0;
+}
+
+/**
+ * @brief Find the replies being collected for a command.
+ * 
+ * @param rn Target runner
+ * @param id Id of the command
+ * @return rn_merge* Pending merge. NULL if the command went to one worker
+ */
+static rn_merge *rn_find_merge(runner *rn, uint64_t id) {
+    for (size_t i = 0; i < rn->merge_count; ++i) {
+        if (rn->merges[i].id == id) {
+            return &rn->merges[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fold the reply of one worker into the reply of a command.
+ * 
+ * Stop, kill, resume and logs go to every worker but only the ones that know
+ * the pid, which reply with it as value, have a meaningful answer. Every other
+ * command adds up the values and texts of all workers and fails if any of
+ * them failed.
+ * 
+ * @param m Target merge
+ * @param r Reply of one worker
+ */
+static void rn_merge_reply(rn_merge *m, const reply *r) {
+    bool is_owned = r->value != 0;
+    bool is_pid_command = m->op == OP_STOP || m->op == OP_KILL
+                       || m->op == OP_RESUME || m->op == OP_LOGS;
+
+    if (is_pid_command) {
+        if (m->is_owned || (m->has_reply && !is_owned)) {
+            return;
+        }
+        reply_reset(&m->r);
+        m->r.value = r->value;
+        m->is_owned = is_owned;
+    } else {
+        m->r.value += r->value;
+    }
+
+    if (r->status < 0) {
+        m->r.status = r->status;
+    }
+    reply_printf(&m->r, "%.*s", (int)r->length, r->text);
+    m->has_reply = true;
+}
+
+/**
+ * @brief Queue a command for the workers that have to run it.
+ * 
+ * A job array is split into one contiguous range of indices per worker,
+ * starting with the worker a single run would go to. Every command other
+ * than run is sent to all workers.
+ * 
+ * @param rn Target runner
+ * @param c Parsed command, modified for each part of a job array
+ * @param id Id of the command
+ * @return int 0 if successful. -1 otherwise
+ */
+static int rn_route(runner *rn, command *c, uint64_t id) {
+    size_t first = rn_shard_of(rn, id);
+    size_t parts = rn->shard_count;
+    if (c->op == OP_RUN && c->count < parts) {
+        parts = c->count;
+    }
+
+    /* Nothing can be sent once a worker is gone for good */
+    for (size_t i = 0; i < parts; ++i) {
+        if (rn->shards[(first + i) % rn->shard_count].command_fd < 0) {
+            errno = EPIPE;
+            return -1;
+        }
+    }
+
+    /* Every part has the same arguments, so its frame has the same size */
+    uint32_t count = c->count;
+    uint32_t index = 0;
+    size_t queued = 0;
+    size_t frame = 0;
+    for (; queued < parts; ++queued) {
+        if (c->op == OP_RUN) {
+            c->count = count / (uint32_t)parts + (queued < count % parts);
+            c->value = (int32_t)index;
+            index += c->count;
+        }
+
+        rn_shard *shard = &rn->shards[(first + queued) % rn->shard_count];
+        size_t size = buffer_size(&shard->outbox);
+        if (command_encode(c, id, &shard->outbox) < 0) {
+            break;
+        }
+        frame = buffer_size(&shard->outbox) - size;
+        if (rn_ids_push(&shard->pending, id) < 0) {
+            buffer_truncate(&shard->outbox, size);
+            break;
+        }
+    }
+
+    /* The merge comes last, a failed command must leave nothing behind to
+     * catch the replies of the next one, which gets the same id
+     */
+    if (queued == parts
+        && (parts == 1 || rn_add_merge(rn, id, c->op, parts) == 0)) {
+        return 0;
+    }
+    for (size_t i = 0; i < queued; ++i) {
+        rn_shard *shard = &rn->shards[(first + i) % rn->shard_count];
+        buffer_truncate(&shard->outbox, buffer_size(&shard->outbox) - frame);
+        shard->pending.count--;
+    }
+    return -1;
+}
+
+/**
+ * @brief Wait until a worker has a reply to read.
+ * 
+ * Workers are polled in rotation so a busy one can't starve the others.
+ * A worker that closed its reply pipe is returned as well, reading from it
+ * then fails.
+ * 
+ * @param rn Target runner
+ * @return rn_shard* Worker with a reply. NULL if every worker is gone
+ */
+static rn_shard *rn_wait_reply(runner *rn) {
+    if (rn->shard_count == 1) {
+        return rn->shards[0].reply_fd >= 0 ? &rn->shards[0] : NULL;
+    }
+
+    while (true) {
+        bool is_open = false;
+        for (size_t i = 0; i < rn->shard_count; ++i) {
+            rn->polls[i].fd = rn->shards[i].reply_fd;
+            rn->polls[i].events = POLLIN;
+            is_open = is_open || rn->shards[i].reply_fd >= 0;
+        }
+        if (!is_open) {
+            return NULL;
+        }
+
+        if (poll(rn->polls, rn->shard_count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NULL;
+        }
+
+        for (size_t i = 0; i < rn->shard_count; ++i) {
+            size_t index = (rn->next_poll + i) % rn->shard_count;
+            short revents = rn->polls[index].revents;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                rn->next_poll = index + 1;
+                return &rn->shards[index];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Read one reply from a worker.
+ * 
+ * @param shard Worker with a reply to read
+ * @param id Destination of the id of the replied input
+ * @param r Destination of the reply
+ * @return int 0 if successful. -1 otherwise
+ */
+static int rn_read_reply(rn_shard *shard, uint64_t *id, reply *r) {
+    reply_header header;
+    reply_reset(r);
+    if (read_exact(shard->reply_fd, &header, sizeof(header)) < 0) {
+        return -1;
+    }
+
+    char buffer[BUFFER_SIZE];
+    size_t remaining = header.length;
+    while (remaining > 0) {
+        size_t len = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        if (read_exact(shard->reply_fd, buffer, len) < 0) {
+            return -1;
+        }
+        reply_printf(r, "%.*s", (int)len, buffer);
+        remaining -= len;
+    }
+
+    *id = header.id;
+    r->status = header.status;
+    r->value = header.value;
+    return 0;
+}
+
+/**
+ * @brief Fork a worker running its own process manager.
+ * 
+ * @param rn Target runner
+ * @param shard Shell end of the new worker, every earlier worker is started
+ * @param config Configuration of the worker's process manager
+ * @return int 0 if successful. -1 otherwise
+ */
+static int rn_start_shard(runner *rn, rn_shard *shard, const pm_config *config) {
+    int pipe_fds[2];
+    int reply_fds[2];
+
+    /* Close-on-exec keeps managed programs from holding the pipes open */
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    if (pipe2(reply_fds, O_CLOEXEC) < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
         return -1;
     }
     
-    rn->worker_pid = fork();
-    switch (rn->worker_pid) {
+    shard->worker_pid = fork();
+    switch (shard->worker_pid) {
         case -1:
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+            close(reply_fds[0]);
+            close(reply_fds[1]);
             return -1;
 
         case 0: /* Initialise background worker process */
+            /* Other workers must see the shell leave, not us */
+            for (size_t i = 0; i < rn->shard_count; ++i) {
+                rn_shard *other = &rn->shards[i];
+                if (other != shard && other->command_fd >= 0) {
+                    close(other->command_fd);
+                }
+                if (other != shard && other->reply_fd >= 0) {
+                    close(other->reply_fd);
+                }
+            }
+            signal(SIGPIPE, SIG_DFL);
+            close(pipe_fds[1]);
+            close(reply_fds[0]);
+            rn->command_fd = pipe_fds[0];
+            rn->reply_fd = reply_fds[1];
+
+            /* Fork-server goes first while the worker image is smallest */
+            rn->zygote.fd = -1;
+            if (config->fork_server && zygote_start(&rn->zygote) < 0) {
+                error("failed to start fork-server");
+                exit(EXIT_FAILURE);
+            }
+
             rn->pm = malloc(sizeof(procman));
-            pm_init(rn->pm, pm_max_running_processes);
+            pm_init(rn->pm, config);
+            if (config->fork_server) {
+                pm_use_zygote(rn->pm, &rn->zygote);
+            }
+            pm_set_reply_handler(rn->pm, rn_reply, rn);
+
+            /* Setup non-blocking command read-end and reply write-end */
+            fcntl(rn->command_fd, F_SETFL, O_NONBLOCK);
+            fcntl(rn->reply_fd, F_SETFL, O_NONBLOCK);
+            reader_init(&rn->commands, rn->command_fd);
+
+            if (rn_setup_events(rn) < 0) {
+                error("failed to setup worker events");
+                exit(EXIT_FAILURE);
+            }
 
-            /* Setup non-blocking pipe read-end */
-            close(rn->pipe[1]);
-            fcntl(rn->pipe[0], F_SETFL, O_NONBLOCK);
+            /* Threads come last so they inherit the blocked SIGCHLD */
+            rn->spawner.fd = -1;
+            if (!config->fork_server && config->spawner_threads > 0) {
+                if (spawner_start(&rn->spawner,
+                                  config->spawner_threads) < 0) {
+                    error("failed to start spawner threads");
+                    exit(EXIT_FAILURE);
+                }
+                pm_use_spawner(rn->pm, &rn->spawner);
+            }
 
             rn_start_worker(rn);
             exit(EXIT_SUCCESS);
 
         default: /* Prepare pipe write-end */
-            close(rn->pipe[0]);
+            close(pipe_fds[0]);
+            close(reply_fds[1]);
+            shard->command_fd = pipe_fds[1];
+            shard->reply_fd = reply_fds[0];
             return 0;
     }
 }
 
 /**
- * @brief Send input to the process runner
+ * @brief Check whether a worker may still read the exit of a job.
+ * 
+ * A worker that took over a job reads its exit status from /proc while it is
+ * a zombie, and journals the exit once it has.
+ * 
+ * @param rn Target runner
+ * @param pid Child of the shell
+ * @return true The journal of a worker that runs or is being restarted lists
+ * the job as live, or could not be read
+ */
+static bool rn_is_tracked(const runner *rn, pid_t pid) {
+    for (size_t i = 0; i < rn->shard_count; ++i) {
+        const rn_shard *shard = &rn->shards[i];
+        if (shard->command_fd < 0 || shard->journal_path == NULL) {
+            continue;
+        }
+
+        journal_entry *jobs;
+        ssize_t count = journal_load(shard->journal_path, &jobs);
+        bool found = count < 0;
+        for (ssize_t j = 0; j < count && !found; ++j) {
+            found = jobs[j].pid == pid;
+        }
+        free(jobs);
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Collect exited children of the shell that no worker needs.
+ * 
+ * As a subreaper the shell inherits the jobs of workers that died and
+ * whatever jobs leave behind. Zombies are collected oldest first. This stops
+ * at a job a worker has not read the exit of yet, or at a worker not known
+ * to be dead yet, and goes on from there on a later call.
+ * 
+ * @param rn Target runner
+ */
+static void rn_reap_orphans(runner *rn) {
+    if (rn->shard_count == 0 || rn->shards[0].journal_path == NULL) {
+        return;
+    }
+
+    while (true) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0
+            || info.si_pid == 0) {
+            return;
+        }
+
+        /* Dead workers are collected once their replies have been read */
+        for (size_t i = 0; i < rn->shard_count; ++i) {
+            if (rn->shards[i].worker_pid == info.si_pid) {
+                return;
+            }
+        }
+        if (rn_is_tracked(rn, info.si_pid)) {
+            return;
+        }
+        waitid(P_PID, (id_t)info.si_pid, &info, WEXITED | WNOHANG);
+    }
+}
+
+/**
+ * @brief Handle a worker that closed its reply pipe.
+ * 
+ * Commands it had not replied to fail. A worker with a journal is replaced
+ * by a new one that takes over its jobs, unless it keeps dying before it
+ * replies. Otherwise no more commands are sent to it.
+ * 
+ * @param rn Target runner
+ * @param shard Worker that closed its reply pipe
+ */
+static void rn_lose_shard(runner *rn, rn_shard *shard) {
+    close(shard->reply_fd);
+    close(shard->command_fd);
+    shard->reply_fd = -1;
+    shard->command_fd = -1;
+    buffer_consume(&shard->outbox, buffer_size(&shard->outbox));
+    waitpid(shard->worker_pid, NULL, 0);
+
+    for (size_t i = 0; i < shard->pending.count; ++i) {
+        if (rn_ids_push(&rn->lost, shard->pending.ids[i]) < 0) {
+            error("failed to fail commands of lost worker");
+        }
+    }
+    shard->pending.count = 0;
+
+    if (shard->journal_path == NULL || shard->restarts == MAX_RESTARTS) {
+        return;
+    }
+
+    shard->restarts++;
+    shard->config.restarted = true;
+    if (rn_start_shard(rn, shard, &shard->config) < 0) {
+        error("failed to restart worker");
+    }
+}
+
+/**
+ * @brief Get the part of a total that goes to one worker.
  * 
+ * @param total Amount to split
+ * @param parts Number of workers
+ * @param index Index of the worker
+ * @return size_t Share of the worker. Shares of all workers add up to total
+ */
+static size_t rn_share(size_t total, size_t parts, size_t index) {
+    return total / parts + (index < total % parts);
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Initialise the runner with its background worker processes
+ * 
+ * The running slots of the configuration are split between the workers.
+ * Runs are spread over them by id and every other command goes to all of
+ * them, with the replies merged into one.
+ * 
+ * With a journal directory, every worker journals its jobs and a worker
+ * that dies is replaced by one that takes them over. The shell then stays
+ * the parent of jobs whose worker died.
+ * 
+ * @param rn Target runner
+ * @param config Configuration of the process managers of all workers
+ * @param shard_count Number of workers, at most one per running slot
+ * @param journal_dir Existing directory holding one journal per worker.
+ * NULL to leave the jobs of a worker that dies unmanaged
+ * @return int 0 if successful. -1 otherwise
+ */
+int rn_init(runner *rn, const pm_config *config, size_t shard_count,
+            const char *journal_dir) {
+    size_t slots = config->max_running_processes;
+    if (shard_count > slots) {
+        shard_count = slots;
+    }
+    if (shard_count == 0) {
+        shard_count = 1;
+    }
+
+    rn->pm = NULL;
+    rn->next_id = 0;
+    rn->shard_count = 0;
+    rn->next_poll = 0;
+    rn->merges = NULL;
+    rn->merge_count = 0;
+    rn->merge_capacity = 0;
+    rn->lost.ids = NULL;
+    rn->lost.count = 0;
+    rn->lost.capacity = 0;
+    rn->pool = NULL;
+    rn->reply_blocked = false;
+    buffer_init(&rn->outbox);
+    command_init(&rn->scratch);
+    args_init(&rn->words);
+
+    rn->shards = calloc(shard_count, sizeof(rn_shard));
+    rn->polls = calloc(shard_count, sizeof(struct pollfd));
+    if (rn->shards == NULL || rn->polls == NULL) {
+        return -1;
+    }
+
+    /* Idle workers lend their slots to busy ones through shared memory */
+    if (shard_count > 1 && (rn->pool = slot_pool_create()) == NULL) {
+        return -1;
+    }
+
+    /* Jobs of a worker that dies come to the shell rather than init, and a
+     * write to its command pipe fails rather than killing the shell
+     */
+    if (journal_dir != NULL) {
+        if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0) {
+            return -1;
+        }
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    size_t first_slot = 0;
+    for (size_t i = 0; i < shard_count; ++i) {
+        pm_config shard_config = *config;
+        shard_config.max_running_processes = rn_share(slots, shard_count, i);
+        if (config->min_running_processes > 0) {
+            size_t min = rn_share(config->min_running_processes, shard_count, i);
+            shard_config.min_running_processes = min > 0 ? min : 1;
+        }
+        shard_config.pool = rn->pool;
+        shard_config.first_slot = first_slot;
+        shard_config.shared_slots = slots;
+
+        rn_shard *shard = &rn->shards[i];
+        buffer_init(&shard->outbox);
+        if (journal_dir != NULL) {
+            if (asprintf(&shard->journal_path, "%s/worker-%zu.journal",
+                         journal_dir, i) < 0) {
+                shard->journal_path = NULL;
+                return -1;
+            }
+            shard_config.journal_path = shard->journal_path;
+        }
+        shard->config = shard_config;
+
+        if (rn_start_shard(rn, shard, &shard->config) < 0) {
+            return -1;
+        }
+        rn->shard_count++;
+        first_slot += shard_config.max_running_processes;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Queue input for the workers without sending it.
+ * 
+ * Input is parsed here, so empty or invalid input is answered right away
+ * and never reaches a worker.
+ * 
+ * @param rn Target runner
  * @param input String input
+ * @param id Destination of the id the reply will carry
+ * @param r Destination of the reply when the input is answered right away
+ * @return int 1 if queued, 0 if answered right away, -1 on error
+ */
+int rn_submit(runner *rn, const char *input, uint64_t *id, reply *r) {
+    reply_reset(r);
+    if (args_parse(&rn->words, input) < 0) {
+        reply_error(r, "%s\n", errno == EINVAL ? "Unterminated quote or escape"
+                                               : strerror(errno));
+        return 0;
+    }
+
+    int result = 0;
+    if (command_parse(&rn->scratch, &rn->words, r)) {
+        *id = rn->next_id;
+        result = rn_route(rn, &rn->scratch, rn->next_id);
+        if (result == 0) {
+            rn->next_id++;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Send every queued input to the workers in as few writes as possible.
+ * 
+ * @param rn Target runner
  * @return int 0 if successful. -1 otherwise
  */
-int rn_send_input(runner *rn, const char *input) {
-    if (write(rn->pipe[1], input, strlen(input) + 1) < 0) {
+int rn_flush(runner *rn) {
+    for (size_t i = 0; i < rn->shard_count; ++i) {
+        rn_shard *shard = &rn->shards[i];
+        size_t size = buffer_size(&shard->outbox);
+        if (size == 0) {
+            continue;
+        }
+
+        /* A dead worker may still have replies to read. The commands it
+         * never got fail once those run out. Only seen with a journal,
+         * otherwise SIGPIPE ends the shell
+         */
+        if (write_exact(shard->command_fd, shard->outbox.data
+                        + shard->outbox.start, size) < 0 && errno != EPIPE) {
+            return -1;
+        }
+        buffer_consume(&shard->outbox, size);
+    }
+    return 0;
+}
+
+/**
+ * @brief Wait for the next reply from the workers.
+ * 
+ * Replies mostly arrive in the order their inputs were sent, except for runs
+ * launched through a fork-server and inputs handled by different workers.
+ * A reply merged from several workers is returned once all of them replied.
+ * Inputs a worker did not reply to before it died fail.
+ * 
+ * @param rn Target runner
+ * @param id Destination of the id of the replied input
+ * @param r Destination of the reply
+ * @return int 0 if successful. -1 otherwise
+ */
+int rn_receive(runner *rn, uint64_t *id, reply *r) {
+    while (true) {
+        if (rn->lost.count > 0) {
+            *id = rn->lost.ids[0];
+            rn_ids_remove(&rn->lost, *id);
+            reply_reset(r);
+            reply_error(r, "Worker exited before replying\n");
+        } else {
+            rn_shard *shard = rn_wait_reply(rn);
+            if (shard == NULL) {
+                return -1;
+            }
+            if (rn_read_reply(shard, id, r) < 0) {
+                rn_lose_shard(rn, shard);
+                continue;
+            }
+            rn_ids_remove(&shard->pending, *id);
+            shard->restarts = 0;
+            rn_reap_orphans(rn);
+        }
+
+        rn_merge *m = rn_find_merge(rn, *id);
+        if (m == NULL) {
+            return 0;
+        }
+
+        rn_merge_reply(m, r);
+        if (--m->remaining > 0) {
+            continue;
+        }
+
+        /* Hand the merged reply over and drop the merge */
+        reply done = *r;
+        *r = m->r;
+        reply_free(&done);
+        *m = rn->merges[--rn->merge_count];
+        return 0;
+    }
+}
+
+/**
+ * @brief Send input to the process runner and wait for it to be applied
+ * 
+ * @param rn Target runner
+ * @param input String input
+ * @param r Destination of the reply to the input
+ * @return int 0 if successful. -1 otherwise
+ */
+int rn_send_input(runner *rn, const char *input, reply *r) {
+    uint64_t id;
+    int queued = rn_submit(rn, input, &id, r);
+    if (queued <= 0) {
+        return queued;
+    }
+    if (rn_flush(rn) < 0) {
         return -1;
     }
-    
+
+    /* Replies carry the id of their command, skip any that are not ours */
+    uint64_t reply_id;
+    do {
+        if (rn_receive(rn, &reply_id, r) < 0) {
+            return -1;
+        }
+    } while (reply_id != id);
+
     return 0;
 }
 
@@ -105,12 +1080,45 @@ int rn_send_input(runner *rn, const char *input) {
  * @return int 
  */
 int rn_free(runner *rn) {
-    if (close(rn->pipe[1]) < 0) {
-        error("failed to close pipe");
-        return -1;
+    /* Workers exit on their own once their command pipe is closed */
+    int result = 0;
+    for (size_t i = 0; i < rn->shard_count; ++i) {
+        if (rn->shards[i].command_fd >= 0
+            && close(rn->shards[i].command_fd) < 0) {
+            error("failed to close pipe");
+            result = -1;
+        }
     }
-    
-    rn_send_input(rn, COMMAND_STOP_WORKER);
-    waitpid(rn->worker_pid, NULL, 0);
-    return 0;
+
+    for (size_t i = 0; i < rn->shard_count; ++i) {
+        rn_shard *shard = &rn->shards[i];
+        waitpid(shard->worker_pid, NULL, 0);
+        shard->command_fd = -1;
+        if (shard->reply_fd >= 0) {
+            close(shard->reply_fd);
+        }
+    }
+
+    /* No worker is left to read the exit of any job */
+    rn_reap_orphans(rn);
+
+    for (size_t i = 0; i < rn->shard_count; ++i) {
+        rn_shard *shard = &rn->shards[i];
+        buffer_free(&shard->outbox);
+        free(shard->pending.ids);
+        free(shard->journal_path);
+    }
+
+    for (size_t i = 0; i < rn->merge_count; ++i) {
+        reply_free(&rn->merges[i].r);
+    }
+    free(rn->merges);
+    free(rn->lost.ids);
+    free(rn->shards);
+    free(rn->polls);
+    slot_pool_destroy(rn->pool);
+    buffer_free(&rn->outbox);
+    command_free(&rn->scratch);
+    args_free(&rn->words);
+    return result;
 }
@@ -1,30 +1,145 @@
 #ifndef RUNNER_H
 #define RUNNER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <poll.h>
+
+#include "argparse.h"
+#include "buffer.h"
+#include "command.h"
+#include "input.h"
 #include "procman.h"
+#include "reply.h"
+#include "slotpool.h"
+#include "spawner.h"
+#include "zygote.h"
+
+/**
+ * Ids of commands waiting for a reply.
+ */
+typedef struct rn_ids {
+    uint64_t *ids;
+    size_t count;
+    size_t capacity;
+} rn_ids;
+
+/**
+ * Shell end of one worker. Every worker runs its own process manager over
+ * its shard of the jobs and its share of the running slots.
+ */
+typedef struct rn_shard {
+    int command_fd;     /* -1 once the worker is gone for good */
+    int reply_fd;       /* -1 once the worker has closed it */
+    pid_t worker_pid;
+    buffer outbox;      /* Frames to send */
+    rn_ids pending;     /* Commands sent and not replied to */
+    pm_config config;   /* Restarts the worker if it has a journal */
+    char *journal_path;
+    size_t restarts;    /* Restarts since the worker last replied */
+} rn_shard;
+
+/**
+ * Reply to a command sent to several workers, complete once all of them
+ * have replied.
+ */
+typedef struct rn_merge {
+    uint64_t id;
+    opcode op;
+    size_t remaining;
+    bool has_reply;
+    bool is_owned;      /* A worker managing the target pid has replied */
+    reply r;
+} rn_merge;
 
 typedef struct runner {
-    int pipe[2];
-    int worker_pid;
+    rn_shard *shards;   /* Shell: one per worker */
+    size_t shard_count;
+    struct pollfd *polls;
+    size_t next_poll;
+    rn_merge *merges;
+    size_t merge_count;
+    size_t merge_capacity;
+    rn_ids lost;        /* Shell: commands whose worker died first */
+    slot_pool *pool;
+    uint64_t next_id;
+    int command_fd;     /* Worker: ends of its own pipes */
+    int reply_fd;
+    int epoll_fd;
+    int signal_fd;
+    int timer_fd;
+    reader commands;    /* Worker: received frames not executed yet */
+    buffer outbox;      /* Worker: replies to send */
+    bool reply_blocked;
+    command scratch;
+    args words;         /* Shell: words of the input being submitted */
+    zygote zygote;
+    spawner spawner;
     procman *pm;
 } runner;
 
 /**
- * @brief Initialise the runner with a corresponding background worker process
+ * @brief Initialise the runner with its background worker processes
+ * 
+ * The running slots of the configuration are split between the workers.
+ * Runs are spread over them by id and every other command goes to all of
+ * them, with the replies merged into one.
+ * 
+ * With a journal directory, every worker journals its jobs and a worker
+ * that dies is replaced by one that takes them over. The shell then stays
+ * the parent of jobs whose worker died.
+ * 
+ * @param rn Target runner
+ * @param config Configuration of the process managers of all workers
+ * @param shard_count Number of workers, at most one per running slot
+ * @param journal_dir Existing directory holding one journal per worker.
+ * NULL to leave the jobs of a worker that dies unmanaged
+ * @return int 0 if successful. -1 otherwise
+ */
+int rn_init(runner *rn, const pm_config *config, size_t shard_count,
+            const char *journal_dir);
+
+/**
+ * @brief Queue input for the worker without sending it.
+ * 
+ * Input is parsed here, so empty or invalid input is answered right away
+ * and never reaches the worker.
+ * 
+ * @param rn Target runner
+ * @param input String input
+ * @param id Destination of the id the reply will carry
+ * @param r Destination of the reply when the input is answered right away
+ * @return int 1 if queued, 0 if answered right away, -1 on error
+ */
+int rn_submit(runner *rn, const char *input, uint64_t *id, reply *r);
+
+/**
+ * @brief Send every queued input to the worker in as few writes as possible.
+ * 
+ * @param rn Target runner
+ * @return int 0 if successful. -1 otherwise
+ */
+int rn_flush(runner *rn);
+
+/**
+ * @brief Wait for the next reply from the worker.
  * 
  * @param rn Target runner
- * @param pm_max_running_processes Max number of running processes
+ * @param id Destination of the id of the replied input
+ * @param r Destination of the reply
  * @return int 0 if successful. -1 otherwise
  */
-int rn_init(runner *rn, size_t pm_max_running_processes);
+int rn_receive(runner *rn, uint64_t *id, reply *r);
 
 /**
- * @brief Send input to the process runner
+ * @brief Send input to the process runner and wait for it to be applied
  * 
+ * @param rn Target runner
  * @param input String input
+ * @param r Destination of the reply to the input
  * @return int 0 if successful. -1 otherwise
  */
-int rn_send_input(runner *rn, const char *input);
+int rn_send_input(runner *rn, const char *input, reply *r);
 
 /**
  * @brief Free resources used by runner
@@ -0,0 +1,169 @@
+#include <string.h>
+#include <stddef.h>
+
+#include "sched.h"
+
+#define MLFQ_LEVELS 3
+#define MLFQ_BOOST_INTERVAL_MS 2000
+
+/* Bits of an MLFQ priority below the level */
+#define MLFQ_LEVEL_SHIFT 48
+
+
+/******************************************************************************
+ *                                   FIFO                                     * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Order processes by the time they were spawned.
+ * 
+ * @param p Target process
+ * @param sequence Unused
+ * @return uint64_t Ticket of the process
+ */
+static uint64_t fifo_priority(const process *p, uint64_t sequence) {
+    (void)sequence;
+    return p->ticket;
+}
+
+const sched_policy sched_fifo = {
+    .name = "fifo",
+    .priority = fifo_priority,
+    .quantum = NULL,
+    .expire = NULL,
+    .boost = NULL,
+    .boost_interval = 0,
+};
+
+
+/******************************************************************************
+ *                                ROUND-ROBIN                                 * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Order processes by the last time they were queued.
+ * 
+ * @param p Unused
+ * @param sequence Time the process was queued
+ * @return uint64_t The sequence number
+ */
+static uint64_t rr_priority(const process *p, uint64_t sequence) {
+    (void)p;
+    return sequence;
+}
+
+/**
+ * @brief Give every process the same quantum.
+ * 
+ * @param p Unused
+ * @param base_ms Configured quantum
+ * @return long The configured quantum
+ */
+static long rr_quantum(const process *p, long base_ms) {
+    (void)p;
+    return base_ms;
+}
+
+/**
+ * @brief Nothing to do, the new priority alone sends a process to the back.
+ * 
+ * @param p Unused
+ */
+static void rr_expire(process *p) {
+    (void)p;
+}
+
+const sched_policy sched_rr = {
+    .name = "rr",
+    .priority = rr_priority,
+    .quantum = rr_quantum,
+    .expire = rr_expire,
+    .boost = NULL,
+    .boost_interval = 0,
+};
+
+
+/******************************************************************************
+ *                                   MLFQ                                     * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Order processes by level, then round-robin within a level.
+ * 
+ * @param p Target process
+ * @param sequence Time the process entered its level
+ * @return uint64_t Priority with the level in the upper bits
+ */
+static uint64_t mlfq_priority(const process *p, uint64_t sequence) {
+    return (uint64_t)p->level << MLFQ_LEVEL_SHIFT | sequence;
+}
+
+/**
+ * @brief Get the quantum of the level of a process.
+ * 
+ * @param p Target process
+ * @param base_ms Quantum of the top level
+ * @return long Milliseconds, doubling on every level
+ */
+static long mlfq_quantum(const process *p, long base_ms) {
+    return base_ms << p->level;
+}
+
+/**
+ * @brief Move a process that used up its quantum down a level.
+ * 
+ * Processes on the bottom level stay there and rotate round-robin.
+ * 
+ * @param p Target process
+ */
+static void mlfq_expire(process *p) {
+    if (p->level < MLFQ_LEVELS - 1) {
+        p->level++;
+    }
+}
+
+/**
+ * @brief Move a process back to the top level.
+ * 
+ * @param p Target process
+ */
+static void mlfq_boost(process *p) {
+    p->level = 0;
+}
+
+const sched_policy sched_mlfq = {
+    .name = "mlfq",
+    .priority = mlfq_priority,
+    .quantum = mlfq_quantum,
+    .expire = mlfq_expire,
+    .boost = mlfq_boost,
+    .boost_interval = MLFQ_BOOST_INTERVAL_MS,
+};
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Find a policy by name.
+ * 
+ * @param name Name of the policy
+ * @return const sched_policy* Matching policy. NULL if there is none
+ */
+const sched_policy *sched_find(const char *name) {
+    static const sched_policy *const policies[] = {
+        &sched_fifo, &sched_rr, &sched_mlfq
+    };
+
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i) {
+        if (!strcmp(policies[i]->name, name)) {
+            return policies[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+#include "ptable.h"
+
+/**
+ * Scheduling policy of a process manager. The policy only decides the
+ * priority of each process, the process manager keeps the highest priority
+ * processes running and preempts the others.
+ */
+typedef struct sched_policy {
+    const char *name;
+
+    /* Priority key of a process entering the queues, lower runs first. The
+     * sequence number grows with every call
+     */
+    uint64_t (*priority)(const process *p, uint64_t sequence);
+
+    /* Milliseconds a process may run before it expires, given the configured
+     * base quantum. NULL for no limit
+     */
+    long (*quantum)(const process *p, long base_ms);
+
+    /* Called when a running process has used up its quantum */
+    void (*expire)(process *p);
+
+    /* Called on every process each boost interval. NULL to never boost */
+    void (*boost)(process *p);
+    long boost_interval;
+} sched_policy;
+
+/* Earliest spawned processes run first and keep running until they stop */
+extern const sched_policy sched_fifo;
+
+/* Processes take turns running for one quantum each */
+extern const sched_policy sched_rr;
+
+/* Multi-level feedback queue. Processes start at the top level and move down
+ * a level each time they use up their quantum, which doubles on every level
+ * starting from the base quantum.
+ * Everything is moved back to the top periodically
+ */
+extern const sched_policy sched_mlfq;
+
+/**
+ * @brief Find a policy by name.
+ * 
+ * @param name Name of the policy
+ * @return const sched_policy* Matching policy. NULL if there is none
+ */
+const sched_policy *sched_find(const char *name);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#include "slotpool.h"
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Create an empty pool in memory shared with forked children.
+ * 
+ * @return slot_pool* New pool. NULL on error
+ */
+slot_pool *slot_pool_create(void) {
+    slot_pool *pool = mmap(NULL, sizeof(slot_pool), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (pool == MAP_FAILED) {
+        return NULL;
+    }
+
+    atomic_init(&pool->spare, 0);
+    atomic_init(&pool->wanted, 0);
+    return pool;
+}
+
+/**
+ * @brief Put slots into the pool.
+ * 
+ * @param pool Target pool
+ * @param count Number of slots
+ */
+void slot_pool_give(slot_pool *pool, size_t count) {
+    atomic_fetch_add(&pool->spare, (long)count);
+}
+
+/**
+ * @brief Take back a slot the caller gave to the pool.
+ * 
+ * @param pool Target pool
+ * @return true A slot was taken
+ * @return false The pool is empty
+ */
+bool slot_pool_reclaim(slot_pool *pool) {
+    long spare = atomic_load(&pool->spare);
+    while (spare > 0) {
+        if (atomic_compare_exchange_weak(&pool->spare, &spare, spare - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Borrow a slot of another worker.
+ * 
+ * Slots their owners are waiting for can't be borrowed.
+ * 
+ * @param pool Target pool
+ * @return true A slot was borrowed
+ * @return false No slot is free to borrow
+ */
+bool slot_pool_borrow(slot_pool *pool) {
+    long spare = atomic_load(&pool->spare);
+    while (spare > atomic_load(&pool->wanted)) {
+        if (atomic_compare_exchange_weak(&pool->spare, &spare, spare - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check whether owners are waiting for slots that are still lent.
+ * 
+ * @param pool Target pool
+ * @return true Borrowers should give their slots back
+ * @return false Every owner can take its slots back
+ */
+bool slot_pool_is_short(const slot_pool *pool) {
+    return atomic_load(&pool->spare) < atomic_load(&pool->wanted);
+}
+
+/**
+ * @brief Change the number of slots owners are waiting for.
+ * 
+ * @param pool Target pool
+ * @param delta Slots now wanted minus slots wanted before
+ */
+void slot_pool_want(slot_pool *pool, long delta) {
+    atomic_fetch_add(&pool->wanted, delta);
+}
+
+/**
+ * @brief Release the pool.
+ * 
+ * @param pool Target pool
+ */
+void slot_pool_destroy(slot_pool *pool) {
+    if (pool != NULL) {
+        munmap(pool, sizeof(slot_pool));
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef SLOTPOOL_H
+#define SLOTPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Running slots lent out by idle workers, shared by every worker of a runner.
+ * A worker gives away the slots of its share it is not using and takes them
+ * back when it has processes waiting. Busy workers may borrow spare slots as
+ * long as no owner wants theirs back.
+ */
+typedef struct slot_pool {
+    _Atomic long spare;
+    _Atomic long wanted;
+} slot_pool;
+
+/**
+ * @brief Create an empty pool in memory shared with forked children.
+ * 
+ * @return slot_pool* New pool. NULL on error
+ */
+slot_pool *slot_pool_create(void);
+
+/**
+ * @brief Put slots into the pool.
+ * 
+ * @param pool Target pool
+ * @param count Number of slots
+ */
+void slot_pool_give(slot_pool *pool, size_t count);
+
+/**
+ * @brief Take back a slot the caller gave to the pool.
+ * 
+ * @param pool Target pool
+ * @return true A slot was taken
+ * @return false The pool is empty
+ */
+bool slot_pool_reclaim(slot_pool *pool);
+
+/**
+ * @brief Borrow a slot of another worker.
+ * 
+ * Slots their owners are waiting for can't be borrowed.
+ * 
+ * @param pool Target pool
+ * @return true A slot was borrowed
+ * @return false No slot is free to borrow
+ */
+bool slot_pool_borrow(slot_pool *pool);
+
+/**
+ * @brief Check whether owners are waiting for slots that are still lent.
+ * 
+ * @param pool Target pool
+ * @return true Borrowers should give their slots back
+ * @return false Every owner can take its slots back
+ */
+bool slot_pool_is_short(const slot_pool *pool);
+
+/**
+ * @brief Change the number of slots owners are waiting for.
+ * 
+ * @param pool Target pool
+ * @param delta Slots now wanted minus slots wanted before
+ */
+void slot_pool_want(slot_pool *pool, long delta);
+
+/**
+ * @brief Release the pool.
+ * 
+ * @param pool Target pool
+ */
+void slot_pool_destroy(slot_pool *pool);
+
+#endif
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sched.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+#define SPAWN_STACK_SIZE (64 * 1024)
+
+/* Stack the child needs besides the copy of argv glibc makes to run scripts
+ * without a shebang through /bin/sh. The same reserve posix_spawn uses
+ */
+#define SPAWN_STACK_RESERVE (32 * 1024)
+
+typedef struct spawn_context {
+    char *const *argv;
+    int cgroup_fd;
+    int output_fd;
+    int error;
+} spawn_context;
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Prepare the child for executing the program.
+ * 
+ * Only async-signal-safe calls are made, as the caller may be a copy of a
+ * multithreaded process.
+ * 
+ * @param ctx The spawn_context of the caller
+ * @return int 0 if successful. -1 with errno set otherwise
+ */
+static int spawn_prepare(const spawn_context *ctx) {
+    /* Do not leak signals blocked or ignored by the worker into the program.
+     * Handlers are not shared without CLONE_SIGHAND, so this is safe.
+     */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    signal(SIGPIPE, SIG_DFL);
+
+    /* Own process group so the whole job tree can be signaled at once */
+    setpgid(0, 0);
+
+    /* Enter the job's cgroup before the program can fork anything */
+    if (ctx->cgroup_fd >= 0 && write(ctx->cgroup_fd, "0", 1) < 0) {
+        return -1;
+    }
+
+    /* dup2() clears close-on-exec on the copies only */
+    if (ctx->output_fd >= 0
+        && (dup2(ctx->output_fd, STDOUT_FILENO) < 0
+            || dup2(ctx->output_fd, STDERR_FILENO) < 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Entry point of the child until it executes the program.
+ * 
+ * Runs on a borrowed stack in the caller's address space, so it must not do
+ * anything beyond preparing and calling exec.
+ * 
+ * @param arg The spawn_context of the caller
+ * @return int Never returns on success
+ */
+static int spawn_child(void *arg) {
+    spawn_context *ctx = arg;
+
+    if (spawn_prepare(ctx) == 0) {
+        execvp(ctx->argv[0], ctx->argv);
+    }
+
+    /* Memory is shared, the caller reads this as soon as we exit */
+    ctx->error = errno;
+    _exit(127);
+}
+
+/**
+ * @brief Launch a program in a child that waits for SIGCONT before executing
+ * it.
+ * 
+ * The child is a copy of the caller, so the caller can return while the
+ * child waits. SIGCONT stays blocked until it arrives, so one sent as soon as
+ * the caller knows the pid is not lost. Setup errors travel back through a
+ * pipe the child closes once it waits. An exec error is only known once the
+ * child is continued, and is then printed by the child before it exits with
+ * status 127.
+ * 
+ * @param ctx The spawn_context of the caller
+ * @param pidfd Destination of a pidfd referring to the child
+ * @return pid_t Pid of the waiting child. -1 with errno set on failure
+ */
+static pid_t spawn_held(spawn_context *ctx, int *pidfd) {
+    int error_pipe[2];
+    if (pipe2(error_pipe, O_CLOEXEC) < 0) {
+        return -1;
+    }
+
+    struct clone_args args;
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_PIDFD;
+    args.pidfd = (uint64_t)(uintptr_t)pidfd;
+    args.exit_signal = SIGCHLD;
+
+    long pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) {
+        close(error_pipe[0]);
+        if (spawn_prepare(ctx) < 0) {
+            int error = errno;
+            ssize_t written = write(error_pipe[1], &error, sizeof(error));
+            (void)written;
+            _exit(127);
+        }
+        sigset_t start;
+        sigemptyset(&start);
+        sigaddset(&start, SIGCONT);
+        sigprocmask(SIG_BLOCK, &start, NULL);
+
+        /* Exec would close these anyway, but the wait can be long and other
+         * launches must see their pipes close. This includes the error pipe
+         */
+        close_range(3, ~0U, 0);
+
+        /* Nothing of the program runs until the manager continues us */
+        int sig;
+        while (sigwait(&start, &sig) != 0) {
+            continue;
+        }
+        sigprocmask(SIG_UNBLOCK, &start, NULL);
+        execvp(ctx->argv[0], ctx->argv);
+
+        /* Unlike strerror(), this never touches the locale */
+        const char *reason = strerrordesc_np(errno);
+        if (reason == NULL) {
+            reason = "unknown error";
+        }
+        struct iovec iov[] = {
+            { .iov_base = "error running ", .iov_len = 14 },
+            { .iov_base = ctx->argv[0], .iov_len = strlen(ctx->argv[0]) },
+            { .iov_base = ": ", .iov_len = 2 },
+            { .iov_base = (char *)reason, .iov_len = strlen(reason) },
+            { .iov_base = "\n", .iov_len = 1 },
+        };
+        ssize_t written = writev(STDERR_FILENO, iov, 5);
+        (void)written;
+        _exit(127);
+    }
+
+    int saved = errno;
+    close(error_pipe[1]);
+    if (pid < 0) {
+        close(error_pipe[0]);
+        errno = saved;
+        return -1;
+    }
+
+    /* Nothing to read means the child got as far as waiting */
+    int error;
+    ssize_t n = read(error_pipe[0], &error, sizeof(error));
+    close(error_pipe[0]);
+    if (n == sizeof(error)) {
+        /* Collect the failed child so it does not linger as a zombie */
+        siginfo_t info;
+        waitid(P_PIDFD, (id_t)*pidfd, &info, WEXITED);
+        close(*pidfd);
+        *pidfd = -1;
+        errno = error;
+        return -1;
+    }
+
+    return (pid_t)pid;
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Launch a program in a new child process.
+ * 
+ * A child that runs right away shares the caller's memory and the caller is
+ * suspended until the child has either executed the program or failed to, so
+ * exec errors are reported to the caller directly. A suspended child waits
+ * for SIGCONT before executing the program and only reports setup errors,
+ * since it would otherwise hold the caller up until it is continued.
+ * 
+ * @param argv Program and its arguments. Last item must be NULL
+ * @param pidfd Destination of a pidfd referring to the child
+ * @param cgroup_fd Writable cgroup.procs the child moves itself into before
+ * executing the program. -1 to stay in the caller's cgroup
+ * @param output_fd Descriptor the child's stdout and stderr are redirected
+ * to. -1 to inherit the caller's
+ * @param suspended Hold the child back before it executes the program, until
+ * it is sent SIGCONT
+ * @return pid_t Pid of the running or waiting child. -1 with errno set if
+ * the child could not be created or could not execute the program
+ */
+pid_t spawn_process(char *const argv[], int *pidfd, int cgroup_fd,
+                    int output_fd, bool suspended) {
+    spawn_context ctx = {
+        .argv = argv,
+        .cgroup_fd = cgroup_fd,
+        .output_fd = output_fd,
+        .error = 0,
+    };
+    if (suspended) {
+        return spawn_held(&ctx, pidfd);
+    }
+
+    size_t argc = 0;
+    while (argv[argc] != NULL) {
+        argc++;
+    }
+    size_t stack_size = SPAWN_STACK_RESERVE + (argc + 2) * sizeof(char *);
+
+    /* Caller is suspended while the child runs, so its stack can be lent.
+     * Long argument lists get a stack of their own, sized like posix_spawn
+     */
+    _Alignas(16) char local_stack[SPAWN_STACK_SIZE];
+    char *stack = local_stack;
+    if (stack_size > sizeof(local_stack)) {
+        stack_size = (stack_size + 15) & ~(size_t)15;
+        stack = mmap(NULL, stack_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (stack == MAP_FAILED) {
+            return -1;
+        }
+    } else {
+        stack_size = sizeof(local_stack);
+    }
+
+    pid_t pid = clone(spawn_child, stack + stack_size,
+                      CLONE_VM | CLONE_VFORK | CLONE_PIDFD | SIGCHLD,
+                      &ctx, pidfd);
+    int saved = errno;
+    if (stack != local_stack) {
+        munmap(stack, stack_size);
+    }
+    if (pid < 0) {
+        errno = saved;
+        return -1;
+    }
+
+    if (ctx.error != 0) {
+        /* Collect the failed child so it does not linger as a zombie */
+        siginfo_t info;
+        waitid(P_PIDFD, (id_t)*pidfd, &info, WEXITED);
+        close(*pidfd);
+        *pidfd = -1;
+        errno = ctx.error;
+        return -1;
+    }
+
+    return pid;
+}
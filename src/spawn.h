@@ -0,0 +1,30 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <stdbool.h>
+#include <unistd.h>
+
+/**
+ * @brief Launch a program in a new child process.
+ * 
+ * A child that runs right away shares the caller's memory and the caller is
+ * suspended until the child has either executed the program or failed to, so
+ * exec errors are reported to the caller directly. A suspended child waits
+ * for SIGCONT before executing the program and only reports setup errors,
+ * since it would otherwise hold the caller up until it is continued.
+ * 
+ * @param argv Program and its arguments. Last item must be NULL
+ * @param pidfd Destination of a pidfd referring to the child
+ * @param cgroup_fd Writable cgroup.procs the child moves itself into before
+ * executing the program. -1 to stay in the caller's cgroup
+ * @param output_fd Descriptor the child's stdout and stderr are redirected
+ * to. -1 to inherit the caller's
+ * @param suspended Hold the child back before it executes the program, until
+ * it is sent SIGCONT
+ * @return pid_t Pid of the running or waiting child. -1 with errno set if
+ * the child could not be created or could not execute the program
+ */
+pid_t spawn_process(char *const argv[], int *pidfd, int cgroup_fd,
+                    int output_fd, bool suspended);
+
+#endif
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+
+#include "spawn.h"
+#include "spawner.h"
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Copy an argument vector into a single allocation.
+ * 
+ * @param argv Program and its arguments. Last item must be NULL
+ * @return char** Copy freed with a single free(). NULL if out of memory
+ */
+static char **spawner_copy_argv(char *const argv[]) {
+    size_t argc = 0;
+    size_t size = 0;
+    while (argv[argc] != NULL) {
+        size += strlen(argv[argc++]) + 1;
+    }
+
+    char **copy = malloc((argc + 1) * sizeof(char *) + size);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    char *text = (char *)(copy + argc + 1);
+    for (size_t i = 0; i < argc; ++i) {
+        size_t length = strlen(argv[i]) + 1;
+        copy[i] = memcpy(text, argv[i], length);
+        text += length;
+    }
+    copy[argc] = NULL;
+    return copy;
+}
+
+/**
+ * @brief Hand a finished launch back to the owner.
+ * 
+ * Pushing onto the stack never waits on other threads, whichever of them is
+ * pushing and whether or not the owner is emptying it.
+ * 
+ * @param s Target pool
+ * @param request Finished launch
+ */
+static void spawner_finish(spawner *s, spawn_request *request) {
+    spawn_request *head = atomic_load_explicit(&s->finished,
+                                               memory_order_relaxed);
+    do {
+        request->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&s->finished, &head,
+                                                    request,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+
+    /* Only fails if the counter is about to overflow, still readable then */
+    uint64_t one = 1;
+    ssize_t written = write(s->fd, &one, sizeof(one));
+    (void)written;
+}
+
+/**
+ * @brief Launch queued programs until the pool is stopped.
+ * 
+ * @param arg The pool the thread belongs to
+ * @return void* Always NULL
+ */
+static void *spawner_thread(void *arg) {
+    spawner *s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (s->pending_head == NULL && !s->stopping) {
+            pthread_cond_wait(&s->wake, &s->lock);
+        }
+
+        /* Queued launches are finished before stopping */
+        spawn_request *request = s->pending_head;
+        if (request == NULL) {
+            break;
+        }
+        s->pending_head = request->next;
+        if (s->pending_head == NULL) {
+            s->pending_tail = NULL;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        /* Only the child keeps the write end once it has been launched */
+        int output[2] = { -1, -1 };
+        if (request->capture_output && pipe2(output, O_CLOEXEC) < 0) {
+            output[0] = output[1] = -1;
+        }
+
+        /* Whether the child may run is only known once it is admitted */
+        request->pid = spawn_process(request->argv, &request->pidfd,
+                                     request->procs_fd, output[1], true);
+        request->error = request->pid < 0 ? errno : 0;
+        if (request->procs_fd >= 0) {
+            close(request->procs_fd);
+            request->procs_fd = -1;
+        }
+        if (output[1] >= 0) {
+            close(output[1]);
+        }
+        if (request->pid < 0 && output[0] >= 0) {
+            close(output[0]);
+            output[0] = -1;
+        }
+        request->output_fd = output[0];
+        spawner_finish(s, request);
+
+        pthread_mutex_lock(&s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Take every finished launch off the shared stack.
+ * 
+ * @param s Target pool with no collected launches left
+ */
+static void spawner_collect(spawner *s) {
+    /* Reset the counter first, so a launch pushed after the stack is taken
+     * makes the descriptor readable again
+     */
+    uint64_t count;
+    ssize_t received = read(s->fd, &count, sizeof(count));
+    (void)received;
+
+    spawn_request *request = atomic_exchange_explicit(&s->finished, NULL,
+                                                      memory_order_acquire);
+
+    /* The stack holds the latest launch first */
+    while (request != NULL) {
+        spawn_request *next = request->next;
+        request->next = s->collected;
+        s->collected = request;
+        request = next;
+    }
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Start the threads of the pool.
+ * 
+ * Threads inherit the signal mask of the caller, which should already block
+ * every signal the owner consumes through a descriptor.
+ * 
+ * @param s Target pool
+ * @param thread_count Number of launching threads
+ * @return int 0 if successful. -1 otherwise
+ */
+int spawner_start(spawner *s, size_t thread_count) {
+    s->threads = calloc(thread_count, sizeof(pthread_t));
+    s->thread_count = 0;
+    s->pending_head = NULL;
+    s->pending_tail = NULL;
+    s->stopping = false;
+    atomic_init(&s->finished, NULL);
+    s->collected = NULL;
+    s->in_flight = 0;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+
+    s->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->fd < 0 || s->threads == NULL) {
+        spawner_stop(s);
+        return -1;
+    }
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        if (pthread_create(&s->threads[i], NULL, spawner_thread, s) != 0) {
+            spawner_stop(s);
+            return -1;
+        }
+        s->thread_count++;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Queue a launch without waiting for it.
+ * 
+ * @param s Target pool
+ * @param argv Program and its arguments, copied by the pool. Last item must
+ * be NULL
+ * @param procs_fd Writable cgroup.procs the child moves itself into, closed
+ * by the pool. -1 to stay in the caller's cgroup
+ * @param capture_output Connect the child's stdout and stderr to a new pipe
+ * @param cgroup Cgroup handed back with the result
+ * @param tag Value handed back with the result
+ * @return int 0 if the launch was queued. -1 with errno set otherwise
+ */
+int spawner_request(spawner *s, char *const argv[], int procs_fd,
+                    bool capture_output, const cgroup_job *cgroup,
+                    uint64_t tag) {
+    spawn_request *request = malloc(sizeof(spawn_request));
+    char **copy = spawner_copy_argv(argv);
+    if (request == NULL || copy == NULL) {
+        free(request);
+        free(copy);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    request->next = NULL;
+    request->argv = copy;
+    request->procs_fd = procs_fd;
+    request->capture_output = capture_output;
+    request->output_fd = -1;
+    request->cgroup = *cgroup;
+    request->tag = tag;
+    request->pid = -1;
+    request->pidfd = -1;
+    request->error = 0;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->pending_tail != NULL) {
+        s->pending_tail->next = request;
+    } else {
+        s->pending_head = request;
+    }
+    s->pending_tail = request;
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+
+    s->in_flight++;
+    return 0;
+}
+
+/**
+ * @brief Collect the result of a finished launch.
+ * 
+ * Results of launches queued together come back in request order as long as
+ * a single thread serves them, and in completion order otherwise.
+ * 
+ * @param s Target pool
+ * @param reply Destination. On success pid and pidfd refer to the launched
+ * child, which waits for SIGCONT before executing the program, and
+ * output_fd, if not -1, to the read end of its output pipe.
+ * Otherwise error is set and both are -1. argv must be freed, cgroup and tag
+ * are the ones given with the request
+ * @param block Wait for a result if none is available yet
+ * @return int 1 if a result was collected. 0 if none was available. -1 on error
+ */
+int spawner_receive(spawner *s, spawner_reply *reply, bool block) {
+    while (s->collected == NULL && s->in_flight > 0) {
+        spawner_collect(s);
+        if (s->collected != NULL || !block) {
+            break;
+        }
+
+        struct pollfd pfd = { .fd = s->fd, .events = POLLIN };
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+
+    spawn_request *request = s->collected;
+    if (request == NULL) {
+        return 0;
+    }
+    s->collected = request->next;
+    s->in_flight--;
+
+    reply->pid = request->pid;
+    reply->pidfd = request->pidfd;
+    reply->output_fd = request->output_fd;
+    reply->error = request->error;
+    reply->argv = request->argv;
+    reply->cgroup = request->cgroup;
+    reply->tag = request->tag;
+    free(request);
+    return 1;
+}
+
+/**
+ * @brief Finish queued launches and stop the threads.
+ * 
+ * Results not received yet are discarded, with their children left running.
+ * 
+ * @param s Target pool
+ */
+void spawner_stop(spawner *s) {
+    pthread_mutex_lock(&s->lock);
+    s->stopping = true;
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+
+    for (size_t i = 0; i < s->thread_count; ++i) {
+        pthread_join(s->threads[i], NULL);
+    }
+    free(s->threads);
+    s->threads = NULL;
+    s->thread_count = 0;
+
+    spawner_reply reply;
+    while (s->fd >= 0 && spawner_receive(s, &reply, false) > 0) {
+        if (reply.pidfd >= 0) {
+            close(reply.pidfd);
+        }
+        if (reply.output_fd >= 0) {
+            close(reply.output_fd);
+        }
+        free(reply.argv);
+    }
+
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+}
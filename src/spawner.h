@@ -0,0 +1,115 @@
+#ifndef SPAWNER_H
+#define SPAWNER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+
+/**
+ * Launch handed to the pool. Owned by the pool from the request until the
+ * result is received.
+ */
+typedef struct spawn_request {
+    struct spawn_request *next;
+    char **argv;
+    int procs_fd;
+    bool capture_output;
+    int output_fd;
+    cgroup_job cgroup;
+    uint64_t tag;
+    pid_t pid;
+    int pidfd;
+    int error;
+} spawn_request;
+
+/**
+ * Pool of threads launching programs on behalf of a single owner thread, so
+ * the owner never waits for a launch. Requests are taken from a queue shared
+ * by the threads and results come back through a lock-free stack that only
+ * the owner empties. The descriptor becomes readable when results are ready.
+ */
+typedef struct spawner {
+    int fd;
+    pthread_t *threads;
+    size_t thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    spawn_request *pending_head;    /* Guarded by lock */
+    spawn_request *pending_tail;
+    bool stopping;
+    _Atomic(spawn_request *) finished;
+    spawn_request *collected;       /* Owner: finished, oldest first */
+    size_t in_flight;               /* Owner: requests not received yet */
+} spawner;
+
+typedef struct spawner_reply {
+    pid_t pid;
+    int pidfd;
+    int output_fd;
+    int error;
+    char **argv;
+    cgroup_job cgroup;
+    uint64_t tag;
+} spawner_reply;
+
+/**
+ * @brief Start the threads of the pool.
+ * 
+ * Threads inherit the signal mask of the caller, which should already block
+ * every signal the owner consumes through a descriptor.
+ * 
+ * @param s Target pool
+ * @param thread_count Number of launching threads
+ * @return int 0 if successful. -1 otherwise
+ */
+int spawner_start(spawner *s, size_t thread_count);
+
+/**
+ * @brief Queue a launch without waiting for it.
+ * 
+ * @param s Target pool
+ * @param argv Program and its arguments, copied by the pool. Last item must
+ * be NULL
+ * @param procs_fd Writable cgroup.procs the child moves itself into, closed
+ * by the pool. -1 to stay in the caller's cgroup
+ * @param capture_output Connect the child's stdout and stderr to a new pipe
+ * @param cgroup Cgroup handed back with the result
+ * @param tag Value handed back with the result
+ * @return int 0 if the launch was queued. -1 with errno set otherwise
+ */
+int spawner_request(spawner *s, char *const argv[], int procs_fd,
+                    bool capture_output, const cgroup_job *cgroup,
+                    uint64_t tag);
+
+/**
+ * @brief Collect the result of a finished launch.
+ * 
+ * Results of launches queued together come back in request order as long as
+ * a single thread serves them, and in completion order otherwise.
+ * 
+ * @param s Target pool
+ * @param reply Destination. On success pid and pidfd refer to the launched
+ * child, which waits for SIGCONT before executing the program, and
+ * output_fd, if not -1, to the read end of its output pipe.
+ * Otherwise error is set and both are -1. argv must be freed, cgroup and tag
+ * are the ones given with the request
+ * @param block Wait for a result if none is available yet
+ * @return int 1 if a result was collected. 0 if none was available. -1 on error
+ */
+int spawner_receive(spawner *s, spawner_reply *reply, bool block);
+
+/**
+ * @brief Finish queued launches and stop the threads.
+ * 
+ * Results not received yet are discarded, with their children left running.
+ * 
+ * @param s Target pool
+ */
+void spawner_stop(spawner *s);
+
+#endif
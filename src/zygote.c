@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "zygote.h"
+
+#define ZYGOTE_MAX_REQUEST (32 * 1024)
+
+/* Every argument takes at least its NUL, so no request can hold more */
+#define ZYGOTE_MAX_ARGS (ZYGOTE_MAX_REQUEST - 1)
+
+/* Request flag asking for the output of the child to be captured */
+#define ZYGOTE_CAPTURE_OUTPUT 0x1
+
+
+/******************************************************************************
+ *                                 UTILITIES                                  * 
+ ******************************************************************************/
+
+
+typedef struct launch_result {
+    pid_t pid;
+    int error;
+} launch_result;
+
+/**
+ * @brief Launch a program as a sibling of the server.
+ * 
+ * CLONE_PARENT makes the caller of the server the parent of the child, so it
+ * can wait for the child as usual. The child waits for SIGCONT before
+ * executing the program, since whether it may run is only known once the
+ * caller admits it. SIGCONT stays blocked until then, so it is not lost if
+ * it comes early. Setup errors travel back through a pipe the child closes
+ * once it waits, exec errors are printed by the child once it is continued.
+ * 
+ * @param argv Program and its arguments. Last item must be NULL
+ * @param pidfd Destination of a pidfd referring to the child. -1 if no child
+ * @param output_fd Descriptor the child's stdout and stderr are redirected
+ * to. -1 to inherit the server's
+ * @return launch_result Pid of the waiting child and 0, or an errno value
+ */
+static launch_result zygote_launch(char *const argv[], int *pidfd,
+                                   int output_fd) {
+    launch_result result = { .pid = -1, .error = 0 };
+    *pidfd = -1;
+
+    int error_pipe[2];
+    if (pipe2(error_pipe, O_CLOEXEC) < 0) {
+        result.error = errno;
+        return result;
+    }
+
+    struct clone_args args;
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_PARENT | CLONE_PIDFD;
+    args.pidfd = (uint64_t)(uintptr_t)pidfd;
+    /* Left 0 as CLONE_PARENT reuses the server's own SIGCHLD exit signal */
+    args.exit_signal = 0;
+
+    long pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) {
+        /* Own process group so the whole job tree can be signaled at once */
+        setpgid(0, 0);
+        if (output_fd >= 0 && (dup2(output_fd, STDOUT_FILENO) < 0
+                               || dup2(output_fd, STDERR_FILENO) < 0)) {
+            int error = errno;
+            ssize_t written = write(error_pipe[1], &error, sizeof(error));
+            (void)written;
+            _exit(127);
+        }
+        sigset_t start;
+        sigemptyset(&start);
+        sigaddset(&start, SIGCONT);
+        sigprocmask(SIG_BLOCK, &start, NULL);
+
+        /* Exec would close these anyway, but the wait can be long and other
+         * launches must see their pipes close. This includes the error pipe
+         */
+        close_range(3, ~0U, 0);
+
+        /* Nothing of the program runs until the caller continues us */
+        int sig;
+        while (sigwait(&start, &sig) != 0) {
+            continue;
+        }
+        sigprocmask(SIG_UNBLOCK, &start, NULL);
+        execvp(argv[0], argv);
+        dprintf(STDERR_FILENO, "error running %s: %s\n", argv[0],
+                strerror(errno));
+        _exit(127);
+    }
+
+    close(error_pipe[1]);
+    if (pid < 0) {
+        result.error = errno;
+    } else {
+        result.pid = (pid_t)pid;
+
+        /* Nothing to read means the child got as far as waiting */
+        int error;
+        if (read(error_pipe[0], &error, sizeof(error)) == sizeof(error)) {
+            result.error = error;
+        }
+    }
+    close(error_pipe[0]);
+
+    return result;
+}
+
+/**
+ * @brief Main loop of the server process.
+ * 
+ * Each request is one packet holding a flags byte followed by NUL separated
+ * arguments. Each reply is a launch_result with the pidfd of the child
+ * attached, followed by the read end of its output pipe when the output is
+ * captured.
+ * 
+ * @param fd Server end of the socket
+ */
+_Noreturn static void zygote_main(int fd) {
+    static char buffer[ZYGOTE_MAX_REQUEST + 1];
+    static char *argv[ZYGOTE_MAX_ARGS + 1];
+
+    ssize_t len;
+    while ((len = recv(fd, buffer, ZYGOTE_MAX_REQUEST, 0)) > 1) {
+        buffer[len] = '\0';
+
+        size_t argc = 0;
+        for (char *iter = buffer + 1;
+             iter < buffer + len && argc < ZYGOTE_MAX_ARGS;
+             iter += strlen(iter) + 1) {
+            argv[argc++] = iter;
+        }
+        argv[argc] = NULL;
+
+        /* Only the child keeps the write end once it has been launched */
+        int fds[2] = { -1, -1 };
+        int output[2] = { -1, -1 };
+        if ((buffer[0] & ZYGOTE_CAPTURE_OUTPUT)
+            && pipe2(output, O_CLOEXEC) < 0) {
+            output[0] = output[1] = -1;
+        }
+
+        launch_result result = zygote_launch(argv, &fds[0], output[1]);
+        if (output[1] >= 0) {
+            close(output[1]);
+        }
+        if (result.error == 0) {
+            fds[1] = output[0];
+        } else if (output[0] >= 0) {
+            close(output[0]);
+        }
+        size_t fd_count = fds[0] < 0 ? 0 : (fds[1] < 0 ? 1 : 2);
+
+        struct iovec iov = { .iov_base = &result, .iov_len = sizeof(result) };
+        union {
+            char buf[CMSG_SPACE(sizeof(fds))];
+            struct cmsghdr align;
+        } control;
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+        if (fd_count > 0) {
+            msg.msg_control = control.buf;
+            msg.msg_controllen = CMSG_SPACE(fd_count * sizeof(int));
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(fd_count * sizeof(int));
+            memcpy(CMSG_DATA(cmsg), fds, fd_count * sizeof(int));
+        }
+
+        bool sent = sendmsg(fd, &msg, 0) >= 0;
+        for (size_t i = 0; i < fd_count; ++i) {
+            close(fds[i]);
+        }
+        if (!sent) {
+            break;
+        }
+    }
+
+    _exit(EXIT_SUCCESS);
+}
+
+
+/******************************************************************************
+ *                             PUBLIC INTERFACE                               * 
+ ******************************************************************************/
+
+
+/**
+ * @brief Fork the server process.
+ * 
+ * Should be called as early as possible so the server image stays small.
+ * 
+ * @param z Target handle
+ * @return int 0 if successful. -1 otherwise
+ */
+int zygote_start(zygote *z) {
+    memset(z, 0, sizeof(zygote));
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        return -1;
+    }
+
+    z->pid = fork();
+    switch (z->pid) {
+    case -1:
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+
+    case 0: {
+        /* Keep nothing but the socket and the standard streams */
+        int fd = fds[1];
+        if (fd != 3) {
+            dup2(fd, 3);
+            fd = 3;
+        }
+        close_range(4, ~0U, 0);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
+        zygote_main(fd);
+    }
+
+    default:
+        close(fds[1]);
+        z->fd = fds[0];
+        return 0;
+    }
+}
+
+/**
+ * @brief Ask the server to launch a program without waiting for the result.
+ * 
+ * @param z Target handle with fewer than ZYGOTE_MAX_IN_FLIGHT launches in flight
+ * @param argv Program and its arguments. Last item must be NULL
+ * @param capture_output Connect the child's stdout and stderr to a new pipe
+ * @param tag Value handed back with the result
+ * @return int 0 if the request was sent. -1 with errno set otherwise
+ */
+int zygote_request(zygote *z, char *const argv[], bool capture_output,
+                   uint64_t tag) {
+    char buffer[ZYGOTE_MAX_REQUEST];
+    size_t len = 1;
+
+    buffer[0] = capture_output ? ZYGOTE_CAPTURE_OUTPUT : 0;
+
+    for (char *const *arg = argv; *arg != NULL; ++arg) {
+        size_t arg_len = strlen(*arg) + 1;
+        if (len + arg_len > sizeof(buffer)) {
+            errno = E2BIG;
+            return -1;
+        }
+        memcpy(buffer + len, *arg, arg_len);
+        len += arg_len;
+    }
+
+    if (send(z->fd, buffer, len, 0) < 0) {
+        return -1;
+    }
+
+    /* Replies come back in request order */
+    struct zygote_pending *pending =
+        &z->pending[(z->pending_head + z->in_flight) % ZYGOTE_MAX_IN_FLIGHT];
+    pending->program = strdup(argv[0]);
+    pending->tag = tag;
+    z->in_flight++;
+    return 0;
+}
+
+/**
+ * @brief Collect the result of the oldest launch in flight.
+ * 
+ * @param z Target handle
+ * @param reply Destination. On success pid and pidfd refer to the launched
+ * child, which waits for SIGCONT before executing the program, and
+ * output_fd, if not -1, to the read end of its output pipe. Otherwise
+ * error is set and pidfd, if not -1, refers to a child that failed to start
+ * and still has to be reaped. program must be freed and tag is
+ * the one given with the request
+ * @param block Wait for a result if none is available yet
+ * @return int 1 if a result was collected. 0 if none was available. -1 on error
+ */
+int zygote_receive(zygote *z, zygote_reply *reply, bool block) {
+    if (z->in_flight == 0) {
+        return 0;
+    }
+
+    launch_result result;
+    struct iovec iov = { .iov_base = &result, .iov_len = sizeof(result) };
+    int fds[2] = { -1, -1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    ssize_t len = recvmsg(z->fd, &msg, MSG_CMSG_CLOEXEC | (block ? 0 : MSG_DONTWAIT));
+    if (len < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    if (len != sizeof(result)) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_type == SCM_RIGHTS) {
+        size_t fd_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg),
+               (fd_count < 2 ? fd_count : 2) * sizeof(int));
+    }
+
+    reply->pid = result.pid;
+    reply->error = result.error;
+    reply->pidfd = fds[0];
+    reply->output_fd = fds[1];
+
+    reply->program = z->pending[z->pending_head].program;
+    reply->tag = z->pending[z->pending_head].tag;
+    z->pending_head = (z->pending_head + 1) % ZYGOTE_MAX_IN_FLIGHT;
+    z->in_flight--;
+    return 1;
+}
+
+/**
+ * @brief Shut the server down and wait for it to exit.
+ * 
+ * @param z Target handle
+ */
+void zygote_stop(zygote *z) {
+    if (z->fd >= 0) {
+        close(z->fd);
+        z->fd = -1;
+    }
+    if (z->pid > 0) {
+        waitpid(z->pid, NULL, 0);
+        z->pid = 0;
+    }
+
+    while (z->in_flight > 0) {
+        free(z->pending[z->pending_head].program);
+        z->pending_head = (z->pending_head + 1) % ZYGOTE_MAX_IN_FLIGHT;
+        z->in_flight--;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define ZYGOTE_MAX_IN_FLIGHT 64
+
+/**
+ * Handle to a fork-server. The server is a small helper process forked before
+ * the caller grows, which launches programs on its behalf. Launched programs
+ * are made children of the caller, not of the server.
+ */
+typedef struct zygote {
+    int fd;
+    pid_t pid;
+    struct zygote_pending {
+        char *program;
+        uint64_t tag;
+    } pending[ZYGOTE_MAX_IN_FLIGHT];
+    size_t pending_head;
+    size_t in_flight;
+} zygote;
+
+typedef struct zygote_reply {
+    pid_t pid;
+    int pidfd;
+    int output_fd;
+    int error;
+    char *program;
+    uint64_t tag;
+} zygote_reply;
+
+/**
+ * @brief Fork the server process.
+ * 
+ * Should be called as early as possible so the server image stays small.
+ * 
+ * @param z Target handle
+ * @return int 0 if successful. -1 otherwise
+ */
+int zygote_start(zygote *z);
+
+/**
+ * @brief Ask the server to launch a program without waiting for the result.
+ * 
+ * @param z Target handle with fewer than ZYGOTE_MAX_IN_FLIGHT launches in flight
+ * @param argv Program and its arguments. Last item must be NULL
+ * @param capture_output Connect the child's stdout and stderr to a new pipe
+ * @param tag Value handed back with the result
+ * @return int 0 if the request was sent. -1 with errno set otherwise
+ */
+int zygote_request(zygote *z, char *const argv[], bool capture_output,
+                   uint64_t tag);
+
+/**
+ * @brief Collect the result of the oldest launch in flight.
+ * 
+ * @param z Target handle
+ * @param reply Destination. On success pid and pidfd refer to the launched
+ * child, which waits for SIGCONT before executing the program, and
+ * output_fd, if not -1, to the read end of its output pipe. Otherwise
+ * error is set and pidfd, if not -1, refers to a child that failed to start
+ * and still has to be reaped. program must be freed and tag is
+ * the one given with the request
+ * @param block Wait for a result if none is available yet
+ * @return int 1 if a result was collected. 0 if none was available. -1 on error
+ */
+int zygote_receive(zygote *z, zygote_reply *reply, bool block);
+
+/**
+ * @brief Shut the server down and wait for it to exit.
+ * 
+ * @param z Target handle
+ */
+void zygote_stop(zygote *z);
+
+#endif
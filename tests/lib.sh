@@ -0,0 +1,103 @@
+#!/bin/bash
+# Helpers shared by the tests and benchmarks. The shell under test runs as a
+# coprocess, fed one command at a time, with its output read back line by
+# line.
+
+SHELL_BIN=${SHELL_BIN:-$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)/bin/shell}
+
+# Replies end with the error of a command that only the worker can answer,
+# which is printed once however many workers there are
+MARKER_COMMAND="logs 1"
+MARKER="PID not found (1)"
+
+TMP=$(mktemp -d)
+trap 'pm_stop; rm -rf "$TMP"' EXIT
+
+# Print a message and fail the test
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+# Skip the test, for features the host does not support
+skip() {
+    echo "SKIP: $*" >&2
+    exit 77
+}
+
+# Start the shell with the given options. The coprocess descriptors are
+# duplicated since subshells don't get them
+pm_start() {
+    coproc PM { exec stdbuf -oL "$SHELL_BIN" "$@" 2>&1; }
+    exec {PM_IN}>&"${PM[1]}" {PM_OUT}<&"${PM[0]}"
+}
+
+# Send a command without waiting for its reply
+pm_send() {
+    printf '%s\n' "$*" >&"$PM_IN"
+}
+
+# Send a command and print its reply, with anything still unread before it
+pm_do() {
+    pm_send "$@"
+    pm_send "$MARKER_COMMAND"
+    local line
+    while IFS= read -r -t 30 line <&"$PM_OUT"; do
+        [ "$line" = "$MARKER" ] && return 0
+        printf '%s\n' "$line"
+    done
+    fail "no reply to '$*'"
+}
+
+# Count the jobs in a state, live or recently terminated. Replies are read
+# in full before they are filtered, so none is left half read
+pm_count() {
+    local out
+    out=$(pm_do list) || exit 1
+    printf '%s\n' "$out" | grep -c "^[0-9]*,$1,"
+}
+
+# Print the pids of the jobs in a state
+pm_pids() {
+    local out
+    out=$(pm_do list) || exit 1
+    printf '%s\n' "$out" | awk -F, -v state="$1" '$2 == state { print $1 }'
+}
+
+# Poll list until a command given the list on stdin succeeds, at most
+# TIMEOUT seconds (10 by default)
+pm_wait() {
+    local deadline=$((SECONDS + ${TIMEOUT:-10}))
+    local out
+    while [ $SECONDS -lt $deadline ]; do
+        out=$(pm_do list) || exit 1
+        printf '%s\n' "$out" | "$@" && return 0
+        sleep 0.05
+    done
+    fail "timed out waiting for: $*"
+}
+
+# Succeed once no job is left RUNNING, READY or STOPPED
+no_live_jobs() {
+    ! grep -q ",\(RUNNING\|READY\|STOPPED\),"
+}
+
+# Exit the shell and wait for it
+pm_stop() {
+    if [ -n "${PM_IN:-}" ]; then
+        pm_send exit 2>/dev/null
+        exec {PM_IN}>&- {PM_OUT}<&-
+        PM_IN=
+        wait "$PM_PID" 2>/dev/null
+    fi
+}
+
+# Current time in seconds with nanoseconds
+now() {
+    date +%s.%N
+}
+
+# Seconds since a time taken with now
+elapsed() {
+    awk -v start="$1" -v end="$(now)" 'BEGIN { printf "%.3f", end - start }'
+}
@@ -0,0 +1,22 @@
+#!/bin/bash
+# Run every test, or the ones named on the command line, and report which
+# ones failed
+
+cd "$(dirname "$0")" || exit 1
+
+tests=("$@")
+if [ ${#tests[@]} -eq 0 ]; then
+    tests=(test_*.sh)
+fi
+
+failed=0
+for t in "${tests[@]}"; do
+    output=$(bash "$t" 2>&1)
+    case $? in
+        0) echo "PASS $t" ;;
+        77) echo "SKIP $t" ;;
+        *) echo "FAIL $t"; echo "$output" | sed 's/^/    /'; failed=$((failed + 1)) ;;
+    esac
+done
+
+[ $failed -eq 0 ]
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Job cgroups are removed once their jobs exit, killing processes that left
+# the job's process group, without holding up the worker. Needs a delegated
+# cgroup v2 directory in PM_CGROUP
+. "$(dirname "$0")/lib.sh"
+
+[ -n "${PM_CGROUP:-}" ] && [ -w "${PM_CGROUP}/cgroup.procs" ] \
+    || skip "set PM_CGROUP to a delegated cgroup v2 directory"
+
+# Print the number of job cgroups the shell created
+job_cgroups() {
+    ls -d "$PM_CGROUP"/job-* 2>/dev/null | grep -cvxFf "$TMP/before"
+}
+
+ls -d "$PM_CGROUP"/job-* > "$TMP/before" 2>/dev/null
+pm_start -c 2 -g "$PM_CGROUP"
+pm_do "run sh -c 'setsid sleep 300 & exit 0'"
+pm_do "run sleep 30"
+pm_wait grep -q ",TERMINATED,0,"
+
+# Commands are still answered while the straggler is killed
+start=$(now)
+pm_do list > /dev/null
+awk -v t="$(elapsed "$start")" 'BEGIN { exit !(t < 0.05) }' \
+    || fail "worker stalled removing a cgroup"
+
+deadline=$((SECONDS + 5))
+while [ "$(job_cgroups)" -ne 1 ] && [ $SECONDS -lt $deadline ]; do
+    sleep 0.05
+done
+[ "$(job_cgroups)" -eq 1 ] || fail "cgroup of an exited job left behind"
+pgrep -fx "sleep 300" > /dev/null && fail "straggler survived its job"
+
+# Jobs killed on exit leave nothing behind either
+pm_stop
+[ "$(job_cgroups)" -eq 0 ] || fail "cgroups left behind on exit"
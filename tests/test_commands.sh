@@ -0,0 +1,33 @@
+#!/bin/bash
+# Commands arriving together are all run and answered in order, however
+# many workers they are spread over
+. "$(dirname "$0")/lib.sh"
+
+for i in $(seq 1000); do
+    echo quantum
+    echo "logs $i"
+done > "$TMP/commands"
+
+for workers in 1 3; do
+    out=$("$SHELL_BIN" -j $workers -c 3 -f "$TMP/commands" 2>&1)
+    quantum=$(echo "$out" | grep -c '^policy=')
+    missing=$(echo "$out" | grep -c '^PID not found')
+    [ "$quantum" -eq $((1000 * workers)) ] \
+        || fail "[-j $workers] $quantum quantum replies"
+    [ "$missing" -eq 1000 ] || fail "[-j $workers] $missing logs replies"
+
+    # Replies come back in the order the commands were sent
+    order=$(echo "$out" | sed -n 's/^PID not found (\([0-9]*\))$/\1/p')
+    [ "$order" = "$(seq 1000)" ] || fail "[-j $workers] replies out of order"
+done
+
+# A single command larger than any pipe buffer
+args=$(seq 20000 | tr '\n' ' ')
+pm_start -l "$TMP"
+pm_do "run echo $args"
+pm_wait grep -q ",TERMINATED,0,"
+[ "$(cat "$TMP"/*.log)" = "${args% }" ] || fail "long command was cut"
+
+# A command too large to send to a worker says why
+out=$(echo "run true $(seq -s ' ' 70000)" | "$SHELL_BIN" -j 2 2>&1)
+echo "$out" | grep -q "Argument list too long" || fail "oversized command: $out"
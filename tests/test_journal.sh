@@ -0,0 +1,55 @@
+#!/bin/bash
+# A worker that dies is restarted and takes over its jobs as they were,
+# including jobs it had already killed
+. "$(dirname "$0")/lib.sh"
+
+# Kill the worker and wait for its replacement to answer
+restart_worker() {
+    local worker
+    worker=$(pgrep -P "$PM_PID" -x shell)
+    kill -9 "$worker"
+    while [ -e "/proc/$worker" ] \
+        && ! grep -q '^State:.*Z' "/proc/$worker/status" 2>/dev/null; do
+        sleep 0.01
+    done
+
+    # A command sent to the dead worker fails, and is answered without the
+    # marker. A worker restarted already answers it
+    local line
+    pm_send quantum
+    IFS= read -r -t 10 line <&"$PM_OUT" || fail "no reply after restart"
+    case $line in
+        "Worker exited before replying"|policy=*) ;;
+        *) fail "unexpected reply '$line'" ;;
+    esac
+
+    TIMEOUT=10 pm_wait grep -q "$1"
+}
+
+mkdir "$TMP/journal"
+pm_start -c 2 -r "$TMP/journal"
+pm_do "run sleep 30"
+pm_do "run sleep 1"
+pm_do "run bash -c 'trap \"sleep 1; exit 9\" TERM; sleep 30 & wait'"
+running=$(pm_pids RUNNING | head -1)
+stopping=$(pm_pids READY)
+pm_do "stop $running"
+pm_wait grep -q "^$stopping,RUNNING,"
+pm_do "kill $stopping"
+pm_wait grep -q "^$stopping,TERMINATED,"
+
+# The killed job is still exiting, live lines show its CPU time third
+restart_worker "^$running,"
+pm_wait grep -q "^$running,STOPPED,"
+pm_wait grep -q "^$stopping,TERMINATED,[0-9]*\.[0-9]*,"
+
+# Jobs taken over still exit into list, without leaving zombies behind
+pm_wait grep -q ",TERMINATED,0,"
+pm_wait grep -q "^$stopping,TERMINATED,9,"
+pm_do "resume $running"
+pm_wait grep -q "^$running,RUNNING,"
+pm_do "kill $running"
+pm_wait grep -q "^$running,TERMINATED,-15,"
+pm_do list > /dev/null
+zombies=$(ps -o stat= --ppid "$PM_PID" | grep -c Z)
+[ "$zombies" -eq 0 ] || fail "$zombies zombies left"
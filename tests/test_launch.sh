@@ -0,0 +1,57 @@
+#!/bin/bash
+# Jobs without a slot never execute the program until they get one, with
+# every launch path, and programs that can't be executed are reported
+. "$(dirname "$0")/lib.sh"
+
+for mode in "" "-z" "-t 2"; do
+    # shellcheck disable=SC2086
+    pm_start -c 1 $mode
+    pm_do "run -n 3 sh -c 'touch $TMP/ran.{i}; exec sleep 30'"
+    pm_wait grep -q ",RUNNING,"
+    [ "$(pm_count READY)" -eq 2 ] || fail "[$mode] expected two ready jobs"
+    sleep 0.3
+    ran=$(ls "$TMP" | grep -c '^ran\.')
+    [ "$ran" -eq 1 ] || fail "[$mode] $ran jobs ran with one slot"
+
+    # The next job only starts once the slot is free
+    pm_do "kill $(pm_pids RUNNING)"
+    pm_wait grep -q ",RUNNING,"
+    sleep 0.3
+    ran=$(ls "$TMP" | grep -c '^ran\.')
+    [ "$ran" -eq 2 ] || fail "[$mode] $ran jobs ran after one was killed"
+
+    for pid in $(pm_pids RUNNING) $(pm_pids READY); do
+        pm_do "kill $pid"
+    done
+    pm_wait no_live_jobs
+
+    # A held job that can't execute its program fails once it is let go
+    pm_do "run sleep 30"
+    pm_do "run $TMP/missing"
+    pm_do "kill $(pm_pids RUNNING)"
+    pm_wait grep -q ",TERMINATED,127,"
+    pm_stop
+    rm -f "$TMP"/ran.*
+done
+
+pm_start
+out=$(pm_do "run $TMP/missing")
+echo "$out" | grep -q "error running $TMP/missing" \
+    || fail "exec failure not reported"
+pm_stop
+
+# The fork-server passes on every argument, not just the first thousand
+pm_start -z
+pm_do "run sh -c 'echo \$# > $TMP/argc' x $(seq -s ' ' 1500)"
+pm_wait grep -q ",TERMINATED,0,"
+[ "$(cat "$TMP/argc")" = 1500 ] || fail "-z passed $(cat "$TMP/argc") arguments"
+pm_stop
+
+# A script without a shebang gets its arguments copied onto the stack of the
+# child, which must fit however many there are
+printf 'echo $# > %s/argc\n' "$TMP" > "$TMP/script"
+chmod +x "$TMP/script"
+pm_start
+pm_do "run $TMP/script $(seq -s ' ' 20000)"
+pm_wait grep -q ",TERMINATED,0,"
+[ "$(cat "$TMP/argc")" = 20000 ] || fail "script got $(cat "$TMP/argc") arguments"
@@ -0,0 +1,23 @@
+#!/bin/bash
+# Job output reaches its log in full, including what jobs still write while
+# the shell exits
+. "$(dirname "$0")/lib.sh"
+
+pm_start -l "$TMP"
+pm_do "run echo done"
+pm_wait grep -q ",TERMINATED,0,"
+pm_do "run sh -c 'trap \"echo bye; exit\" TERM; echo hi; while :; do sleep 0.01; done'"
+pm_wait grep -q ",RUNNING,"
+pid=$(pm_pids RUNNING)
+
+# The job is only told to stop once its trap is set
+for _ in $(seq 100); do
+    [ -s "$TMP/$pid"-*.log ] && break
+    sleep 0.05
+done
+pm_stop
+
+grep -qx done "$TMP"/*.log || fail "output of a finished job lost"
+log=$(cat "$TMP/$pid"-*.log)
+[ "$(echo "$log" | sed -n '1p;$p')" = "$(printf 'hi\nbye')" ] \
+    || fail "output written at exit lost: $log"
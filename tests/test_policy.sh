@@ -0,0 +1,22 @@
+#!/bin/bash
+# A short job overtakes a long CPU-bound one under mlfq, and waits behind it
+# under fifo
+. "$(dirname "$0")/lib.sh"
+
+LONG="run sh -c 'while :; do :; done'"
+SHORT="run sh -c 'i=0; while [ \$i -lt 20000 ]; do i=\$((i+1)); done'"
+
+pm_start -c 1 -s fifo
+pm_do "$LONG"
+sleep 0.3
+pm_do "$SHORT"
+sleep 1
+[ "$(pm_count READY)" -eq 1 ] || fail "short job ran ahead under fifo"
+pm_stop
+
+pm_start -c 1 -s mlfq -q 50
+pm_do "$LONG"
+sleep 0.3
+pm_do "$SHORT"
+pm_wait grep -q ",TERMINATED,0,"
+[ "$(pm_count RUNNING)" -eq 1 ] || fail "long job stopped running under mlfq"
@@ -0,0 +1,13 @@
+#!/bin/bash
+# Quoted and escaped words reach the program as the shell would pass them
+. "$(dirname "$0")/lib.sh"
+
+pm_start -l "$TMP"
+pm_do "run	printf '%s|' 'a b' \"c \\\"d\\\"\" e\\ f 'g\\h' \"\"	tab  end"
+pm_wait grep -q ",TERMINATED,0,"
+expected='a b|c "d"|e f|g\h||tab|end|'
+[ "$(cat "$TMP"/*.log)" = "$expected" ] \
+    || fail "got '$(cat "$TMP"/*.log)', expected '$expected'"
+
+out=$(pm_do "run echo 'unterminated")
+echo "$out" | grep -q "Unterminated quote" || fail "unterminated quote accepted"
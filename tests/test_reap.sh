@@ -0,0 +1,25 @@
+#!/bin/bash
+# Every job of a burst is reaped, and stops and continues from outside the
+# shell show up in list and free or take back the slot
+. "$(dirname "$0")/lib.sh"
+
+pm_start -c 8
+pm_do "run -n 1000 true"
+pm_wait no_live_jobs
+pm_stop
+
+pm_start -c 1
+pm_do "run sleep 30"
+pm_do "run sleep 30"
+first=$(pm_pids RUNNING)
+second=$(pm_pids READY)
+[ -n "$first" ] && [ -n "$second" ] || fail "expected one running and one ready job"
+
+kill -STOP "$first"
+pm_wait grep -q "^$first,STOPPED,"
+pm_wait grep -q "^$second,RUNNING,"
+
+# The earlier job wins its slot back under fifo
+kill -CONT "$first"
+pm_wait grep -q "^$first,RUNNING,"
+pm_wait grep -q "^$second,READY,"
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Several workers share one slot budget, hand slots to each other and merge
+# their lists
+. "$(dirname "$0")/lib.sh"
+
+pm_start -j 3 -c 3
+[ "$(pm_do quantum | grep -c '^policy=')" -eq 3 ] || fail "expected 3 workers"
+
+pm_do "run -n 9 sleep 30"
+pm_wait awk '/,RUNNING,/ { r++ } /,READY,/ { q++ } END { exit !(r == 3 && q == 6) }'
+
+# Freed slots go to jobs waiting in any worker, never beyond the budget
+for pid in $(pm_pids RUNNING); do
+    pm_do "kill $pid"
+done
+pm_wait awk '/,RUNNING,/ { r++ } /,READY,/ { q++ } END { exit !(r == 3 && q == 3) }'
+
+for pid in $(pm_pids RUNNING) $(pm_pids READY); do
+    pm_do "kill $pid"
+done
+pm_wait no_live_jobs
+
+pm_do "run -n 300 true"
+pm_wait no_live_jobs
+[ "$(pm_count TERMINATED)" -gt 64 ] || fail "workers' histories were not merged"
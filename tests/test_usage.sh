@@ -0,0 +1,17 @@
+#!/bin/bash
+# list reports the CPU time, CPU%, RSS and context switches of live jobs
+. "$(dirname "$0")/lib.sh"
+
+pm_start -c 2 -i 100
+pm_do "run sh -c 'while :; do :; done'"
+pm_do "run sh -c 'while :; do sleep 0.01; done'"
+sleep 1
+out=$(pm_do list)
+
+# pid,status,cpu,cpu%,rss,voluntary,involuntary
+busy=$(echo "$out" | sed -n 1p)
+idle=$(echo "$out" | sed -n 2p)
+echo "$busy" | awk -F, '$3 > 0.2 && $4 > 20 && $5 > 0 { ok = 1 } END { exit !ok }' \
+    || fail "busy job sampled as '$busy'"
+echo "$idle" | awk -F, '$4 < 20 && $5 > 0 && $6 > 10 { ok = 1 } END { exit !ok }' \
+    || fail "sleeping job sampled as '$idle'"